@@ -3,42 +3,634 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <float.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
 
 #include "approximateCompression_internal.h"
 #include "bitUtils.h"
 #include "bucket.h"
 #include "uint8.h"
+#include "segment.h"
+#include "context.h"
+#include "halfFloat.h"
+#include "sign.h"
 
 // Command to compile: gcc -std=gnu99 -c approximateCompression.c
 
 #define VERBOSE 0
 #define DEBUG 0
 
-// BLOCK_SIZE is the maximum size of data that can be compressed
-// without divided into multiple blocks
-#define BLOCK_SIZE (256 * 1024)
-
-// Compressed FP array structure
-// Size of the compressed array in bytes uint32_t
-// meta data, for example size (16/32/64), maximum err (1/0.5/0.25 etc) uint32_t
-// Number of elements N uint32_t
-// Number of batches n uint32_t
+// Worst case size of the compressed array. In the worst case every
+// element is a batch of its own, a batch of one element takes the
+// batch size and the element itself. Larger batches take less space
+// per element, even if delta encoding of a batch takes more bytes
+// than the plain bucket numbers. The encoded data of a batch is
+// written to the output before it is compared with the plain bucket
+// numbers, which replace it if it is not smaller. For a small batch
+// with zeros the encoded data that is replaced may reach a byte or two
+// past the bound of the batch. That matters only for the last batch of
+// a chunk, and BOUND_SLACK at the end of each chunk covers it
+#define HEADER_SIZE (4 * sizeof(uint32_t) + 2 * sizeof(uint64_t))
+#define HEADER_SIZE_V1 (4 * sizeof(uint32_t))
+#define BOUND_SLACK 8
+
+// Compressed FP array structure, version 2
+// Size of the compressed array in bytes uint32_t, UINT32_MAX if larger
+// meta data, for example size (16/32/64), maximum err (1/0.5/0.25 etc),
+//   version uint32_t
+// Size of the compressed array in bytes uint64_t
+// Number of elements N uint64_t
+// Number of batches n uint64_t
 // Repeated n times
-//   Number of elements in this batch uint16_t
+//   Number of elements in this batch varint
 //   Max and Min for this batch 32|64 bit
 //   Type of encoding used in this batch uint8_t
-//   Number of bytes in this batch uint16_t
-//   Encoded bit representation for each element
+//   Number of bytes of encoded data varint, unless the type is 0
+//   Encoded bit representation for each element, with checkpoints if the
+//     meta data has a checkpoint interval, see uint8.c
+//   Signs of the elements, if the array has negative numbers
+// Index of the batches, if the meta data has METADATA_INDEX
+//   Repeated m times
+//     Number of the first element of the batch uint64_t
+//     Offset of the batch from the start of the array uint64_t
+//   Number of entries m uint64_t
+//
+// Version 1 arrays, which are still read, have a 16 byte header of the
+// size, meta data, N and n as uint32_t. The number of elements of a batch
+// and the number of bytes of encoded data (counting the two bytes of the
+// number itself) are uint16_t. A varint is stored as by put_varint, see
+// bitUtils.c. Batches of one or two elements hold the numbers unencoded,
+// instead of Max and Min
+
+// The version is stored in bits 8 to 15 of the meta data, which are 0 in
+// version 1 arrays
+#define METADATA_VERSION_SHIFT 8
+#define FORMAT_VERSION 2
+
+// Metadata flag of arrays which end with an index of the batches. A batch
+// has an entry in the index if it starts at least INDEX_INTERVAL elements
+// after the batch of the previous entry, so that small batches do not make
+// the index larger than the data. The first batch always has an entry
+#define METADATA_INDEX (1 << 16)
+#define INDEX_INTERVAL 1024
+#define INDEX_ENTRY_SIZE (2 * sizeof(uint64_t))
+
+// Bits 24 to 28 of the meta data hold n, the encoded data of a batch has a
+// checkpoint every 2 ^ n elements. There are no checkpoints if n is 0
+#define METADATA_CHECKPOINT_SHIFT 24
+#define METADATA_CHECKPOINT_MASK 0x1f
+
+// Largest number of elements of a batch. The bucket numbers of a batch
+// are staged in memory, which limits the batch size, not the format
+#define MAX_BATCH_SIZE (1 << 20)
+
+// Number of elements of a chunk compressed by one thread, when the context
+// has more than one. A chunk starts a new batch, which costs nothing
+// noticeable at this size
+#define CHUNK_SIZE (1 << 18)
+
+// Trailing batches of fewer numbers are reopened by an append, the new
+// numbers that fall within the bounds of the batch join it. A larger
+// trailing batch is left as it is, so that appending a few numbers does
+// not encode a whole batch again
+#define REOPEN_SIZE 4096
+
+// Number of elements bucketized at a time by compress_batch. The
+// input numbers of a stage (16 or 32 KB) stay in L1 cache while the
+// delta statistics of the stage are collected
+#define STAGE_SIZE 4096
+
+// Metadata flag of arrays whose batch bounds and unencoded numbers are
+// stored in double precision. Batch bounds and unencoded numbers of double
+// precision arrays are stored in single precision, like the ones of single
+// precision arrays, unless a number is beyond the range of float
+#define METADATA_WIDE_VALUES 0x40
+
+// Metadata flag of arrays which have negative numbers. Batches are made of
+// the magnitudes of the numbers, the signs of the numbers of a batch follow
+// its encoded magnitudes, see sign.c. Unencoded numbers keep their sign
+#define METADATA_SIGNED 0x80
+
+// The header of a compressed array, as read by read_header
+typedef struct {
+	uint64_t size;		// Size of the compressed array in bytes
+	uint64_t elem_count;
+	uint64_t batch_count;
+	uint32_t header_size;
+	uint8_t version;
+	uint8_t precision;
+	uint8_t accuracy;
+	size_t value_size;	// Size of batch bounds and unencoded numbers
+	int is_signed;		// The batches are followed by their signs
+	int has_index;		// The batches are followed by their index
+	uint32_t checkpoint_interval;	// 0 if there are no checkpoints
+} array_header;
+
+// Size in bytes of one uncompressed number
+static size_t
+precision_size(uint8_t precision)
+{
+	if (precision == PRECISION_SINGLE)
+		return sizeof(float);
+	else if (precision == PRECISION_DOUBLE)
+		return sizeof(double);
+	else // PRECISION_HALF or PRECISION_BFLOAT16
+		return sizeof(uint16_t);
+}
+
+// Returns element i of a float, double, half precision or bfloat16 array
+static inline double
+get_value(void *input, uint8_t precision, size_t i)
+{
+	if (precision == PRECISION_SINGLE)
+		return ((float *) input)[i];
+	else if (precision == PRECISION_DOUBLE)
+		return ((double *) input)[i];
+	else if (precision == PRECISION_HALF)
+		return half_to_float(((uint16_t *) input)[i]);
+	else // PRECISION_BFLOAT16
+		return bfloat16_to_float(((uint16_t *) input)[i]);
+}
+
+// Sets element i of a float, double, half precision or bfloat16 array.
+// Numbers beyond the range of the 16 bit formats are set to their
+// largest number, as unbucketize does
+static inline void
+set_value(void *output, uint8_t precision, size_t i, double value)
+{
+	if (precision == PRECISION_SINGLE)
+		((float *) output)[i] = value;
+	else if (precision == PRECISION_DOUBLE)
+		((double *) output)[i] = value;
+	else if (precision == PRECISION_HALF)
+		((uint16_t *) output)[i] = float_to_half(isinf(value) ? value : fmax(fmin(value, HALF_MAX), -HALF_MAX));
+	else // PRECISION_BFLOAT16
+		((uint16_t *) output)[i] = float_to_bfloat16(isinf(value) ? value : fmax(fmin(value, BFLOAT16_MAX), -BFLOAT16_MAX));
+}
+
+// Returns 1 if some number can not be stored in single precision without
+// overflow or loss of precision due to underflow, 0 otherwise
+static int
+needs_wide_values(double *input, uint64_t elem_count)
+{
+double val;
+
+	for (uint64_t i = 0; i < elem_count; i++) {
+		val = fabs(input[i]);
+		if ((val > FLT_MAX && val != INFINITY) || (val < FLT_MIN && val != 0.0))
+			return 1;
+	}
+
+	return 0;
+}
+
+// Batch bounds stored in single precision are rounded towards zero. The
+// rounded minimum is the divisor of the batch, so that no number of a
+// positive batch is below it. The rounded bounds of a batch are within
+// the range min .. 2 * min, just like the exact ones
+static double
+narrow_bound(double value)
+{
+float val32;
+
+	val32 = value;
+	if (fabs(val32) > fabs(value))
+		val32 = nextafterf(val32, 0.0);
+
+	return val32;
+}
+
+// Stores a batch bound or an unencoded number in value_size bytes,
+// returns the pointer past it
+static uint8_t *
+put_value(uint8_t *ptr, double value, size_t value_size)
+{
+float val32;
+
+	if (value_size == sizeof(float)) {
+		val32 = value;
+		memcpy(ptr, &val32, sizeof(float));
+	} else
+		memcpy(ptr, &value, sizeof(double));
+
+	return ptr + value_size;
+}
+
+// Reads a value stored by put_value, returns the pointer past it
+static uint8_t *
+read_value(uint8_t *ptr, double *value, size_t value_size)
+{
+float val32;
+
+	if (value_size == sizeof(float)) {
+		memcpy(&val32, ptr, sizeof(float));
+		*value = val32;
+	} else
+		memcpy(value, ptr, sizeof(double));
+
+	return ptr + value_size;
+}
+
+// Bucketizes count numbers of the array input, whose precision is
+// precision, within the bounds of a batch. Returns 0 on success, -1 in
+// case of error
+static int
+bucketize_values(uint32_t count, void *input, uint8_t precision, double max, double min, uint8_t accuracy, 
+		uint8_t *bucketized_array)
+{
+	if (precision == PRECISION_SINGLE)
+		return bucketize_into(count, input, max, min, accuracy, bucketized_array);
+	else if (precision == PRECISION_DOUBLE)
+		return bucketize_double_into(count, input, max, min, accuracy, bucketized_array);
+	else if (precision == PRECISION_HALF)
+		return bucketize_half_into(count, input, max, min, accuracy, bucketized_array);
+	else // PRECISION_BFLOAT16
+		return bucketize_bfloat16_into(count, input, max, min, accuracy, bucketized_array);
+}
+
+// Writes the encode key and the encoded data of the bucket numbers of a
+// batch, whose delta statistics are stats, to batch_ptr. Returns number of
+// bytes written, 0 in case of error
+static uint32_t
+encode_buckets(delta_stats *stats, uint32_t batch_size, uint32_t checkpoint_interval, uint8_t *bucketized_array, 
+		uint8_t *batch_ptr)
+{
+uint8_t batch_encode_key;
+uint32_t encoded_size;
+uint32_t size_bytes;
+
+	batch_encode_key = bucket_choose_key(stats);
+	*batch_ptr++ = batch_encode_key;
+
+	if (batch_encode_key == 0) {
+		// Delta encoding is not possible, copy the bucketized array
+		memcpy(batch_ptr, bucketized_array, batch_size);
+
+		return 1 + batch_size;
+	}
+
+	size_bytes = varint_size(batch_size);
+	encoded_size = uint8_encode(batch_encode_key, batch_size, bucketized_array, batch_ptr + size_bytes, 
+			checkpoint_interval);
+	if (DEBUG)
+		printf("encoded size = %d\n", encoded_size);
+
+	// The bucketized array is copied instead if the encoding does
+	// not make it smaller
+	if (encoded_size == 0 || size_bytes + encoded_size >= batch_size) {
+		*(batch_ptr - 1) = 0;
+		memcpy(batch_ptr, bucketized_array, batch_size);
+
+		return 1 + batch_size;
+	}
+
+	put_varint_padded(batch_ptr, encoded_size, size_bytes);
+
+	return 1 + size_bytes + encoded_size;
+}
+
+// Bucketizes and encodes one batch, writing the encode key followed by
+// the encoded (or plain bucketized) data at batch_ptr. The batch is 
+// processed in stages, the delta statistics of a stage are collected
+// right after it is bucketized. The bucket numbers are staged in the
+// caller provided array bucketized_array, which must have space for
+// batch_size elements. The encoder writes straight into the output,
+// there is no intermediate buffer, after room for the varint of the
+// encoded size. The size is smaller than batch_size, so the room is
+// the size of the varint of batch_size, and the varint is padded to
+// fill it. The encoded data has a checkpoint every checkpoint_interval
+// elements, none if it is 0. Returns number of bytes written, 0 in case
+// of error
+static uint32_t
+compress_batch(uint32_t batch_size, void *input, uint8_t precision, double max, double min, uint8_t accuracy, 
+		uint32_t checkpoint_interval, uint8_t *bucketized_array, uint8_t *batch_ptr)
+{
+delta_stats stats;
+uint32_t stage_size;
+int status;
+
+	bucket_stats_init(&stats);
+
+	for (uint32_t i = 0; i < batch_size; i += stage_size) {
+		stage_size = batch_size - i;
+		if (stage_size > STAGE_SIZE)
+			stage_size = STAGE_SIZE;
+
+		status = bucketize_values(stage_size, (uint8_t *) input + i * precision_size(precision), precision, 
+				max, min, accuracy, bucketized_array + i);
+		if (status != 0)
+			return 0;
+
+		// The statistics keep the last bucket of the previous
+		// stage, so that no delta is missed
+		bucket_stats_collect(&stats, stage_size, bucketized_array + i);
+	}
+
+	return encode_buckets(&stats, batch_size, checkpoint_interval, bucketized_array, batch_ptr);
+}
+
+// A chunk of the input array, compressed into batches which do not depend
+// on the batches of the other chunks
+typedef struct {
+	uint64_t start;		// First element of the chunk
+	uint64_t count;		// Number of elements of the chunk
+	uint8_t *output;	// Batches of the chunk
+	uint64_t size;		// Size of the batches in bytes
+	uint64_t batch_count;
+	uint64_t *index;	// Index entries, the offsets are from output
+	uint64_t index_count;
+	int wide;		// Some number needs wide values
+	int negative;		// Some number has its sign bit set
+	int status;		// 0 on success, -1 in case of error
+} compress_chunk;
+
+// The chunks of a call are handed out to its threads in order
+typedef struct {
+	uint64_t chunk_count;
+	uint64_t next_chunk;	// Next chunk to be taken by a thread
+	uint32_t next_thread;	// Number of threads started so far
+} work_queue;
+
+// The array being compressed, shared by the threads of the compressor
+typedef struct {
+	work_queue queue;
+	void *input;
+	uint8_t precision;
+	uint8_t accuracy;
+	size_t value_size;
+	int is_signed;
+	uint32_t checkpoint_interval;
+	int open_end;		// The last batch is left open, see append_batches
+	compress_chunk *chunks;
+	uint8_t *staging;	// Bucket numbers, staging_size bytes per thread
+	size_t staging_size;
+} compress_job;
+
+// Writes the batches of the chunk to chunk->output and the index entries
+// of the batches to chunk->index, if it is not NULL. The bucket numbers of
+// a batch are staged in bucketized_array. Returns 0 on success, -1 in case
+// of error
+static int
+compress_chunk_batches(compress_job *job, compress_chunk *chunk, uint8_t *bucketized_array)
+{
+double min;
+double max;
+double open_min;
+float max32;
+float min32;
+void *input;
+uint8_t precision;
+size_t value_size;
+uint8_t *batch_ptr;
+uint8_t *batch_input;
+uint32_t batch_size;
+uint64_t start;
+uint64_t end;
+uint32_t byte_count;
+uint32_t scan_count;
+uint32_t lead;
+
+	input = job->input;
+	precision = job->precision;
+	value_size = job->value_size;
+
+	batch_ptr = chunk->output;
+	chunk->batch_count = 0;
+	chunk->index_count = 0;
+
+	start = chunk->start;
+	end = chunk->start + chunk->count;
+
+	// Loop through all batches. A batch is a sequence such that
+	// all numbers are within a range of min .. 2 * min
+
+	while (start < end) {
+		// Started processing a new batch
+		chunk->batch_count++;
+
+		// Every index entry but the first is INDEX_INTERVAL elements
+		// after the previous one
+		if (chunk->index != NULL && (chunk->index_count == 0 || 
+				start >= chunk->index[2 * (chunk->index_count - 1)] + INDEX_INTERVAL)) {
+			chunk->index[2 * chunk->index_count] = start;
+			chunk->index[2 * chunk->index_count + 1] = batch_ptr - chunk->output;
+			chunk->index_count++;
+		}
+
+		// A batch can not be more than MAX_BATCH_SIZE
+		scan_count = MAX_BATCH_SIZE;
+		if (end - start < MAX_BATCH_SIZE)
+			scan_count = end - start;
+
+		// 0.0 goes to the zero bucket of a batch, the bounds of the
+		// batch start with the first number which is not 0.0
+		lead = 0;
+		while (lead < scan_count && get_value(input, precision, start + lead) == 0.0)
+			lead++;
+
+		if (lead < scan_count) {
+			max = fabs(get_value(input, precision, start + lead));
+			min = max;
+		}
+
+		// The numbers scanned for the end of the batch follow the
+		// first number which is not 0.0
+		batch_input = (uint8_t *) input + (start + lead + 1) * precision_size(precision);
+
+		if (lead < scan_count && max < 2.0 * min) {
+			if (precision == PRECISION_DOUBLE)
+				batch_size = lead + 1 + segment_batch_double(scan_count - lead - 1, (double *) batch_input, 
+						&max, &min);
+			else {
+				max32 = max;
+				min32 = min;
+				if (precision == PRECISION_SINGLE)
+					batch_size = lead + 1 + segment_batch(scan_count - lead - 1, (float *) batch_input, 
+							&max32, &min32);
+				else if (precision == PRECISION_HALF)
+					batch_size = lead + 1 + segment_batch_half(scan_count - lead - 1, (uint16_t *) batch_input, 
+							&max32, &min32);
+				else // PRECISION_BFLOAT16
+					batch_size = lead + 1 + segment_batch_bfloat16(scan_count - lead - 1, (uint16_t *) batch_input, 
+							&max32, &min32);
+				max = max32;
+				min = min32;
+			}
+		} else {
+			// The batch has only zeros, up to infinity or a number 
+			// that is not a number, which can not be bucketized. 
+			// Any bounds will do
+			max = 1.0;
+			min = 1.0;
+			batch_size = lead;
+		}
+
+		// At this pointed we have just identified a batch. In some
+		// case, the entire input array may be a batch, but a batch 
+		// may not have more than MAX_BATCH_SIZE elements
+
+		// A batch of one or two elements is read back as unencoded
+		// numbers, so it is written that way. A number that can not
+		// be bucketized forms a batch of its own
+		if (batch_size < 3) {
+			if (batch_size == 0)
+				batch_size = 1;
+
+			batch_ptr = put_varint(batch_ptr, batch_size);
+			for (uint32_t j = 0; j < batch_size; j++)
+				batch_ptr = put_value(batch_ptr, get_value(input, precision, start + j), value_size);
+			start += batch_size;
+
+			if (VERBOSE)
+				printf("Batch # %llu has %d unencoded elements, first = %.9f\n", 
+						(unsigned long long) (chunk->batch_count - 1), batch_size, 
+						get_value(input, precision, start - batch_size));
+
+			continue;
+		}
+		
+		if (VERBOSE)
+			printf("Batch # %llu has %d elements, max = %.9f, min = %.9f\n", 
+					(unsigned long long) (chunk->batch_count - 1), batch_size, max, min);
+
+		batch_ptr = put_varint(batch_ptr, batch_size);
+
+		// The batch is bucketized with the bounds as they are stored
+		if (value_size == sizeof(float)) {
+			max = narrow_bound(max);
+			min = narrow_bound(min);
+		}
+
+		// The bucket numbers are relative to the minimum, any minimum
+		// from max / 2 to min will do. The minimum of an open batch
+		// is lowered so that its range is centered on its numbers,
+		// and the numbers appended next are likely to join it
+		if (job->open_end && start + batch_size == end && batch_size < REOPEN_SIZE) {
+			open_min = sqrt(max * min / 2.0);
+			if (value_size == sizeof(float))
+				open_min = narrow_bound(open_min);
+			if (open_min <= min && max <= 2.0 * open_min)
+				min = open_min;
+		}
+
+		batch_ptr = put_value(batch_ptr, max, value_size);
+		batch_ptr = put_value(batch_ptr, min, value_size);
+
+		byte_count = compress_batch(batch_size, (uint8_t *) input + start * precision_size(precision), precision, 
+				max, min, job->accuracy, job->checkpoint_interval, bucketized_array, batch_ptr);
+		if (byte_count == 0)
+			return (-1);
+
+		batch_ptr += byte_count;
+
+		if (job->is_signed)
+			batch_ptr += sign_encode(batch_size, (uint8_t *) input + start * precision_size(precision), 
+					precision, batch_ptr);
+
+		if (DEBUG)
+			printf("start = %llu\tsize = %d\n", (unsigned long long) start, batch_size);
+
+		start += batch_size;
+	}
+
+	chunk->size = batch_ptr - chunk->output;
+
+	return 0;
+}
+
+// Returns the number of the calling thread, counting from 0
+static uint32_t
+start_thread(work_queue *queue)
+{
+	return __atomic_fetch_add(&queue->next_thread, 1, __ATOMIC_RELAXED);
+}
+
+// Sets c to the next chunk to be done by the calling thread. Returns 0 if
+// all chunks have been taken
+static int
+take_chunk(work_queue *queue, uint64_t *c)
+{
+	*c = __atomic_fetch_add(&queue->next_chunk, 1, __ATOMIC_RELAXED);
+
+	return *c < queue->chunk_count;
+}
+
+// Finds whether the numbers of the chunks taken from the job need wide
+// values and whether they have negative numbers
+static void *
+scan_worker(void *arg)
+{
+compress_job *job;
+compress_chunk *chunk;
+uint8_t *input;
+uint64_t c;
+
+	job = arg;
+
+	while (take_chunk(&job->queue, &c)) {
+		chunk = &job->chunks[c];
+		input = (uint8_t *) job->input + chunk->start * precision_size(job->precision);
+
+		chunk->wide = (job->precision == PRECISION_DOUBLE && needs_wide_values((double *) input, chunk->count));
+		chunk->negative = sign_any_negative(chunk->count, input, job->precision);
+	}
+
+	return NULL;
+}
+
+// Compresses the chunks taken from the job, the thread stages bucket
+// numbers in a slice of the staging memory of its own
+static void *
+compress_worker(void *arg)
+{
+compress_job *job;
+uint8_t *bucketized_array;
+uint64_t c;
+
+	job = arg;
+	bucketized_array = job->staging + start_thread(&job->queue) * job->staging_size;
+
+	while (take_chunk(&job->queue, &c))
+		job->chunks[c].status = compress_chunk_batches(job, &job->chunks[c], bucketized_array);
+
+	return NULL;
+}
+
+// Runs worker(job) on thread_count threads, the calling thread being one
+// of them, and waits until all chunks of the queue are done. The chunks of
+// a thread that can not be created are taken by the other threads
+static void
+run_workers(void *job, work_queue *queue, int thread_count, void *(*worker)(void *))
+{
+pthread_t threads[MAX_THREADS];
+int created;
+
+	queue->next_chunk = 0;
+	queue->next_thread = 0;
+
+	created = 0;
+	while (created < thread_count - 1 && pthread_create(&threads[created], NULL, worker, job) == 0)
+		created++;
+
+	worker(job);
+
+	for (int i = 0; i < created; i++)
+		pthread_join(threads[i], NULL);
+}
 
 /*
 ** This function accepts as input a floating point array
-** and returns an opaque structure (array of bytes) containing
-** the compressed array. The first 4 bytes contain the length
-** N followed by N bytes. It can be uncompressed by calling
-** function uncompress_float and passing on the pointer to the
-** opaque structure.
+** and writes an opaque structure (array of bytes) containing
+** the compressed array to output_bucket. The first 4 bytes
+** contain the length N followed by N bytes. It can be uncompressed
+** by calling function uncompress_float and passing on the pointer
+** to the opaque structure.
 **
-** In case of any error, a NULL pointer is returned
+** The output_bucket must have space for compress_bound bytes. The
+** bucket numbers of a batch are staged in the arena of the context
+** ctx. Returns the length N, in case of any error 0 is returned
 **
 ** The compression is approximate and the accuracy is specified by
 ** the third parameter. Possible values are ACCURACY_HALF_PERCENT,
@@ -63,546 +655,2505 @@
 **	  bucket number. The delta is encoded representation of the
 **	  difference, typically encoded using 1 to 4 bits. Potentially
 **	  each batch of numbers can be encoded differently
+**
+** If the context has more than one thread, the array is split in
+** chunks of CHUNK_SIZE numbers which are compressed in parallel.
+** A chunk starts a new batch, so the array is read like any other
 */
+static size_t
+approximate_compress(ac_context *ctx, uint64_t elem_count, uint8_t precision, uint8_t accuracy, void *input, uint8_t *output_bucket)
+{
+compress_job job;
+compress_chunk *chunk;
+uint64_t chunk_size;
+size_t elem_bound;
+uint8_t *batch_ptr;
+uint64_t batch_count;
+uint32_t metadata;
+uint64_t output_size;
+uint32_t val32[2];
+uint64_t val64[3];
+uint64_t *index;
+uint64_t index_count;
+uint64_t entry[2];
+int thread_count;
+int has_index;
+
+	// Compressed FP array structure, see the top of this file
+	// Size of the compressed array in bytes uint32_t
+	// Meta data, for example size (16/32/64), maximum err (1/0.5/0.25 etc),
+	//   version uint32_t
+	// Size of the compressed array in bytes uint64_t
+	// Number of elements N uint64_t
+	// Number of batches n uint64_t
+	// Repeated n times
+	//   Number of elements in this batch varint
+	//   Max and Min for this batch 32|64 bit
+	//   Type of encoding used in this batch uint8_t
+	//   Number of bytes of encoded data varint
+	//   Encoded bit representation for each element
+	//   Signs of the elements, if the array has negative numbers
+	// Index of the batches, if the context asks for one or if the
+	//   array has several chunks
+
+	// The whole array is a single chunk unless it is compressed by
+	// several threads. The index is the directory of the chunks, the
+	// first batch of a chunk always has an entry
+	chunk_size = elem_count;
+	thread_count = 1;
+	if (ctx->thread_count > 1 && elem_count > CHUNK_SIZE) {
+		chunk_size = CHUNK_SIZE;
+		thread_count = ctx->thread_count;
+	}
+
+	job.queue.chunk_count = 1;
+	if (elem_count > chunk_size)
+		job.queue.chunk_count = (elem_count + chunk_size - 1) / chunk_size;
+	if (thread_count > job.queue.chunk_count)
+		thread_count = job.queue.chunk_count;
+
+	has_index = (ctx->index || job.queue.chunk_count > 1);
+
+	job.chunks = arena_reserve(&ctx->chunks, job.queue.chunk_count * sizeof(compress_chunk));
+	if (job.chunks == NULL)
+		return 0;
+
+	job.staging_size = chunk_size < MAX_BATCH_SIZE ? chunk_size : MAX_BATCH_SIZE;
+	job.staging = arena_reserve(&ctx->staging, thread_count * job.staging_size);
+	if (job.staging == NULL && elem_count > 0)
+		return 0;
+
+	// The index entries are staged until the last batch is written,
+	// a chunk has at most one entry per INDEX_INTERVAL elements, plus
+	// the entry of its first batch
+	index = NULL;
+	if (has_index) {
+		index = arena_reserve(&ctx->index_staging, 
+				(elem_count / INDEX_INTERVAL + job.queue.chunk_count) * INDEX_ENTRY_SIZE);
+		if (index == NULL)
+			return 0;
+	}
+
+	// A chunk is written where it would start if the numbers before
+	// it took their worst case size, see compress_bound, so that no
+	// chunk overwrites the next one. The chunks are moved next to each
+	// other once they are all done
+	elem_bound = precision_size(precision);
+	if (elem_bound < sizeof(float))
+		elem_bound = sizeof(float);
+	elem_bound += sizeof(uint16_t);
+
+	for (uint64_t c = 0; c < job.queue.chunk_count; c++) {
+		chunk = &job.chunks[c];
+		chunk->start = c * chunk_size;
+		chunk->count = elem_count - chunk->start < chunk_size ? elem_count - chunk->start : chunk_size;
+		chunk->output = output_bucket + HEADER_SIZE + chunk->start * elem_bound + c * BOUND_SLACK;
+		chunk->index = index;
+		if (index != NULL)
+			index += 2 * (chunk->count / INDEX_INTERVAL + 1);
+	}
+
+	job.input = input;
+	job.precision = precision;
+	job.accuracy = accuracy;
+	job.checkpoint_interval = ctx->checkpoint_interval;
+	job.open_end = 0;
+
+	// Batch bounds and unencoded numbers are stored in single
+	// precision, unless a number is beyond its range. Batches are
+	// made of magnitudes, the signs are stored only if there is a
+	// negative number
+	run_workers(&job, &job.queue, thread_count, scan_worker);
+
+	job.value_size = sizeof(float);
+	job.is_signed = 0;
+	for (uint64_t c = 0; c < job.queue.chunk_count; c++) {
+		if (job.chunks[c].wide)
+			job.value_size = sizeof(double);
+		job.is_signed |= job.chunks[c].negative;
+	}
+
+	run_workers(&job, &job.queue, thread_count, compress_worker);
+
+	batch_ptr = output_bucket + HEADER_SIZE;
+	batch_count = 0;
+
+	for (uint64_t c = 0; c < job.queue.chunk_count; c++) {
+		chunk = &job.chunks[c];
+		if (chunk->status != 0)
+			return 0;
+
+		if (chunk->output != batch_ptr)
+			memmove(batch_ptr, chunk->output, chunk->size);
+		chunk->output = batch_ptr;
+
+		batch_ptr += chunk->size;
+		batch_count += chunk->batch_count;
+	}
+
+	// The offsets of the index entries become offsets from the start
+	// of the array
+	if (has_index) {
+		index_count = 0;
+		for (uint64_t c = 0; c < job.queue.chunk_count; c++) {
+			chunk = &job.chunks[c];
+			for (uint64_t i = 0; i < chunk->index_count; i++) {
+				entry[0] = chunk->index[2 * i];
+				entry[1] = chunk->index[2 * i + 1] + (chunk->output - output_bucket);
+				memcpy(batch_ptr, entry, INDEX_ENTRY_SIZE);
+				batch_ptr += INDEX_ENTRY_SIZE;
+			}
+			index_count += chunk->index_count;
+		}
+
+		memcpy(batch_ptr, &index_count, sizeof(uint64_t));
+		batch_ptr += sizeof(uint64_t);
+	}
+
+	output_size = batch_ptr - output_bucket;
+
+	if (VERBOSE)
+		printf("Compressed %llu elements in %llu batches, output size = %llu bytes\n", (unsigned long long) elem_count, 
+				(unsigned long long) batch_count, (unsigned long long) output_size);
+
+	// Finally patch the header of the compressed structure
+	// with the size of the encoded buffer, total number of
+	// floating point elements in the input array and the 
+	// number of batches 
+	
+	metadata = (FORMAT_VERSION << METADATA_VERSION_SHIFT) | (precision << 3) | accuracy;
+	if (job.value_size == sizeof(double))
+		metadata |= METADATA_WIDE_VALUES;
+	if (job.is_signed)
+		metadata |= METADATA_SIGNED;
+	if (has_index)
+		metadata |= METADATA_INDEX;
+	for (uint32_t n = 1; n <= METADATA_CHECKPOINT_MASK; n++) {
+		if (ctx->checkpoint_interval == 1U << n)
+			metadata |= n << METADATA_CHECKPOINT_SHIFT;
+	}
+
+	if (DEBUG)
+		printf("precision = 0x%X, accuracy = 0x%X, metadata = 0x%X\n", precision, accuracy, metadata);
+
+	// The first four bytes hold the size where version 1 arrays have it,
+	// so that the metadata stays at the same offset in both versions.
+	// Version 2 readers take the size from the 64 bit field. The output
+	// need not be aligned, for example an array written after another
+	// in the buffer of ac_compress_float_into
+	val32[0] = output_size < UINT32_MAX ? output_size : UINT32_MAX;
+	val32[1] = metadata;
+
+	val64[0] = output_size;
+	val64[1] = elem_count;
+	val64[2] = batch_count;
+
+	memcpy(output_bucket, val32, sizeof(val32));
+	memcpy(output_bucket + sizeof(val32), val64, sizeof(val64));
+
+	return output_size;
+}
+
+// Reads and validates the header of the compressed array, version 1 or 2.
+// Returns 0 on success, -1 if the header is not valid
+static int
+read_header(compressed_array input, array_header *header)
+{
+uint32_t metadata;
+uint32_t val32[4];
+uint64_t val64[3];
+
+	if (input == NULL)
+		return (-1);
+
+	// Compressed FP array structure, see the top of this file
+	// Size of the compressed array in bytes uint32_t
+	// Meta data, for example size (16/32/64), maximum err (1/0.5/0.25 etc),
+	//   version uint32_t
+	// Version 1: Number of elements N, number of batches n uint32_t
+	// Version 2: Size in bytes, N, n uint64_t
+	//
+	// The array need not be aligned, for example a frame of a stream
+
+	memcpy(val32, input, 2 * sizeof(uint32_t));
+	header->size = val32[0];
+	metadata = val32[1];
+	header->version = (metadata >> METADATA_VERSION_SHIFT) & 0xff;
+
+	if (header->version == 0) {
+		header->version = 1;
+		header->header_size = HEADER_SIZE_V1;
+		memcpy(val32, input, HEADER_SIZE_V1);
+		header->elem_count = val32[2];
+		header->batch_count = val32[3];
+	} else if (header->version == FORMAT_VERSION) {
+		header->header_size = HEADER_SIZE;
+		memcpy(val64, (uint8_t *) input + 2 * sizeof(uint32_t), sizeof(val64));
+		header->size = val64[0];
+		header->elem_count = val64[1];
+		header->batch_count = val64[2];
+	} else {
+		if (DEBUG)
+			printf("Unknown version %d of the compressed array\n", header->version);
+		return (-1);
+	}
+
+	header->accuracy = metadata & 0b111;
+	header->precision = (metadata >> 3) & 0b111;
+	header->is_signed = (metadata & METADATA_SIGNED) != 0;
+	header->has_index = (metadata & METADATA_INDEX) != 0;
+	header->checkpoint_interval = (metadata >> METADATA_CHECKPOINT_SHIFT) & METADATA_CHECKPOINT_MASK;
+	if (header->checkpoint_interval != 0)
+		header->checkpoint_interval = 1U << header->checkpoint_interval;
+
+	if (metadata & METADATA_WIDE_VALUES)
+		header->value_size = sizeof(double);
+	else
+		header->value_size = sizeof(float);
+
+	// Validate accuracy and precision
+	if ((header->precision != PRECISION_SINGLE) && (header->precision != PRECISION_DOUBLE) 
+			&& (header->precision != PRECISION_HALF) && (header->precision != PRECISION_BFLOAT16)) {
+		if (DEBUG)
+			printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
+		return (-1);
+	}
+
+	if ((header->accuracy != ACCURACY_HALF_PERCENT) && (header->accuracy != ACCURACY_QUARTER_PERCENT) 
+			&& (header->accuracy != ACCURACY_ONE_TENTH_PERCENT)) {
+		if (DEBUG)
+			printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
+		return (-1);
+	}
+
+	if (header->size < header->header_size) {
+		if (DEBUG)
+			printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
+		return (-1);
+	}
+
+	if (header->checkpoint_interval != 0 && (header->checkpoint_interval < MIN_CHECKPOINT_INTERVAL 
+			|| header->checkpoint_interval > MAX_CHECKPOINT_INTERVAL)) {
+		if (DEBUG)
+			printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
+		return (-1);
+	}
+
+	if (DEBUG) {
+		printf("Compressed file: version = %d input_size = %llu metadata = %d elem_count = %llu ", header->version, 
+				(unsigned long long) header->size, metadata, (unsigned long long) header->elem_count);
+		printf("batch_count = %llu precision = %d accuracy = %d\n", 
+				(unsigned long long) header->batch_count, header->precision, header->accuracy);
+	}
+
+	return 0;
+}
+
+// Reads the number of elements of a batch and, for batches that are not
+// unencoded numbers, the number of bytes of encoded data, in the format
+// of version 1 or 2. The encoded data of version 1 starts with two bytes
+// of its size, which are skipped. Returns the position after the number,
+// NULL if it goes past end
+static uint8_t *
+read_batch_size(uint8_t *ptr, uint8_t *end, uint8_t version, uint64_t *size)
+{
+uint16_t val16;
+
+	if (version != 1)
+		return get_varint(ptr, end, size);
+
+	if (end - ptr < sizeof(uint16_t))
+		return NULL;
+
+	memcpy(&val16, ptr, sizeof(uint16_t));
+	*size = val16;
+
+	return ptr + sizeof(uint16_t);
+}
+
+// Reads the bounds and the bucket numbers of a batch of batch_size numbers,
+// at least 3, whose number of elements has already been read. The batch
+// must end before input_end. The bucket numbers are written to buckets,
+// which has space for batch_size numbers. Returns the position after the
+// bucket numbers, where the signs start, NULL in case of error
+static uint8_t *
+read_buckets(array_header *header, uint8_t *input_ptr, uint8_t *input_end, uint32_t batch_size, double *max, 
+		double *min, uint8_t *buckets)
+{
+uint64_t encoded_buffer_size;
+uint8_t encode_key;
+int status;
+
+	if (input_end - input_ptr < 2 * header->value_size + 1)
+		return NULL;
+
+	input_ptr = read_value(input_ptr, max, header->value_size);
+	input_ptr = read_value(input_ptr, min, header->value_size);
+
+	encode_key = *input_ptr++;
+
+	if (VERBOSE)
+		printf("Batch has %d elements, max = %.9f, min = %.9f\n", batch_size, *max, *min);
+	if (DEBUG)
+		printf("Batch encoded using encode key = %d\n", encode_key);
+
+	if (encode_key == 0) {
+		if (input_end - input_ptr < batch_size)
+			return NULL;
+
+		memcpy(buckets, input_ptr, batch_size);
+
+		return input_ptr + batch_size;
+	}
+
+	// The encoded data starts with its size
+	input_ptr = read_batch_size(input_ptr, input_end, header->version, &encoded_buffer_size);
+	if (header->version == 1 && input_ptr != NULL) {
+		if (encoded_buffer_size < sizeof(uint16_t))
+			return NULL;
+		encoded_buffer_size -= sizeof(uint16_t);
+	}
+
+	if (input_ptr == NULL || input_end - input_ptr < encoded_buffer_size)
+		return NULL;
+
+	if (DEBUG)
+		printf("encoded size in bytes = %llu\n", (unsigned long long) encoded_buffer_size);
+
+	status = uint8_decode(encode_key, batch_size, input_ptr, encoded_buffer_size, header->checkpoint_interval, 
+			buckets);
+	if (status == (-1))
+		return NULL;
+
+	return input_ptr + encoded_buffer_size;
+}
+
+// Decodes one batch of batch_size numbers, whose number of elements has
+// already been read, and writes the numbers to output_ptr in the precision
+// output_precision. The batch must end before input_end. The bucket numbers
+// of the batch are staged in the arena staging. Returns the position after
+// the batch, NULL in case of error
+static uint8_t *
+decode_batch(ac_arena *staging, array_header *header, uint8_t *input_ptr, uint8_t *input_end, uint32_t batch_size, 
+		uint8_t output_precision, uint8_t *output_ptr)
+{
+uint8_t *decoded_buffer;
+double min;
+double max;
+double value;
+int status;
+
+	// Take care of the special case when the batch has
+	// Just one or two elements. Nothing to be decoded
+	if (batch_size == 1 || batch_size == 2) {
+		if (input_end - input_ptr < batch_size * header->value_size)
+			return NULL;
+
+		// Write in the output precision
+		for (int j = 0; j < batch_size; j++) {
+			input_ptr = read_value(input_ptr, &value, header->value_size);
+			set_value(output_ptr, output_precision, j, value);
+		}
+
+		return input_ptr;
+	}
+
+	decoded_buffer = arena_reserve(staging, batch_size);
+	if (decoded_buffer == NULL)
+		return NULL;
+
+	input_ptr = read_buckets(header, input_ptr, input_end, batch_size, &max, &min, decoded_buffer);
+	if (input_ptr == NULL)
+		return NULL;
+
+	// Batches with a single precision minimum are reconstructed in
+	// single precision, so older arrays decompress as they used to
+	if (header->value_size == sizeof(float))
+		unbucketize(batch_size, decoded_buffer, output_ptr, min, output_precision, header->accuracy);
+	else
+		unbucketize_wide(batch_size, decoded_buffer, output_ptr, min, output_precision, header->accuracy);
+
+	// The signs follow the batch
+	if (header->is_signed) {
+		status = sign_decode(batch_size, input_ptr, input_end, output_ptr, output_precision);
+		if (status == (-1))
+			return NULL;
+
+		input_ptr += status;
+	}
+
+	return input_ptr;
+}
+
+// Returns the position after the batch of batch_size numbers at input_ptr,
+// whose number of elements has already been read, without decoding it.
+// Returns NULL if the batch goes past input_end
+static uint8_t *
+skip_batch(array_header *header, uint8_t *input_ptr, uint8_t *input_end, uint32_t batch_size)
+{
+uint64_t encoded_buffer_size;
+uint8_t encode_key;
+int status;
+
+	if (batch_size == 1 || batch_size == 2) {
+		if (input_end - input_ptr < batch_size * header->value_size)
+			return NULL;
+
+		return input_ptr + batch_size * header->value_size;
+	}
+
+	if (input_end - input_ptr < 2 * header->value_size + 1)
+		return NULL;
+
+	input_ptr += 2 * header->value_size;
+	encode_key = *input_ptr++;
+
+	encoded_buffer_size = batch_size;
+	if (encode_key != 0) {
+		input_ptr = read_batch_size(input_ptr, input_end, header->version, &encoded_buffer_size);
+		if (header->version == 1 && input_ptr != NULL) {
+			if (encoded_buffer_size < sizeof(uint16_t))
+				return NULL;
+			encoded_buffer_size -= sizeof(uint16_t);
+		}
+	}
+
+	if (input_ptr == NULL || input_end - input_ptr < encoded_buffer_size)
+		return NULL;
+
+	input_ptr += encoded_buffer_size;
+
+	if (header->is_signed) {
+		status = sign_size(batch_size, input_ptr, input_end);
+		if (status == (-1))
+			return NULL;
+
+		input_ptr += status;
+	}
+
+	return input_ptr;
+}
+
+// A chunk of the compressed array, a run of whole batches decoded by one
+// thread of the parallel decompressor
+typedef struct {
+	uint64_t start;		// First element of the chunk
+	uint64_t count;		// Number of elements of the chunk
+	uint8_t *input;		// First batch of the chunk
+	uint64_t batch_count;	// Number of batches, found as they are decoded
+	int status;		// 0 on success, -1 in case of error
+} decompress_chunk;
+
+// The array being decompressed, shared by the threads of the decompressor
+typedef struct {
+	work_queue queue;
+	array_header *header;
+	uint8_t *input_end;
+	uint8_t output_precision;
+	uint8_t *output;
+	decompress_chunk *chunks;
+	ac_arena *staging;	// One arena per thread
+} decompress_job;
+
+// Splits the compressed array into chunks of at least CHUNK_SIZE elements
+// that start with a batch. The batches are found through the index of the
+// array, if it has a valid one, otherwise by skipping the batches one
+// after the other, which reads only their sizes. Returns the number of
+// chunks, 0 in case of error
+static uint64_t
+find_chunks(compressed_array input, array_header *header, decompress_chunk *chunks)
+{
+uint8_t *index;
+uint8_t *input_ptr;
+uint8_t *input_end;
+uint64_t entry_count;
+uint64_t entry[2];
+uint64_t prev[2];
+uint64_t chunk_count;
+uint64_t batch_size;
+uint64_t elem;
+
+	chunk_count = 0;
+	input_end = (uint8_t *) input + header->size;
+
+	entry_count = 0;
+	if (header->has_index && header->size >= header->header_size + sizeof(uint64_t)) {
+		memcpy(&entry_count, input_end - sizeof(uint64_t), sizeof(uint64_t));
+		if (entry_count > (header->size - header->header_size - sizeof(uint64_t)) / INDEX_ENTRY_SIZE)
+			entry_count = 0;
+	}
+
+	// The entries must start with the first batch and increase, the
+	// chunks are checked again as they are decoded
+	index = input_end - sizeof(uint64_t) - entry_count * INDEX_ENTRY_SIZE;
+	for (uint64_t i = 0; i < entry_count; i++) {
+		memcpy(entry, index + i * INDEX_ENTRY_SIZE, INDEX_ENTRY_SIZE);
+		if (i == 0 ? entry[0] != 0 || entry[1] != header->header_size 
+				: entry[0] <= prev[0] || entry[1] <= prev[1] || entry[1] >= index - (uint8_t *) input 
+				|| entry[0] >= header->elem_count) {
+			if (DEBUG)
+				printf("Index entry %llu is not valid\n", (unsigned long long) i);
+			chunk_count = 0;
+			break;
+		}
+
+		if (chunk_count == 0 || entry[0] >= chunks[chunk_count - 1].start + CHUNK_SIZE) {
+			chunks[chunk_count].start = entry[0];
+			chunks[chunk_count].input = (uint8_t *) input + entry[1];
+			chunk_count++;
+		}
+
+		prev[0] = entry[0];
+		prev[1] = entry[1];
+	}
+
+	if (chunk_count == 0) {
+		input_ptr = (uint8_t *) input + header->header_size;
+		for (elem = 0; elem < header->elem_count; elem += batch_size) {
+			if (chunk_count == 0 || elem >= chunks[chunk_count - 1].start + CHUNK_SIZE) {
+				chunks[chunk_count].start = elem;
+				chunks[chunk_count].input = input_ptr;
+				chunk_count++;
+			}
+
+			input_ptr = read_batch_size(input_ptr, input_end, header->version, &batch_size);
+			if (input_ptr == NULL || batch_size == 0 || batch_size > header->elem_count - elem 
+					|| batch_size > MAX_BATCH_SIZE)
+				return 0;
+
+			input_ptr = skip_batch(header, input_ptr, input_end, batch_size);
+			if (input_ptr == NULL)
+				return 0;
+		}
+	}
+
+	for (uint64_t c = 0; c < chunk_count; c++) {
+		elem = (c + 1 < chunk_count) ? chunks[c + 1].start : header->elem_count;
+		chunks[c].count = elem - chunks[c].start;
+	}
+
+	return chunk_count;
+}
+
+// Decodes the chunks taken from the job straight to their place in the
+// output. A chunk must end exactly where the next one starts
+static void *
+decompress_worker(void *arg)
+{
+decompress_job *job;
+decompress_chunk *chunk;
+ac_arena *staging;
+uint8_t *input_ptr;
+uint64_t batch_size;
+uint64_t elem;
+uint64_t c;
+
+	job = arg;
+	staging = &job->staging[start_thread(&job->queue)];
+
+	while (take_chunk(&job->queue, &c)) {
+		chunk = &job->chunks[c];
+		chunk->batch_count = 0;
+		chunk->status = 0;
+
+		input_ptr = chunk->input;
+		for (elem = chunk->start; elem < chunk->start + chunk->count; elem += batch_size) {
+			input_ptr = read_batch_size(input_ptr, job->input_end, job->header->version, &batch_size);
+			if (input_ptr == NULL || batch_size == 0 || batch_size > chunk->start + chunk->count - elem 
+					|| batch_size > MAX_BATCH_SIZE) {
+				if (DEBUG)
+					printf("Batch at element %llu has a bad number of elements\n", (unsigned long long) elem);
+				chunk->status = (-1);
+				break;
+			}
+
+			input_ptr = decode_batch(staging, job->header, input_ptr, job->input_end, batch_size, 
+					job->output_precision, job->output + elem * precision_size(job->output_precision));
+			if (input_ptr == NULL) {
+				chunk->status = (-1);
+				break;
+			}
+
+			chunk->batch_count++;
+		}
+	}
+
+	return NULL;
+}
+
+// Same as approximate_decompress, the chunks of the array are decoded by
+// up to thread_count threads. Returns 0 on success, -1 in case of error
+static int
+parallel_decompress(ac_context *ctx, compressed_array input, array_header *header, uint8_t output_precision, 
+		uint8_t *output, int thread_count)
+{
+decompress_job job;
+uint64_t batch_count;
+
+	job.chunks = arena_reserve(&ctx->chunks, (header->elem_count / CHUNK_SIZE + 1) * sizeof(decompress_chunk));
+	if (job.chunks == NULL)
+		return (-1);
+
+	job.queue.chunk_count = find_chunks(input, header, job.chunks);
+	if (job.queue.chunk_count == 0)
+		return (-1);
+
+	if (thread_count > job.queue.chunk_count)
+		thread_count = job.queue.chunk_count;
+
+	job.header = header;
+	job.input_end = (uint8_t *) input + header->size;
+	job.output_precision = output_precision;
+	job.output = output;
+	job.staging = ctx->thread_staging;
+
+	run_workers(&job, &job.queue, thread_count, decompress_worker);
+
+	batch_count = 0;
+	for (uint64_t c = 0; c < job.queue.chunk_count; c++) {
+		if (job.chunks[c].status != 0)
+			return (-1);
+		batch_count += job.chunks[c].batch_count;
+	}
+
+	// The number of batches specified in the encoded buffer should
+	// match the number of batches found during decoding
+	if (batch_count != header->batch_count) {
+		if (DEBUG)
+			printf("mismatch in batch_count (%llu) and number of batches (%llu)\n", 
+					(unsigned long long) batch_count, (unsigned long long) header->batch_count);
+		return (-1);
+	}
+
+	return 0;
+}
+
+/*
+** This function accepts as input an opaque structure 
+** (array of bytes) containing a compressed array, previously
+** generated using compress_float or compress_double. It writes
+** the uncompressed numbers to the array output, which has space
+** for output_count numbers. The numbers are written in the precision
+** output_precision (float, double, half precision or bfloat16),
+** independent of the precision of the original array.
+**
+** The bucket numbers of a batch are staged in the arena of the
+** context ctx. Returns 0 on success, in case of any error -1 is
+** returned
+**
+** High level algorithm:
+**  - From the header of the compressed structure, retrieve
+**    the total number of floating point numbers present
+**	  and the number of batches
+**	- For each batch perform following steps:
+**		- Decode the encoded bits to get the bucket numbers
+**		- Convert the bucket numbers to floating point numbers
+**		- Append the numbers to the uncompressed array
+**
+** If the context has more than one thread, large arrays are split in
+** chunks of whole batches which are decoded in parallel, see
+** parallel_decompress
+*/
+
+static int
+approximate_decompress(ac_context *ctx, compressed_array input, uint8_t output_precision, uint8_t *output, uint64_t output_count)
+{
+uint64_t batch_size;
+uint64_t total_size;
+array_header header;
+uint8_t *input_ptr;
+uint8_t *input_end;
+
+	if (read_header(input, &header) != 0)
+		return (-1);
+
+	if (header.elem_count > output_count) {
+		if (DEBUG)
+			printf("Output has space for %llu numbers, %llu needed\n", (unsigned long long) output_count, 
+					(unsigned long long) header.elem_count);
+		return (-1);
+	}
+
+	if (ctx->thread_count > 1 && header.elem_count > CHUNK_SIZE)
+		return parallel_decompress(ctx, input, &header, output_precision, output, ctx->thread_count);
+
+	input_ptr = (uint8_t *) input + header.header_size;
+	input_end = (uint8_t *) input + header.size;
+
+	total_size = 0;
+
+	// Loop through all batches. A batch is a sequence such that
+	// all numbers are within a range of min .. 2 * min
+
+	for (uint64_t i = 0; i < header.batch_count; i++) {
+		// Started processing a new batch
+		input_ptr = read_batch_size(input_ptr, input_end, header.version, &batch_size);
+
+		// A batch must not go beyond the end of the output
+		if (input_ptr == NULL || batch_size == 0 || batch_size > header.elem_count - total_size 
+				|| batch_size > MAX_BATCH_SIZE) {
+			if (DEBUG)
+				printf("Batch #%llu has a bad number of elements\n", (unsigned long long) i);
+			return (-1);
+		}
+
+		if (VERBOSE)
+			printf("Batch #%llu has %d elements\n", (unsigned long long) i, (int) batch_size);
+
+		input_ptr = decode_batch(&ctx->staging, &header, input_ptr, input_end, batch_size, output_precision, 
+				output + total_size * precision_size(output_precision));
+		if (input_ptr == NULL)
+			return (-1);
+
+		// Update the number of elements processed so far
+		total_size += batch_size;
+	}
+
+	// The size specified in the encoded buffer should match
+	// the number of elements found during decoding
+	if (total_size != header.elem_count) {
+		// Some thing went wrong
+		if (DEBUG)
+			printf("mismatch in total_size (%llu) and elem_count (%llu)\n", (unsigned long long) total_size, 
+					(unsigned long long) header.elem_count);
+		return (-1);
+	}
+
+	return 0;
+}
+
+// Finds in the index of the compressed array the last batch that starts
+// at or before element start. On return elem holds the first element of
+// the batch and the batch starts at the returned position. Decoding starts
+// with the first batch if the array has no index or the index is not valid
+static uint8_t *
+index_lookup(compressed_array input, array_header *header, uint64_t start, uint64_t *elem)
+{
+uint8_t *index;
+uint64_t entry_count;
+uint64_t entry[2];
+uint64_t low;
+uint64_t high;
+uint64_t mid;
+
+	*elem = 0;
+	if (!header->has_index || header->size < header->header_size + sizeof(uint64_t))
+		return (uint8_t *) input + header->header_size;
+
+	memcpy(&entry_count, (uint8_t *) input + header->size - sizeof(uint64_t), sizeof(uint64_t));
+	if (entry_count == 0 || entry_count > (header->size - header->header_size - sizeof(uint64_t)) / INDEX_ENTRY_SIZE)
+		return (uint8_t *) input + header->header_size;
+
+	index = (uint8_t *) input + header->size - sizeof(uint64_t) - entry_count * INDEX_ENTRY_SIZE;
+
+	// The first elements of the entries are increasing, the first
+	// entry is the first batch
+	low = 0;
+	high = entry_count;
+	while (high - low > 1) {
+		mid = low + (high - low) / 2;
+		memcpy(entry, index + mid * INDEX_ENTRY_SIZE, INDEX_ENTRY_SIZE);
+		if (entry[0] <= start)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	memcpy(entry, index + low * INDEX_ENTRY_SIZE, INDEX_ENTRY_SIZE);
+	if (entry[0] > start || entry[1] < header->header_size || entry[1] >= index - (uint8_t *) input) {
+		if (DEBUG)
+			printf("Index entry %llu is not valid\n", (unsigned long long) low);
+		return (uint8_t *) input + header->header_size;
+	}
+
+	*elem = entry[0];
+
+	return (uint8_t *) input + entry[1];
+}
+
+/*
+** Same as approximate_decompress for the count numbers starting with
+** element start. Only the batches that hold these numbers are decoded,
+** the index of the compressed array tells where the batch of element
+** start begins, the batches between it and that element are skipped.
+** The numbers of the batches that are decoded in part are
+** staged in the arena of the context ctx
+*/
+
+static int
+approximate_decompress_range(ac_context *ctx, compressed_array input, uint64_t start, uint64_t count, 
+		uint8_t output_precision, uint8_t *output)
+{
+uint64_t batch_size;
+uint64_t elem;
+uint64_t first;
+uint64_t last;
+array_header header;
+size_t value_size;
+uint8_t *input_ptr;
+uint8_t *input_end;
+uint8_t *batch_output;
+
+	if (read_header(input, &header) != 0)
+		return (-1);
+
+	if (start > header.elem_count || count > header.elem_count - start) {
+		if (DEBUG)
+			printf("Range %llu + %llu is beyond %llu numbers\n", (unsigned long long) start, (unsigned long long) count, 
+					(unsigned long long) header.elem_count);
+		return (-1);
+	}
+
+	value_size = precision_size(output_precision);
+	input_end = (uint8_t *) input + header.size;
+	input_ptr = index_lookup(input, &header, start, &elem);
+
+	while (elem < start + count) {
+		input_ptr = read_batch_size(input_ptr, input_end, header.version, &batch_size);
+		if (input_ptr == NULL || batch_size == 0 || batch_size > header.elem_count - elem 
+				|| batch_size > MAX_BATCH_SIZE) {
+			if (DEBUG)
+				printf("Batch at element %llu has a bad number of elements\n", (unsigned long long) elem);
+			return (-1);
+		}
+
+		// A batch that lies before the range is skipped, which
+		// takes reading its sizes only
+		if (elem + batch_size <= start) {
+			input_ptr = skip_batch(&header, input_ptr, input_end, batch_size);
+			if (input_ptr == NULL)
+				return (-1);
+
+			elem += batch_size;
+			continue;
+		}
+
+		// A batch that lies within the range is decoded in place
+		if (elem >= start && elem + batch_size <= start + count) {
+			input_ptr = decode_batch(&ctx->staging, &header, input_ptr, input_end, batch_size, output_precision, 
+					output + (elem - start) * value_size);
+			if (input_ptr == NULL)
+				return (-1);
+
+			elem += batch_size;
+			continue;
+		}
+
+		batch_output = arena_reserve(&ctx->batch, batch_size * value_size);
+		if (batch_output == NULL)
+			return (-1);
+
+		input_ptr = decode_batch(&ctx->staging, &header, input_ptr, input_end, batch_size, output_precision, batch_output);
+		if (input_ptr == NULL)
+			return (-1);
+
+		first = elem > start ? elem : start;
+		last = elem + batch_size < start + count ? elem + batch_size : start + count;
+		memcpy(output + (first - start) * value_size, batch_output + (first - elem) * value_size, 
+				(last - first) * value_size);
+
+		elem += batch_size;
+	}
+
+	return 0;
+}
+
+// Decodes element index of the batch of batch_size numbers at input_ptr,
+// whose number of elements has already been read. The number is returned
+// in value as decompress_double returns it. Returns 0 on success, -1 in
+// case of error
+static int
+decode_element(array_header *header, uint8_t *input_ptr, uint8_t *input_end, uint32_t batch_size, uint32_t index, 
+		double *value)
+{
+double min;
+uint64_t encoded_buffer_size;
+uint8_t encode_key;
+uint8_t bucket;
+int status;
+
+	if (batch_size == 1 || batch_size == 2) {
+		if (input_end - input_ptr < batch_size * header->value_size)
+			return (-1);
+
+		read_value(input_ptr + index * header->value_size, value, header->value_size);
+
+		return 0;
+	}
+
+	if (input_end - input_ptr < 2 * header->value_size + 1)
+		return (-1);
+
+	input_ptr = read_value(input_ptr + header->value_size, &min, header->value_size);
+	encode_key = *input_ptr++;
+
+	if (encode_key == 0) {
+		if (input_end - input_ptr < batch_size)
+			return (-1);
+
+		bucket = input_ptr[index];
+		input_ptr += batch_size;
+	} else {
+		input_ptr = read_batch_size(input_ptr, input_end, header->version, &encoded_buffer_size);
+		if (header->version == 1 && input_ptr != NULL) {
+			if (encoded_buffer_size < sizeof(uint16_t))
+				return (-1);
+			encoded_buffer_size -= sizeof(uint16_t);
+		}
+
+		if (input_ptr == NULL || input_end - input_ptr < encoded_buffer_size)
+			return (-1);
+
+		status = uint8_decode_element(encode_key, batch_size, input_ptr, encoded_buffer_size, 
+				header->checkpoint_interval, index, &bucket);
+		if (status == (-1))
+			return (-1);
+
+		input_ptr += encoded_buffer_size;
+	}
+
+	// The number is reconstructed as the batch would be
+	if (header->value_size == sizeof(float))
+		unbucketize(1, &bucket, (uint8_t *) value, min, PRECISION_DOUBLE, header->accuracy);
+	else
+		unbucketize_wide(1, &bucket, (uint8_t *) value, min, PRECISION_DOUBLE, header->accuracy);
+
+	if (header->is_signed) {
+		status = sign_get(batch_size, input_ptr, input_end, index);
+		if (status == (-1))
+			return (-1);
+
+		if (status)
+			*value = -*value;
+	}
+
+	return 0;
+}
+
+// Sets value to element i of the compressed array, as decompress_double
+// returns it. The batch of the element is found using the index of the
+// array, the batches that follow the index entry are skipped without being
+// decoded. Within the batch, decoding starts with the checkpoint before the
+// element. Returns 0 on success, -1 in case of error
+int
+get_element(compressed_array c, uint64_t i, double *value)
+{
+uint64_t batch_size;
+uint64_t elem;
+array_header header;
+uint8_t *input_ptr;
+uint8_t *input_end;
+
+	if (read_header(c, &header) != 0 || i >= header.elem_count)
+		return (-1);
+
+	input_end = (uint8_t *) c + header.size;
+	input_ptr = index_lookup(c, &header, i, &elem);
+
+	for (;;) {
+		input_ptr = read_batch_size(input_ptr, input_end, header.version, &batch_size);
+		if (input_ptr == NULL || batch_size == 0 || batch_size > header.elem_count - elem 
+				|| batch_size > MAX_BATCH_SIZE) {
+			if (DEBUG)
+				printf("Batch at element %llu has a bad number of elements\n", (unsigned long long) elem);
+			return (-1);
+		}
+
+		if (i < elem + batch_size)
+			return decode_element(&header, input_ptr, input_end, batch_size, i - elem, value);
+
+		input_ptr = skip_batch(&header, input_ptr, input_end, batch_size);
+		if (input_ptr == NULL)
+			return (-1);
+
+		elem += batch_size;
+	}
+}
+
+// The end of a compressed array being appended to. The tail is the part
+// of the array from its last index entry, or from the header if it has no
+// index, to its end. It is read from the array or from its file, and the
+// appended batches and the index are written over it
+typedef struct {
+	array_header header;
+	uint8_t *tail;
+	uint64_t tail_offset;	// Offset of the tail in the array
+	uint64_t tail_elem;	// First element of the tail
+	uint64_t data_end;	// Offset of the end of the batches
+	uint64_t *index;	// Index entries, in the index staging arena
+	uint64_t index_count;
+	uint64_t last_offset;	// Offset of the last batch
+	uint64_t last_elem;	// First element of the last batch
+	uint64_t last_size;	// Number of elements of the last batch, 0 if none
+	uint64_t write_offset;	// Offset of the first byte written by the append
+} append_job;
+
+// Checks that count numbers of input, whose precision is precision, can be
+// appended to the array of the header. The bounds and unencoded numbers of
+// the array keep their size, and the batches of an array without negative
+// numbers have no signs, unless the array is empty. Returns 0 if they can,
+// -1 otherwise
+static int
+append_check(array_header *header, uint8_t precision, uint64_t count, void *input)
+{
+int wide;
+int negative;
+
+	if (header->version != FORMAT_VERSION || header->precision != precision) {
+		if (DEBUG)
+			printf("Can not append to version %d array of precision %d\n", header->version, header->precision);
+		return (-1);
+	}
+
+	wide = (precision == PRECISION_DOUBLE && needs_wide_values(input, count));
+	negative = sign_any_negative(count, input, precision);
+
+	if (header->elem_count == 0) {
+		if (wide)
+			header->value_size = sizeof(double);
+		header->is_signed |= negative;
+		return 0;
+	}
+
+	if ((wide && header->value_size == sizeof(float)) || (negative && !header->is_signed))
+		return (-1);
+
+	return 0;
+}
+
+// Checks the number of index entries of the array and finds the size of
+// its index. Returns 0 on success, -1 if the index is not valid
+static int
+append_index_size(array_header *header, uint64_t entry_count, uint64_t *index_size)
+{
+	*index_size = 0;
+	if (!header->has_index)
+		return 0;
+
+	if (entry_count > (header->size - header->header_size - sizeof(uint64_t)) / INDEX_ENTRY_SIZE)
+		return (-1);
+
+	*index_size = entry_count * INDEX_ENTRY_SIZE + sizeof(uint64_t);
+
+	return 0;
+}
+
+// Chooses the tail of the array, which starts with its last index entry.
+// The index entries, index_size bytes, are in the index of the job. An
+// array without an index gains one that starts with its first batch
+static int
+append_find_tail(append_job *job, uint64_t index_size)
+{
+array_header *header;
+uint64_t *entry;
+
+	header = &job->header;
+	job->data_end = header->size - index_size;
+
+	if (job->index_count == 0 && header->elem_count > 0) {
+		job->index[0] = 0;
+		job->index[1] = header->header_size;
+		job->index_count = 1;
+	}
+
+	job->tail_offset = header->header_size;
+	job->tail_elem = 0;
+
+	if (job->index_count > 0) {
+		entry = job->index + 2 * (job->index_count - 1);
+		if (entry[0] > header->elem_count || entry[1] < header->header_size || entry[1] > job->data_end) {
+			if (DEBUG)
+				printf("Index entry %llu is not valid\n", (unsigned long long) (job->index_count - 1));
+			return (-1);
+		}
+
+		job->tail_offset = entry[1];
+		job->tail_elem = entry[0];
+	}
+
+	return 0;
+}
+
+// Finds the last batch of the array, skipping the batches of the tail
+static int
+append_find_last(append_job *job)
+{
+array_header *header;
+uint64_t batch_size;
+uint64_t elem;
+uint8_t *batch_ptr;
+uint8_t *input_ptr;
+uint8_t *input_end;
+
+	header = &job->header;
+	input_ptr = job->tail;
+	input_end = job->tail + (job->data_end - job->tail_offset);
+	elem = job->tail_elem;
+	job->last_size = 0;
+
+	while (input_ptr < input_end) {
+		batch_ptr = input_ptr;
+		input_ptr = read_batch_size(input_ptr, input_end, header->version, &batch_size);
+		if (input_ptr == NULL || batch_size == 0 || batch_size > header->elem_count - elem 
+				|| batch_size > MAX_BATCH_SIZE) {
+			if (DEBUG)
+				printf("Batch at element %llu has a bad number of elements\n", (unsigned long long) elem);
+			return (-1);
+		}
+
+		input_ptr = skip_batch(header, input_ptr, input_end, batch_size);
+		if (input_ptr == NULL)
+			return (-1);
+
+		job->last_offset = job->tail_offset + (batch_ptr - job->tail);
+		job->last_elem = elem;
+		job->last_size = batch_size;
+		elem += batch_size;
+	}
+
+	if (elem != header->elem_count)
+		return (-1);
+
+	return 0;
+}
+
+// Returns the number of bytes from the start of the tail needed to append
+// count numbers, which is never more than compress_bound of the numbers of
+// the array after the append. Every batch takes at most the bound of its
+// numbers, so the batches before the last one fit in the bound of their
+// numbers, and the last batch, if it is written again, and the new batches
+// fit in the bound of theirs. The new index entries are at least
+// INDEX_INTERVAL elements after the last entry, an empty array gains an
+// entry for its first batch
+static uint64_t
+append_bound(append_job *job, uint64_t count)
+{
+uint64_t elem_bound;
+uint64_t last_entry;
+uint64_t entry_count;
+uint64_t end;
+
+	elem_bound = precision_size(job->header.precision);
+	if (elem_bound < sizeof(float))
+		elem_bound = sizeof(float);
+	elem_bound += sizeof(uint16_t);
+
+	if (job->last_size > 0 && job->last_size < REOPEN_SIZE)
+		end = job->last_offset + (job->last_size + count) * elem_bound;
+	else
+		end = job->data_end + count * elem_bound;
+
+	last_entry = 0;
+	if (job->index_count > 0)
+		last_entry = job->index[2 * (job->index_count - 1)];
+	entry_count = job->index_count + (job->header.elem_count + count - last_entry) / INDEX_INTERVAL 
+		+ (job->index_count == 0);
+
+	return end - job->tail_offset + BOUND_SLACK + entry_count * INDEX_ENTRY_SIZE + sizeof(uint64_t);
+}
+
+// Compresses count numbers of input, which follow element elem of the
+// array, into batches written at output. The index entries of the batches
+// are added to the index of the job, at least INDEX_INTERVAL elements after
+// the previous entry. Returns the position after the batches, NULL in case
+// of error
+static uint8_t *
+append_chunk(append_job *job, compress_job *cjob, uint8_t *bucketized_array, void *input, uint64_t count, 
+		uint64_t elem, uint8_t *output)
+{
+compress_chunk chunk;
+uint64_t entry[2];
+
+	if (count == 0)
+		return output;
+
+	cjob->input = input;
+	chunk.start = 0;
+	chunk.count = count;
+	chunk.output = output;
+	chunk.index = job->index + 2 * job->index_count;
+
+	if (compress_chunk_batches(cjob, &chunk, bucketized_array) != 0)
+		return NULL;
+
+	// The entries of the chunk are moved down over the ones dropped
+	for (uint64_t i = 0; i < chunk.index_count; i++) {
+		entry[0] = elem + chunk.index[2 * i];
+		entry[1] = job->tail_offset + (output - job->tail) + chunk.index[2 * i + 1];
+		if (job->index_count > 0 && entry[0] < job->index[2 * (job->index_count - 1)] + INDEX_INTERVAL)
+			continue;
+
+		job->index[2 * job->index_count] = entry[0];
+		job->index[2 * job->index_count + 1] = entry[1];
+		job->index_count++;
+	}
+
+	job->header.batch_count += chunk.batch_count;
+
+	return output + chunk.size;
+}
+
+/*
+** Appends count numbers of input, whose precision is precision, to the
+** array whose tail is in the job. The tail must have space for
+** append_bound bytes. The batches of the tail are written over from the
+** last batch on, followed by the index, and the counts of the header of
+** the job are updated. Returns the new size of the tail, -1 in case of
+** error
+**
+** The last batch is handled in one of three ways
+**	- An encoded batch of less than REOPEN_SIZE numbers is reopened.
+**	  Its bucket numbers are relative to its minimum, so the new numbers
+**	  from the minimum to twice the minimum, and 0.0, are bucketized
+**	  with the same minimum and join the batch, which is encoded again.
+**	  The numbers of the batch are not decoded and bucketized again,
+**	  which would add to their error
+**	- A batch of one or two unencoded numbers is compressed again
+**	  together with the new numbers, the numbers are exact
+**	- Otherwise the batch is left as it is
+** The remaining numbers are compressed into new batches
+*/
+static int64_t
+append_batches(ac_context *ctx, append_job *job, uint8_t precision, uint64_t count, void *input)
+{
+array_header *header;
+compress_job cjob;
+delta_stats stats;
+uint8_t *bucketized_array;
+uint8_t *batch_ptr;
+uint8_t *input_ptr;
+uint8_t *input_end;
+uint8_t *head;
+float *signs;
+uint64_t staging_size;
+uint64_t batch_size;
+uint64_t joined;
+uint64_t head_count;
+uint64_t elem;
+uint32_t byte_count;
+double max;
+double min;
+double value;
+
+	header = &job->header;
+	signs = NULL;
+	input_end = job->tail + (job->data_end - job->tail_offset);
+	batch_ptr = input_end;
+	elem = header->elem_count;
+	job->write_offset = job->data_end;
+
+	staging_size = job->last_size + count < MAX_BATCH_SIZE ? job->last_size + count : MAX_BATCH_SIZE;
+	bucketized_array = arena_reserve(&ctx->staging, staging_size);
+	if (bucketized_array == NULL && staging_size > 0)
+		return (-1);
+
+	job->index = arena_grow(&ctx->index_staging, 
+			(job->index_count + (job->last_size + count) / INDEX_INTERVAL + 2) * INDEX_ENTRY_SIZE);
+	if (job->index == NULL)
+		return (-1);
+
+	cjob.precision = precision;
+	cjob.accuracy = header->accuracy;
+	cjob.value_size = header->value_size;
+	cjob.is_signed = header->is_signed;
+	cjob.checkpoint_interval = header->checkpoint_interval;
+	cjob.open_end = 1;
+
+	input_ptr = job->tail + (job->last_offset - job->tail_offset);
+	if (job->last_size > 0)
+		input_ptr = read_batch_size(input_ptr, input_end, header->version, &batch_size);
+
+	if (job->last_size >= 3 && job->last_size < REOPEN_SIZE) {
+		input_ptr = read_buckets(header, input_ptr, input_end, batch_size, &max, &min, bucketized_array);
+		if (input_ptr == NULL)
+			return (-1);
+
+		joined = 0;
+		while (joined < count && batch_size + joined < MAX_BATCH_SIZE) {
+			value = fabs(get_value(input, precision, joined));
+			if (value != 0.0 && !(value >= min && value < 2.0 * min))
+				break;
+			if (value > max)
+				max = value;
+			joined++;
+		}
+
+		if (joined > 0) {
+			if (header->value_size == sizeof(float))
+				max = narrow_bound(max);
+
+			if (bucketize_values(joined, input, precision, max, min, header->accuracy, 
+					bucketized_array + batch_size) != 0)
+				return (-1);
+
+			// The signs of the batch are staged as 1.0 or -1.0
+			if (header->is_signed) {
+				signs = arena_reserve(&ctx->batch, (batch_size + joined) * sizeof(float));
+				if (signs == NULL)
+					return (-1);
+
+				for (uint64_t i = 0; i < batch_size; i++)
+					signs[i] = 1.0;
+				if (sign_decode(batch_size, input_ptr, input_end, (uint8_t *) signs, PRECISION_SINGLE) == (-1))
+					return (-1);
+				for (uint64_t i = 0; i < joined; i++)
+					signs[batch_size + i] = signbit(get_value(input, precision, i)) ? -1.0 : 1.0;
+			}
+
+			bucket_stats_init(&stats);
+			bucket_stats_collect(&stats, batch_size + joined, bucketized_array);
+
+			job->write_offset = job->last_offset;
+			batch_ptr = job->tail + (job->last_offset - job->tail_offset);
+			batch_ptr = put_varint(batch_ptr, batch_size + joined);
+			batch_ptr = put_value(batch_ptr, max, header->value_size);
+			batch_ptr = put_value(batch_ptr, min, header->value_size);
+
+			byte_count = encode_buckets(&stats, batch_size + joined, header->checkpoint_interval, 
+					bucketized_array, batch_ptr);
+			if (byte_count == 0)
+				return (-1);
+			batch_ptr += byte_count;
+
+			if (header->is_signed)
+				batch_ptr += sign_encode(batch_size + joined, signs, PRECISION_SINGLE, batch_ptr);
+
+			if (VERBOSE)
+				printf("Reopened batch of %llu elements, %llu elements joined\n", 
+						(unsigned long long) batch_size, (unsigned long long) joined);
+
+			input = (uint8_t *) input + joined * precision_size(precision);
+			count -= joined;
+			elem += joined;
+		}
+	} else if (job->last_size == 1 || job->last_size == 2) {
+		// The unencoded numbers are followed by the first new numbers,
+		// the others are compressed apart
+		head_count = count < REOPEN_SIZE ? count : REOPEN_SIZE;
+		head = arena_reserve(&ctx->batch, (batch_size + head_count) * precision_size(precision));
+		if (head == NULL)
+			return (-1);
+
+		for (uint64_t i = 0; i < batch_size; i++) {
+			input_ptr = read_value(input_ptr, &value, header->value_size);
+			set_value(head, precision, i, value);
+		}
+		memcpy(head + batch_size * precision_size(precision), input, head_count * precision_size(precision));
+
+		job->write_offset = job->last_offset;
+		header->batch_count--;
+		batch_ptr = append_chunk(job, &cjob, bucketized_array, head, batch_size + head_count, job->last_elem, 
+				job->tail + (job->last_offset - job->tail_offset));
+		if (batch_ptr == NULL)
+			return (-1);
+
+		input = (uint8_t *) input + head_count * precision_size(precision);
+		count -= head_count;
+		elem += head_count;
+	}
+
+	batch_ptr = append_chunk(job, &cjob, bucketized_array, input, count, elem, batch_ptr);
+	if (batch_ptr == NULL)
+		return (-1);
+
+	elem += count;
+
+	memcpy(batch_ptr, job->index, job->index_count * INDEX_ENTRY_SIZE);
+	batch_ptr += job->index_count * INDEX_ENTRY_SIZE;
+	memcpy(batch_ptr, &job->index_count, sizeof(uint64_t));
+	batch_ptr += sizeof(uint64_t);
+
+	header->elem_count = elem;
+	header->has_index = 1;
+	header->size = job->tail_offset + (batch_ptr - job->tail);
+
+	return batch_ptr - job->tail;
+}
+
+// Writes the size and the counts of the header of a version 2 array that
+// has been appended to, its metadata gains the index flag and the flags
+// of the numbers appended to an empty array
+static void
+update_header(uint8_t *output, array_header *header)
+{
+uint32_t val32[2];
+uint64_t val64[3];
+
+	memcpy(val32, output, sizeof(val32));
+	val32[0] = header->size < UINT32_MAX ? header->size : UINT32_MAX;
+	val32[1] |= METADATA_INDEX;
+	if (header->value_size == sizeof(double))
+		val32[1] |= METADATA_WIDE_VALUES;
+	if (header->is_signed)
+		val32[1] |= METADATA_SIGNED;
+
+	val64[0] = header->size;
+	val64[1] = header->elem_count;
+	val64[2] = header->batch_count;
+
+	memcpy(output, val32, sizeof(val32));
+	memcpy(output + sizeof(val32), val64, sizeof(val64));
+}
+
+/*
+** Appends count numbers of input, whose precision is precision, to the
+** compressed array, which has space for capacity bytes. Only the end of
+** the array is read and written, from its last index entry on, the work
+** does not depend on the size of the array once it has an index. Arrays
+** that are appended to always have one. Returns the new size of the
+** array, 0 in case of error or if capacity is too small, in which case
+** the array is left as it was
+*/
+static size_t
+approximate_append(ac_context *ctx, uint8_t *array, size_t capacity, uint8_t precision, uint64_t count, void *input)
+{
+append_job job;
+uint64_t index_size;
+uint64_t entry_count;
+
+	if (read_header((compressed_array) array, &job.header) != 0 || job.header.size > capacity)
+		return 0;
+
+	if (append_check(&job.header, precision, count, input) != 0)
+		return 0;
+
+	entry_count = 0;
+	if (job.header.has_index && job.header.size >= job.header.header_size + sizeof(uint64_t))
+		memcpy(&entry_count, array + job.header.size - sizeof(uint64_t), sizeof(uint64_t));
+	if (append_index_size(&job.header, entry_count, &index_size) != 0)
+		return 0;
+
+	// The index is staged, the new batches are written over it
+	job.index = arena_reserve(&ctx->index_staging, (entry_count + 1) * INDEX_ENTRY_SIZE);
+	if (job.index == NULL)
+		return 0;
+	memcpy(job.index, array + job.header.size - index_size, entry_count * INDEX_ENTRY_SIZE);
+	job.index_count = entry_count;
+
+	if (append_find_tail(&job, index_size) != 0)
+		return 0;
+
+	job.tail = array + job.tail_offset;
+	if (append_find_last(&job) != 0)
+		return 0;
+
+	if (append_bound(&job, count) > capacity - job.tail_offset)
+		return 0;
+
+	if (append_batches(ctx, &job, precision, count, input) < 0)
+		return 0;
+
+	update_header(array, &job.header);
+
+	return job.header.size;
+}
+
+// Reads size bytes at offset of the file, retrying short and interrupted
+// reads. Returns 0 on success, -1 in case of error
+static int
+pread_full(int fd, uint8_t *data, uint64_t size, uint64_t offset)
+{
+ssize_t n;
+
+	while (size > 0) {
+		n = pread(fd, data, size, offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return (-1);
+
+		data += n;
+		size -= n;
+		offset += n;
+	}
+
+	return 0;
+}
+
+// Same as pread_full for writes
+static int
+pwrite_full(int fd, uint8_t *data, uint64_t size, uint64_t offset)
+{
+ssize_t n;
+
+	while (size > 0) {
+		n = pwrite(fd, data, size, offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return (-1);
+
+		data += n;
+		size -= n;
+		offset += n;
+	}
+
+	return 0;
+}
+
+/*
+** Same as approximate_append for the compressed array in the file fd,
+** which starts at offset 0 and is opened for reading and writing. The
+** header, the index and the tail are read, the tail is staged in the
+** compressed arena of the context ctx. The bytes from the last batch on
+** are written back, then the header. The file is not consistent if the
+** append is interrupted. Returns 0 on success, -1 in case of error
+*/
+static int
+approximate_append_fd(ac_context *ctx, int fd, uint8_t precision, uint64_t count, void *input)
+{
+uint8_t header_bytes[HEADER_SIZE];
+append_job job;
+uint64_t index_size;
+uint64_t entry_count;
+uint64_t old_size;
+int64_t tail_size;
+
+	if (pread_full(fd, header_bytes, HEADER_SIZE, 0) != 0)
+		return (-1);
+
+	if (read_header((compressed_array) header_bytes, &job.header) != 0)
+		return (-1);
+
+	if (append_check(&job.header, precision, count, input) != 0)
+		return (-1);
+
+	entry_count = 0;
+	if (job.header.has_index && job.header.size >= job.header.header_size + sizeof(uint64_t) 
+			&& pread_full(fd, (uint8_t *) &entry_count, sizeof(uint64_t), job.header.size - sizeof(uint64_t)) != 0)
+		return (-1);
+	if (append_index_size(&job.header, entry_count, &index_size) != 0)
+		return (-1);
+
+	job.index = arena_reserve(&ctx->index_staging, (entry_count + 1) * INDEX_ENTRY_SIZE);
+	if (job.index == NULL)
+		return (-1);
+	if (pread_full(fd, (uint8_t *) job.index, entry_count * INDEX_ENTRY_SIZE, job.header.size - index_size) != 0)
+		return (-1);
+	job.index_count = entry_count;
+
+	if (append_find_tail(&job, index_size) != 0)
+		return (-1);
+
+	job.tail = arena_reserve(&ctx->compressed, job.data_end - job.tail_offset);
+	if (job.tail == NULL && job.data_end > job.tail_offset)
+		return (-1);
+	if (pread_full(fd, job.tail, job.data_end - job.tail_offset, job.tail_offset) != 0)
+		return (-1);
+
+	if (append_find_last(&job) != 0)
+		return (-1);
+
+	job.tail = arena_grow(&ctx->compressed, append_bound(&job, count));
+	if (job.tail == NULL)
+		return (-1);
+
+	old_size = job.header.size;
+	tail_size = append_batches(ctx, &job, precision, count, input);
+	if (tail_size < 0)
+		return (-1);
+
+	if (pwrite_full(fd, job.tail + (job.write_offset - job.tail_offset), job.header.size - job.write_offset, 
+			job.write_offset) != 0)
+		return (-1);
+
+	if (job.header.size < old_size && ftruncate(fd, job.header.size) != 0)
+		return (-1);
+
+	update_header(header_bytes, &job.header);
+
+	return pwrite_full(fd, header_bytes, HEADER_SIZE, 0);
+}
+
+// A reader decodes compressed arrays, or the frames of a stream, as their
+// bytes arrive. It keeps a window of the input that holds at least one
+// batch and the numbers of the batch being returned, so its memory does
+// not depend on the size of the arrays
+struct ac_reader {
+	ac_reader_read read;	// NULL if the whole input is in data
+	void *opaque;
+	int fd;			// Read by read_fd
+	uint8_t output_precision;
+	uint8_t *data;		// Window of the input
+	size_t data_size;	// Bytes in the window
+	size_t pos;		// Next byte to be read in the window
+	int at_end;		// All the input is in the window
+	ac_arena input;		// Window, unless the input is a buffer
+	array_header header;	// Array being read
+	int in_array;
+	uint64_t array_left;	// Bytes of the array after pos
+	uint64_t batch_left;	// Batches of the array after pos
+	uint64_t elem_left;	// Numbers of the array after pos
+	ac_arena staging;	// Bucket numbers of a batch
+	ac_arena batch;		// Numbers of a batch returned in part
+	uint64_t batch_size;
+	uint64_t batch_pos;	// Next number of the batch to be returned
+	int status;		// -1 once an error occurred
+};
+
+// Number of bytes the reader asks for at least when the window is filled
+#define READ_SIZE (1 << 16)
+
+// Largest number of bytes of a varint of 64 bits
+#define MAX_VARINT_SIZE 10
+
+// Reads from the file descriptor of the reader, retrying interrupted reads
+static int64_t
+read_fd(void *opaque, uint8_t *data, size_t size)
+{
+ac_reader *reader;
+ssize_t n;
+
+	reader = opaque;
+	do {
+		n = read(reader->fd, data, size);
+	} while (n < 0 && errno == EINTR);
+
+	return n;
+}
+
+static ac_reader *
+reader_create(uint8_t output_precision)
+{
+ac_reader *reader;
+
+	if ((output_precision != PRECISION_SINGLE) && (output_precision != PRECISION_DOUBLE) 
+			&& (output_precision != PRECISION_HALF) && (output_precision != PRECISION_BFLOAT16))
+		return NULL;
+
+	reader = calloc(1, sizeof(ac_reader));
+	if (reader == NULL) {
+		if (DEBUG)
+			printf("Internal error at file %s line %d: memory allocation failed\n",  __FILE__, __LINE__);
+		return NULL;
+	}
+
+	reader->output_precision = output_precision;
+
+	return reader;
+}
+
+// Creates a reader of the size bytes at data, which must remain valid
+// while the reader is used
+ac_reader *
+ac_reader_init_buffer(uint8_t *data, size_t size, uint8_t output_precision)
+{
+ac_reader *reader;
+
+	reader = reader_create(output_precision);
+	if (reader == NULL)
+		return NULL;
+
+	reader->data = data;
+	reader->data_size = size;
+	reader->at_end = 1;
+
+	return reader;
+}
+
+// Creates a reader of the bytes returned by read, which writes up to size
+// bytes to data and returns their number, 0 at the end of the input, -1 in
+// case of error
+ac_reader *
+ac_reader_init(ac_reader_read read, void *opaque, uint8_t output_precision)
+{
+ac_reader *reader;
+
+	reader = reader_create(output_precision);
+	if (reader == NULL)
+		return NULL;
+
+	reader->read = read;
+	reader->opaque = opaque;
+
+	return reader;
+}
+
+// Creates a reader of the file descriptor fd, which is not closed
+ac_reader *
+ac_reader_init_fd(int fd, uint8_t output_precision)
+{
+ac_reader *reader;
+
+	reader = reader_create(output_precision);
+	if (reader == NULL)
+		return NULL;
+
+	reader->read = read_fd;
+	reader->opaque = reader;
+	reader->fd = fd;
+
+	return reader;
+}
+
+void
+ac_reader_free(ac_reader *reader)
+{
+	if (reader == NULL)
+		return;
+
+	free(reader->input.base);
+	free(reader->staging.base);
+	free(reader->batch.base);
+	free(reader);
+}
+
+// Makes sure the window holds size bytes after pos, unless the input ends
+// before. The bytes before pos are dropped. Returns the number of bytes
+// after pos, -1 in case of error
+static int64_t
+reader_fill(ac_reader *reader, size_t size)
+{
+size_t kept;
+int64_t n;
+
+	if (reader->data_size - reader->pos >= size || reader->at_end)
+		return reader->data_size - reader->pos;
+
+	kept = reader->data_size - reader->pos;
+	if (kept > 0)
+		memmove(reader->input.base, reader->input.base + reader->pos, kept);
+	reader->pos = 0;
+	reader->data_size = kept;
+
+	reader->data = arena_grow(&reader->input, size > READ_SIZE ? size : READ_SIZE);
+	if (reader->data == NULL)
+		return (-1);
+
+	while (reader->data_size < size) {
+		n = reader->read(reader->opaque, reader->data + reader->data_size, reader->input.size - reader->data_size);
+		if (n < 0)
+			return (-1);
+		if (n == 0) {
+			reader->at_end = 1;
+			break;
+		}
+
+		reader->data_size += n;
+	}
+
+	return reader->data_size - reader->pos;
+}
+
+// Drops size bytes of the input, which may not all be in the window.
+// Returns 0 on success, -1 if the input ends before
+static int
+reader_skip(ac_reader *reader, uint64_t size)
+{
+int64_t avail;
+
+	while (size > 0) {
+		avail = reader_fill(reader, 1);
+		if (avail <= 0)
+			return (-1);
+
+		if (avail > size)
+			avail = size;
+		reader->pos += avail;
+		size -= avail;
+	}
+
+	return 0;
+}
+
+// Starts reading the array at pos. Returns 1 if there is one, 0 at the end
+// of the input, -1 in case of error
+static int
+reader_start_array(ac_reader *reader)
+{
+uint8_t header[HEADER_SIZE];
+int64_t avail;
+
+	avail = reader_fill(reader, HEADER_SIZE);
+	if (avail <= 0)
+		return avail;
+
+	// The header of a version 1 array is shorter, the bytes after the
+	// end of the input are zero
+	memset(header, 0, HEADER_SIZE);
+	memcpy(header, reader->data + reader->pos, avail < HEADER_SIZE ? avail : HEADER_SIZE);
+
+	if (read_header((compressed_array) header, &reader->header) != 0 || reader->header.size > (uint64_t) INT64_MAX 
+			|| reader->header.size < reader->header.header_size || avail < reader->header.header_size) {
+		if (DEBUG)
+			printf("Array at byte %zu has a bad header\n", reader->pos);
+		return (-1);
+	}
+
+	reader->pos += reader->header.header_size;
+	reader->array_left = reader->header.size - reader->header.header_size;
+	reader->batch_left = reader->header.batch_count;
+	reader->elem_left = reader->header.elem_count;
+	reader->in_array = 1;
+
+	return 1;
+}
+
+// Decodes the next batch of the input. Its numbers are written to output
+// if it has space for them, otherwise the batch is kept and the first
+// space numbers are written. Returns the number of numbers written, 0 at
+// the end of the input, -1 in case of error
+static int64_t
+reader_next_batch(ac_reader *reader, uint8_t *output, uint64_t space)
+{
+uint8_t *input_ptr;
+uint8_t *input_end;
+uint8_t *batch_output;
+uint64_t batch_size;
+size_t value_size;
+size_t size_bytes;
+uint64_t need;
+int64_t avail;
+int status;
+
+	value_size = precision_size(reader->output_precision);
+
+	// The index that may follow the batches of an array is skipped
+	while (!reader->in_array || reader->batch_left == 0) {
+		if (reader->in_array) {
+			if (reader->elem_left != 0 || reader_skip(reader, reader->array_left) != 0)
+				return (-1);
+			reader->in_array = 0;
+		}
+
+		status = reader_start_array(reader);
+		if (status <= 0)
+			return status;
+	}
+
+	avail = reader_fill(reader, MAX_VARINT_SIZE);
+	if (avail < 0)
+		return (-1);
+
+	input_ptr = reader->data + reader->pos;
+	input_end = input_ptr + (avail < reader->array_left ? avail : reader->array_left);
+	input_ptr = read_batch_size(input_ptr, input_end, reader->header.version, &batch_size);
+	if (input_ptr == NULL || batch_size == 0 || batch_size > reader->elem_left || batch_size > MAX_BATCH_SIZE) {
+		if (DEBUG)
+			printf("Batch at byte %zu has a bad number of elements\n", reader->pos);
+		return (-1);
+	}
+	size_bytes = input_ptr - (reader->data + reader->pos);
+
+	batch_output = output;
+	if (batch_size > space) {
+		batch_output = arena_reserve(&reader->batch, batch_size * value_size);
+		if (batch_output == NULL)
+			return (-1);
+	}
+
+	// A batch takes at most its bounds, its encoded data, which is
+	// smaller than the plain bucket numbers, and its signs. The window
+	// is made larger if the batch does not fit after all
+	need = size_bytes + 2 * reader->header.value_size + 1 + MAX_VARINT_SIZE + batch_size + 1 + (batch_size + 7) / 8;
+	for (;;) {
+		if (need > reader->array_left)
+			need = reader->array_left;
+
+		avail = reader_fill(reader, need);
+		if (avail < 0)
+			return (-1);
+
+		input_ptr = reader->data + reader->pos;
+		input_end = input_ptr + (avail < reader->array_left ? avail : reader->array_left);
+		input_ptr = decode_batch(&reader->staging, &reader->header, input_ptr + size_bytes, input_end, batch_size, 
+				reader->output_precision, batch_output);
+		if (input_ptr != NULL)
+			break;
+
+		if (input_end - (reader->data + reader->pos) >= reader->array_left || reader->at_end)
+			return (-1);
+		need *= 2;
+	}
+
+	reader->array_left -= input_ptr - (reader->data + reader->pos);
+	reader->pos = input_ptr - reader->data;
+	reader->batch_left--;
+	reader->elem_left -= batch_size;
+
+	if (batch_output == output)
+		return batch_size;
+
+	memcpy(output, batch_output, space * value_size);
+	reader->batch_size = batch_size;
+	reader->batch_pos = space;
+
+	return space;
+}
+
+// Writes the next count numbers of the input to output, in the precision
+// of the reader. Returns the number of numbers written, less than count
+// only at the end of the input, -1 in case of error
+int64_t
+ac_reader_next(ac_reader *reader, void *output, uint64_t count)
+{
+size_t value_size;
+uint64_t done;
+uint64_t n;
+int64_t status;
+
+	if (reader->status != 0)
+		return (-1);
+
+	value_size = precision_size(reader->output_precision);
+
+	done = 0;
+	while (done < count) {
+		// Numbers of a batch that did not fit come first
+		if (reader->batch_pos < reader->batch_size) {
+			n = reader->batch_size - reader->batch_pos;
+			if (n > count - done)
+				n = count - done;
+
+			memcpy((uint8_t *) output + done * value_size, reader->batch.base + reader->batch_pos * value_size, 
+					n * value_size);
+			reader->batch_pos += n;
+			done += n;
+			continue;
+		}
+
+		status = reader_next_batch(reader, (uint8_t *) output + done * value_size, count - done);
+		if (status < 0)
+			return (reader->status = (-1));
+		if (status == 0)
+			break;
+
+		done += status;
+	}
+
+	return done;
+}
+
+// The compressed array is kept in the compressed arena of the context ctx,
+// it remains valid until the next compression using the same context
+
+static compressed_array
+context_compress(ac_context *ctx, uint64_t elem_count, uint8_t precision, uint8_t accuracy, void *input)
+{
+uint8_t *output;
+
+	output = arena_reserve(&ctx->compressed, compress_bound(elem_count, precision));
+	if (output == NULL)
+		return NULL;
+
+	if (approximate_compress(ctx, elem_count, precision, accuracy, input, output) == 0)
+		return NULL;
+
+	return (compressed_array) output;
+}
+
+compressed_array
+ac_compress_float(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, float *input)
+{
+	return(context_compress(ctx, elem_count, PRECISION_SINGLE, accuracy, input));
+}
+
+compressed_array
+ac_compress_double(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, double *input)
+{
+	return(context_compress(ctx, elem_count, PRECISION_DOUBLE, accuracy, input));
+}
+
+compressed_array
+ac_compress_half(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, uint16_t *input)
+{
+	return(context_compress(ctx, elem_count, PRECISION_HALF, accuracy, input));
+}
+
 compressed_array
-approximate_compress(uint32_t elem_count, uint8_t precision, uint8_t accuracy, float *input)
+ac_compress_bfloat16(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, uint16_t *input)
+{
+	return(context_compress(ctx, elem_count, PRECISION_BFLOAT16, accuracy, input));
+}
+
+// The uncompressed array is kept in the decompressed arena of the context
+// ctx, it remains valid until the next decompression using the same context.
+// The first 4 bytes contain the length N followed by N bytes of float,
+// double, half precision or bfloat16 numbers, depending on the precision
+// of the original array
+uint8_t *
+ac_decompress(ac_context *ctx, compressed_array input)
 {
-uint8_t *bucketized_array;
-float min;
-float max;
-float *p_float;
-uint8_t *batch_ptr;
-uint8_t encoded_bucket[UINT16_MAX];
-uint8_t output_bucket[BLOCK_SIZE];
 uint8_t *output;
-uint8_t batch_encode_key;
-uint16_t encoded_size;
-uint16_t batch_size;
-uint16_t batch_count;
-uint32_t metadata;
-uint32_t elem_processed;
-uint32_t start;
-uint32_t end;
-uint32_t output_size;
-uint32_t byte_count;
-uint16_t *p_val16;
-uint32_t *p_val32;
+array_header header;
+uint64_t output_size;
 
-	// Compressed FP array structure
-	// Size of the compressed array in bytes uint32_t
-	// Meta data, for example size (16/32/64), maximum err (1/0.5/0.25 etc) uint32_t
-	// Number of elements N uint32_t
-	// Number of batches n uint32_t
-	// Repeated n times
-	//   Number of elements in this batch uint16_t
-	//   Max and Min for this batch 32|64 bit
-	//   Type of encoding used in this batch uint8_t
-	//   Number of bytes in this batch uint16_t
-	//   Encoded bit representation for each element
+	if (read_header(input, &header) != 0)
+		return NULL;
 
-	// The first four elements of compressed buffer to be filled later with the size
-	// of the compressed structure, metadata, number of elements and number of batches
+	// The size of the uncompressed array must fit in its first four bytes
+	output_size = (uint64_t) header.elem_count * precision_size(header.precision);
+	if (output_size > UINT32_MAX - sizeof(uint32_t)) {
+		if (DEBUG)
+			printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
+		return NULL;
+	}
 
-	p_val32 = (uint32_t *) output_bucket;
-	*p_val32++ = 0; 
-	*p_val32++ = 0;
-	*p_val32++ = 0; 
-	*p_val32++ = 0; 
+	output = arena_reserve(&ctx->decompressed, sizeof(uint32_t) + output_size);
+	if (output == NULL)
+		return NULL;
 
-	// batch_ptr will be used to fillup the output bucket
-	batch_ptr = (uint8_t *) p_val32;
+	if (approximate_decompress(ctx, input, header.precision, output + sizeof(uint32_t), header.elem_count) != 0)
+		return NULL;
 
-	start = 0;
-	batch_count = 0;
+	// The size is followed by the numbers
+	*(uint32_t *) output = output_size;
 
-	// Loop through all batches. A batch is a sequence such that
-	// all numbers are within a range of min .. 2 * min
+	return output;
+}
 
-	do {
-		// Started processing a new batch
-		batch_count++;
+// The functions below write to a caller provided buffer. The context
+// ctx may be NULL, in which case a context is created for the call.
+// The compressed array is written straight to output if it has space
+// for compress_bound bytes, otherwise it is staged in the context and
+// copied. Returns the size of the compressed array, 0 in case of error
+// or if output is too small
 
-		// Initialize batch_size, in case all the numbers are within
-		// the range min .. 2 * min. This happens for the last batch
-		// or if there is only one batch. Needed because the for loop
-		// below does not initialize the batch_size, if all the remaining
-		// numbers are within the range min .. 2 * min
+size_t
+context_compress_into(ac_context *ctx, uint64_t elem_count, uint8_t precision, uint8_t accuracy, void *input, 
+		uint8_t *output, size_t output_capacity)
+{
+uint8_t *output_bucket;
+size_t output_size;
 
-		batch_size = elem_count - start; 
+	if (output_capacity >= compress_bound(elem_count, precision))
+		return approximate_compress(ctx, elem_count, precision, accuracy, input, output);
 
-		// Take care of some special cases now
+	output_bucket = arena_reserve(&ctx->compressed, compress_bound(elem_count, precision));
+	if (output_bucket == NULL)
+		return 0;
 
-		// No element left after the last batch
-		if (batch_size == 0) 
-			break;
+	output_size = approximate_compress(ctx, elem_count, precision, accuracy, input, output_bucket);
+	if (output_size == 0 || output_size > output_capacity)
+		return 0;
 
-		// Just one element left after the last batch
-		// or the next element is 0.0, which forms a
-		// batch of its own
-		if (batch_size == 1) {
-			// In this case, there will be no encoding the
-			// lone element will be put in place of max
-			p_val16 = (uint16_t *) batch_ptr;
-			*p_val16 = 1;
-			batch_ptr = batch_ptr + sizeof(uint16_t);
-			p_float = (float *) batch_ptr;
-			*p_float++ = input[start];
-			batch_ptr = (uint8_t *) p_float;
+	memcpy(output, output_bucket, output_size);
 
-			if (VERBOSE)
-				printf("Batch # %d has one element = %.9f\n", (batch_count - 1), input[start]);
+	return output_size;
+}
 
-			break;
-		}
+static size_t
+compress_into(ac_context *ctx, uint64_t elem_count, uint8_t precision, uint8_t accuracy, void *input, uint8_t *output, size_t output_capacity)
+{
+ac_context *own_ctx;
+size_t output_size;
+
+	own_ctx = NULL;
+	if (ctx == NULL) {
+		ctx = own_ctx = ac_context_create();
+		if (ctx == NULL)
+			return 0;
+	}
 
-		// Just two elements left after the last batch
-		if (batch_size == 2) {
-			// Create a mini batch of size two
-			// In this case, there will be no encoding, the
-			// two elements will be put in place of max and min
-			p_val16 = (uint16_t *) batch_ptr;
-			*p_val16 = 2;
-			batch_ptr = batch_ptr + sizeof(uint16_t);
-			p_float = (float *) batch_ptr;
-			*p_float++ = input[start];
-			*p_float++ = input[start + 1];
-			batch_ptr = (uint8_t *) p_float;
+	output_size = context_compress_into(ctx, elem_count, precision, accuracy, input, output, output_capacity);
 
-			if (VERBOSE)
-				printf("Batch # %d has two elements, %.9f, %.9f\n", (batch_count - 1), input[start], input[start + 1]);
+	ac_context_free(own_ctx);
 
-			break;
-		}
+	return output_size;
+}
 
-		// RESOLVE: Do not terminate a batch due to presence of 0.0
-		// Have a special bucket for 0.0
+size_t
+ac_compress_float_into(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, float *input, uint8_t *output, size_t output_capacity)
+{
+	return(compress_into(ctx, elem_count, PRECISION_SINGLE, accuracy, input, output, output_capacity));
+}
 
-		if (input[start] == 0.0) {
-			// In this case, there will be no encoding the
-			// lone element will be put in place of max
-			p_val16 = (uint16_t *) batch_ptr;
-			*p_val16 = 1;
-			batch_ptr = batch_ptr + sizeof(uint16_t);
-			p_float = (float *) batch_ptr;
-			*p_float++ = 0.0;
-			batch_ptr = (uint8_t *) p_float;
-			start += 1;
+size_t
+ac_compress_double_into(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, double *input, uint8_t *output, size_t output_capacity)
+{
+	return(compress_into(ctx, elem_count, PRECISION_DOUBLE, accuracy, input, output, output_capacity));
+}
 
-			if (VERBOSE)
-				printf("Batch # %d has one element = %.9f\n", (batch_count - 1), input[start]);
+size_t
+ac_compress_half_into(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, uint16_t *input, uint8_t *output, size_t output_capacity)
+{
+	return(compress_into(ctx, elem_count, PRECISION_HALF, accuracy, input, output, output_capacity));
+}
 
-			continue;
-		} else if (input[start + 1] == 0.0) {
-			// Create a mini batch of size two
-			// In this case, there will be no encoding, 0.0 and the
-			// other element will be put in place of max and min
-			p_val16 = (uint16_t *) batch_ptr;
-			*p_val16 = 2;
-			batch_ptr = batch_ptr + sizeof(uint16_t);
-			p_float = (float *) batch_ptr;
-			*p_float++ = input[start];
-			*p_float++ = input[start + 1];
-			batch_ptr = (uint8_t *) p_float;
-			start += 2;
+size_t
+ac_compress_bfloat16_into(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, uint16_t *input, uint8_t *output, size_t output_capacity)
+{
+	return(compress_into(ctx, elem_count, PRECISION_BFLOAT16, accuracy, input, output, output_capacity));
+}
 
-			if (VERBOSE)
-				printf("Batch # %d has two elements, %.9f, %.9f\n", (batch_count - 1), input[start], input[start + 1]);
+// Decompress to a caller provided array of output_count float, double,
+// half precision or bfloat16 numbers, which must be at least get_element_count(input). The context
+// ctx may be NULL, in which case a context is created for the call.
+// Returns 0 on success, -1 in case of error
 
-			continue;
-		}
+static int
+decompress_into(ac_context *ctx, compressed_array input, uint8_t output_precision, uint8_t *output, uint64_t output_count)
+{
+ac_context *own_ctx;
+int status;
 
-		if (input[start] > input[start + 1]) {
-			max = input[start];
-			min = input[start + 1];
-		} else {
-			max = input[start + 1];
-			min = input[start];
-		}
+	own_ctx = NULL;
+	if (ctx == NULL) {
+		ctx = own_ctx = ac_context_create();
+		if (ctx == NULL)
+			return (-1);
+	}
 
-		// RESOLVE: Change hard coded 2 to number of elements that need to be skipped
-		// to find non-zero max and min
-		for (int i = start + 2; i < elem_count; i++) {
-			// A batch can not be more than 65536
-			if (i >= start + UINT16_MAX) {
-				batch_size = i - start;
-				break;
-			}
+	status = approximate_decompress(ctx, input, output_precision, output, output_count);
 
-			if (input[i] == 0.0) {
-				batch_size = i - start;
-				break;
-			}
+	ac_context_free(own_ctx);
 
-			if (input[i] > max) {
-				if (input[i] >= 2.0 * min) {
-					batch_size = i - start;
-					break;
-				}
-				max = input[i];
-			}
-			if (input[i] < min) {
-				if (input[i] <= 0.5 * max) {
-					batch_size = i - start;
-					break;
-				}
-				min = input[i];
-			}
-		}
+	return status;
+}
 
-		// At this pointed we have just identified a batch. In some
-		// case, the entire input array may be a batch, but a batch 
-		// may not have more than 65536 (Max uint16_t) elements
-		
-		if (VERBOSE)
-			printf("Batch # %d has %d elements, max = %.9f, min = %.9f\n", (batch_count - 1), batch_size, max, min);
+int
+ac_decompress_float_into(ac_context *ctx, compressed_array input, float *output, uint64_t output_count)
+{
+	return(decompress_into(ctx, input, PRECISION_SINGLE, (uint8_t *) output, output_count));
+}
 
-		p_val16 = (uint16_t *) batch_ptr;
-		*p_val16 = batch_size;
-		batch_ptr = batch_ptr + sizeof(uint16_t);
+int
+ac_decompress_double_into(ac_context *ctx, compressed_array input, double *output, uint64_t output_count)
+{
+	return(decompress_into(ctx, input, PRECISION_DOUBLE, (uint8_t *) output, output_count));
+}
 
-		p_float = (float *) batch_ptr;
-		*p_float++ = max;
-		*p_float++ = min;
-		batch_ptr = (uint8_t *) p_float;
+int
+ac_decompress_half_into(ac_context *ctx, compressed_array input, uint16_t *output, uint64_t output_count)
+{
+	return(decompress_into(ctx, input, PRECISION_HALF, (uint8_t *) output, output_count));
+}
 
-		// RESOLVE: The parameter precision is not used by bucketize, set to zero
-		bucketized_array = bucketize(batch_size, input + start, max, min, 0, accuracy);
-		batch_encode_key = bucket_analyze(batch_size, bucketized_array);
+int
+ac_decompress_bfloat16_into(ac_context *ctx, compressed_array input, uint16_t *output, uint64_t output_count)
+{
+	return(decompress_into(ctx, input, PRECISION_BFLOAT16, (uint8_t *) output, output_count));
+}
 
-		*batch_ptr++ = batch_encode_key;
+// Decompress count numbers starting with element start to a caller provided
+// array of float, double, half precision or bfloat16 numbers. The context
+// ctx may be NULL, in which case a context is created for the call.
+// Returns 0 on success, -1 in case of error
 
-		if (batch_encode_key == 0) {
-			// Delta encoding is not possible, copy the bucketized array
-			for (int i = 0; i < batch_size; i++)
-				batch_ptr[i] = bucketized_array[i];
+static int
+decompress_range(ac_context *ctx, compressed_array input, uint64_t start, uint64_t count, uint8_t output_precision, 
+		uint8_t *output)
+{
+ac_context *own_ctx;
+int status;
 
-			batch_ptr += batch_size;
-		} else {
-			uint8_encode(batch_encode_key, batch_size, bucketized_array, encoded_bucket);
+	own_ctx = NULL;
+	if (ctx == NULL) {
+		ctx = own_ctx = ac_context_create();
+		if (ctx == NULL)
+			return (-1);
+	}
 
-			// The first two bytes of the encoded buffer contains the size.
-			// first retrieve the size and then the rest of the buffer
+	status = approximate_decompress_range(ctx, input, start, count, output_precision, output);
 
-			p_val16 = (uint16_t *) encoded_bucket;
-			encoded_size = *p_val16;
-			if (DEBUG)
-				printf("encoded size = %d\n", encoded_size);
-			// Check for error
-			if (encoded_size == 0) {
-				free(bucketized_array);
-				return NULL;
-			}
-				
-			for (int i = 0; i < encoded_size; i++)
-				batch_ptr[i] = encoded_bucket[i];
+	ac_context_free(own_ctx);
 
-			batch_ptr += encoded_size;
-		}
+	return status;
+}
 
-		if (DEBUG)
-			printf("start = %d\tend = %d\tsize = %d\n", start, start + batch_size - 1, batch_size);
+int
+ac_decompress_range_float(ac_context *ctx, compressed_array input, uint64_t start, uint64_t count, float *output)
+{
+	return(decompress_range(ctx, input, start, count, PRECISION_SINGLE, (uint8_t *) output));
+}
 
-		start += batch_size;
+int
+ac_decompress_range_double(ac_context *ctx, compressed_array input, uint64_t start, uint64_t count, double *output)
+{
+	return(decompress_range(ctx, input, start, count, PRECISION_DOUBLE, (uint8_t *) output));
+}
 
-		// Release the bucketized array to prevent memory leakage
-		free(bucketized_array);
+int
+ac_decompress_range_half(ac_context *ctx, compressed_array input, uint64_t start, uint64_t count, uint16_t *output)
+{
+	return(decompress_range(ctx, input, start, count, PRECISION_HALF, (uint8_t *) output));
+}
 
-	} while (start < elem_count);
+int
+ac_decompress_range_bfloat16(ac_context *ctx, compressed_array input, uint64_t start, uint64_t count, uint16_t *output)
+{
+	return(decompress_range(ctx, input, start, count, PRECISION_BFLOAT16, (uint8_t *) output));
+}
 
-	output_size = batch_ptr - output_bucket;
+// Append numbers to a compressed array in a caller provided buffer or in a
+// file. The context ctx may be NULL, in which case a context is created for
+// the call
 
-	if (VERBOSE)
-		printf("Compressed %d elements in %d batches, output size = %d bytes\n", elem_count, batch_count, output_size);
+static size_t
+append(ac_context *ctx, compressed_array array, size_t capacity, uint8_t precision, uint64_t count, void *input)
+{
+ac_context *own_ctx;
+size_t size;
+
+	own_ctx = NULL;
+	if (ctx == NULL) {
+		ctx = own_ctx = ac_context_create();
+		if (ctx == NULL)
+			return 0;
+	}
 
-	// Finally patch the header of the compressed structure
-	// with the size of the encoded buffer, total number of
-	// floating point elements in the input array and the 
-	// number of batches 
-	
-	metadata = (precision << 3) |accuracy;
+	size = approximate_append(ctx, (uint8_t *) array, capacity, precision, count, input);
 
-	if (DEBUG)
-		printf("precision = 0x%X, accuracy = 0x%X, metadata = 0x%X\n", precision, accuracy, metadata);
+	ac_context_free(own_ctx);
 
-	p_val32 = (uint32_t *) output_bucket;
-	*p_val32++ = output_size;
-	*p_val32++ = metadata;
-	*p_val32++ = elem_count;
-	*p_val32 = batch_count;
+	return size;
+}
 
-	output = malloc(output_size);
-	if (output == NULL)
-		return NULL;
+size_t
+ac_append_float(ac_context *ctx, compressed_array array, size_t capacity, uint64_t count, float *input)
+{
+	return(append(ctx, array, capacity, PRECISION_SINGLE, count, input));
+}
 
-	memcpy(output, output_bucket, output_size);
+size_t
+ac_append_double(ac_context *ctx, compressed_array array, size_t capacity, uint64_t count, double *input)
+{
+	return(append(ctx, array, capacity, PRECISION_DOUBLE, count, input));
+}
 
-	return (compressed_array) output;
+size_t
+ac_append_half(ac_context *ctx, compressed_array array, size_t capacity, uint64_t count, uint16_t *input)
+{
+	return(append(ctx, array, capacity, PRECISION_HALF, count, input));
 }
 
-/*
-** This function accepts as input an opaque structure 
-** (array of bytes) containing a compressed array, previously
-** generated using uncompress_float function. The first 
-** 4 bytes contain the length N followed by N bytes. It returns
-** the uncompressed array, the first 4 bytes contain the length 
-** N followed by N floating point numbers.
-**
-** In case of any error, a NULL pointer is returned
-**
-** High level algorithm:
-**  - From the header of the compressed structure, retrieve
-**    the total number of floating point numbers present
-**	  and the number of batches
-**	- For each batch perform following steps:
-**		- Decode the encoded bits to get the bucket numbers
-**		- Convert the bucket numbers to floating point numbers
-**		- Append the numbers to the uncompressed array
-*/
+size_t
+ac_append_bfloat16(ac_context *ctx, compressed_array array, size_t capacity, uint64_t count, uint16_t *input)
+{
+	return(append(ctx, array, capacity, PRECISION_BFLOAT16, count, input));
+}
 
-uint8_t *
-decompress_float(compressed_array input)
+static int
+append_fd(ac_context *ctx, int fd, uint8_t precision, uint64_t count, void *input)
 {
-uint8_t encoded_buffer[UINT16_MAX];
-uint8_t decoded_buffer[UINT16_MAX];
-uint8_t uncompressed_buffer[BLOCK_SIZE];
-float min;
-float max;
-uint16_t batch_size;
-uint32_t batch_size_in_bytes;
-uint16_t total_size;
-uint16_t encoded_buffer_size;
-uint8_t encode_key;
-uint32_t batch_count;
-uint32_t input_size;
-uint32_t elem_count;
-uint32_t metadata;
-uint8_t precision;
-uint8_t accuracy;
-uint8_t *input_ptr;
-uint8_t *output_ptr;
-float *output_ptr_float;
-double *output_ptr_double;
-double tmp_double;
-uint8_t *output;
-uint32_t output_size;
-uint32_t *p_val32;;
-uint16_t *p_val16;;
-float *p_float;;
+ac_context *own_ctx;
 int status;
 
-	input_ptr = (uint8_t *)input; // Make a copy of the input pointer
-	output_ptr = uncompressed_buffer;
+	own_ctx = NULL;
+	if (ctx == NULL) {
+		ctx = own_ctx = ac_context_create();
+		if (ctx == NULL)
+			return (-1);
+	}
 
-	// Compressed FP array structure
-	// Size of the compressed array in bytes uint32_t
-	// Meta data, for example size (16/32/64), maximum err (1/0.5/0.25 etc) uint32_t
-	// Number of elements N uint32_t
-	// Number of batches n uint32_t
-	// Repeated n times
-	//   Number of elements in this batch uint16_t
-	//   Max and Min for this batch 32|64 bit
-	//   Encoding key for this batch uint8_t
-	//   Number of bytes in this batch uint16_t
-	//   Encoded bit representation for each element
+	status = approximate_append_fd(ctx, fd, precision, count, input);
 
-	p_val32 = (uint32_t *) input_ptr;
-	input_size = *p_val32++;
-	metadata = *p_val32++;
-	elem_count = *p_val32++;
-	batch_count = *p_val32++;
-	input_ptr = (uint8_t *) p_val32;
+	ac_context_free(own_ctx);
 
-	accuracy = metadata & 0b111;
-	precision = (metadata >> 3) & 0b111;
+	return status;
+}
 
-	// Validate accuracy and precision
-	if ((precision != PRECISION_SINGLE) && (precision != PRECISION_DOUBLE)) {
-		if (DEBUG)
-			printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
-		return NULL;
-	}
+int
+ac_append_fd_float(ac_context *ctx, int fd, uint64_t count, float *input)
+{
+	return(append_fd(ctx, fd, PRECISION_SINGLE, count, input));
+}
 
-	if ((accuracy != ACCURACY_HALF_PERCENT) && (accuracy != ACCURACY_QUARTER_PERCENT) 
-			&& (accuracy != ACCURACY_ONE_TENTH_PERCENT)) {
-		if (DEBUG)
-			printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
-		return NULL;
-	}
+int
+ac_append_fd_double(ac_context *ctx, int fd, uint64_t count, double *input)
+{
+	return(append_fd(ctx, fd, PRECISION_DOUBLE, count, input));
+}
 
-	if (DEBUG) {
-		printf("Compressed file: input_size =%d metadata = %d elem_count = %d ", 
-				input_size, metadata, elem_count);
-		printf("batch_count = %d precision = %d accuracy = %d\n", 
-				batch_count, precision, accuracy);
-	}
+int
+ac_append_fd_half(ac_context *ctx, int fd, uint64_t count, uint16_t *input)
+{
+	return(append_fd(ctx, fd, PRECISION_HALF, count, input));
+}
 
-	total_size = 0;
+int
+ac_append_fd_bfloat16(ac_context *ctx, int fd, uint64_t count, uint16_t *input)
+{
+	return(append_fd(ctx, fd, PRECISION_BFLOAT16, count, input));
+}
 
-	// Loop through all batches. A batch is a sequence such that
-	// all numbers are within a range of min .. 2 * min
+// Number of elements in the compressed array, read from the header only
+uint64_t
+get_element_count(compressed_array c)
+{
+array_header header;
 
-	for (int i = 0; i < batch_count; i++) {
-		// Started processing a new batch
-		p_val16 = (uint16_t *) input_ptr;
-		batch_size = *p_val16++;
-		input_ptr = (uint8_t *) p_val16;
-
-		// Take care of the special case when the batch has
-		// Just one or two elements. Nothing to be decoded
-		if (batch_size == 1 || batch_size == 2) {
-			// Write as float or double
-			p_float = (float *) input_ptr;
-			if (precision == PRECISION_SINGLE) {
-				output_ptr_float = (float *) output_ptr;
-
-				*output_ptr_float++ = *p_float++;
-				if (batch_size == 2) {
-					*output_ptr_float++ = *p_float++;
-				}
-
-				output_ptr = (uint8_t *) output_ptr_float;
-			} else {
-				output_ptr_double = (double *) output_ptr;
-
-				tmp_double = *p_float++;
-				*output_ptr_double++ = tmp_double;
-
-				if (batch_size == 2) {
-					tmp_double = *p_float++;
-					*output_ptr_double++ = tmp_double;
-				}
-
-				output_ptr = (uint8_t *) output_ptr_double;
-			}
+	if (read_header(c, &header) != 0)
+		return 0;
 
-			input_ptr = (uint8_t *) p_float;
+	return header.elem_count;
+}
 
-			// Update the number of elements processed so far
-			total_size += batch_size;
+// Size in bytes of the numbers returned by decompress_float or ac_decompress,
+// not counting the 4 byte length, read from the header only
+size_t
+get_decompressed_size(compressed_array c)
+{
+array_header header;
 
-			if (VERBOSE)
-				printf("Batch #%d has %d elements\n", i, batch_size);
+	if (read_header(c, &header) != 0)
+		return 0;
 
-			continue;
-		}
+	return (size_t) header.elem_count * precision_size(header.precision);
+}
 
-		// Update the number of elements processed so far
-		total_size += batch_size;
+// The functions below compress or decompress a single array using a
+// context of their own. The result is taken over from the arena of
+// the context and trimmed to its size, the caller must free it
 
-		p_float = (float *) input_ptr;
-		max = *p_float++;
-		min = *p_float++;
-		input_ptr = (uint8_t *) p_float;
+static uint8_t *
+take_result(ac_arena *arena, uint8_t *result, size_t size)
+{
+uint8_t *output;
 
-		encode_key = *input_ptr++;
+	if (result == NULL)
+		return NULL;
 
-		if (VERBOSE)
-			printf("Batch #%d has %d elements, max = %.9f, min = %.9f\n", i, batch_size, max, min);
-		if (DEBUG)
-			printf("Batch #%d encoded using encode key = %d\n", i, encode_key);
+	arena->base = NULL;
+	arena->size = 0;
 
-		// Validate batch_size, just in case
-		if (batch_size == 0) {
-			if (DEBUG)
-				printf("Batch #%d has size zero\n", i);
-			return NULL;
-		}
+	output = realloc(result, size);
+	if (output == NULL)
+		return result;
 
-		if (encode_key == 0) {
-			memcpy(decoded_buffer, input_ptr, batch_size);
-			input_ptr += batch_size;
-		} else {
-			p_val16 = (uint16_t *) input_ptr;
-			encoded_buffer_size = *p_val16++;
-			input_ptr = (uint8_t *) p_val16;
+	return output;
+}
 
-			if (DEBUG)
-				printf("encoded size in bytes = %d\n", encoded_buffer_size);
+static compressed_array
+compress_owned(uint64_t elem_count, uint8_t precision, uint8_t accuracy, void *input)
+{
+ac_context *ctx;
+uint8_t *output;
 
-			p_val16 = (uint16_t *) encoded_buffer;
-			*p_val16 = batch_size;
+	ctx = ac_context_create();
+	if (ctx == NULL)
+		return NULL;
 
-			encoded_buffer_size = encoded_buffer_size - 2;
+	output = (uint8_t *) context_compress(ctx, elem_count, precision, accuracy, input);
+	output = take_result(&ctx->compressed, output, get_compressed_length((compressed_array) output));
+	ac_context_free(ctx);
 
-			memcpy(encoded_buffer + 2, input_ptr, encoded_buffer_size);
-			input_ptr += (encoded_buffer_size);
+	return (compressed_array) output;
+}
 
-			status = uint8_decode(encode_key, batch_size, encoded_buffer, decoded_buffer);
-			if (status == (-1))
-				return NULL;
-		}
+compressed_array
+compress_float(uint64_t elem_count, uint8_t accuracy, float *input)
+{
+	return(compress_owned(elem_count, PRECISION_SINGLE, accuracy, input));
+}
 
-		unbucketize(batch_size, decoded_buffer, (uint8_t *)output_ptr, min, precision, accuracy);
+compressed_array
+compress_double(uint64_t elem_count, uint8_t accuracy, double *input)
+{
+	return(compress_owned(elem_count, PRECISION_DOUBLE, accuracy, input));
+}
 
-		if (precision == PRECISION_SINGLE)
-			batch_size_in_bytes = batch_size * sizeof(float);
-		else // PRECISION_DOUBLE
-			batch_size_in_bytes = batch_size * sizeof(double);
+compressed_array
+compress_half(uint64_t elem_count, uint8_t accuracy, uint16_t *input)
+{
+	return(compress_owned(elem_count, PRECISION_HALF, accuracy, input));
+}
 
-		output_ptr += batch_size_in_bytes;
-	}
+compressed_array
+compress_bfloat16(uint64_t elem_count, uint8_t accuracy, uint16_t *input)
+{
+	return(compress_owned(elem_count, PRECISION_BFLOAT16, accuracy, input));
+}
 
-	// The size specified in the encoded buffer should match
-	// the number of elements found during decoding
-	if (total_size == elem_count) {
-		if (precision == PRECISION_SINGLE)
-			output_size = elem_count * sizeof(float);
-		else // PRECISION_DOUBLE
-			output_size = elem_count * sizeof(double);
+uint8_t *
+decompress_float(compressed_array input)
+{
+ac_context *ctx;
+uint8_t *output;
 
+	ctx = ac_context_create();
+	if (ctx == NULL)
+		return NULL;
 
-		output = malloc(output_size + sizeof(uint32_t));
-		// Quit if can not allocate memory
-		if (output == NULL)
-			return NULL;
+	output = ac_decompress(ctx, input);
+	if (output != NULL)
+		output = take_result(&ctx->decompressed, output, sizeof(uint32_t) + *(uint32_t *) output);
+	ac_context_free(ctx);
 
-		// Copy the size followed by the float array
-		p_val32 = (uint32_t *) output;
-		*p_val32 = output_size;
-		memcpy(output + sizeof(uint32_t), uncompressed_buffer, output_size);
+	return output;
+}
 
-		return output;
-	} else
-		// Some thing went wrong
-		if (DEBUG)
-			printf("mismatch in total_size (%d) and elem_count (%d)\n", total_size, elem_count);
+// Decompresses to numbers of the precision output_precision, whatever
+// the precision of the original array
+static uint8_t *
+decompress_owned(compressed_array input, uint8_t output_precision)
+{
+uint8_t *output;
+uint64_t output_size;
+uint64_t elem_count;
+
+	elem_count = get_element_count(input);
+
+	// The size of the uncompressed array must fit in its first four bytes
+	output_size = (uint64_t) elem_count * precision_size(output_precision);
+	if (output_size > UINT32_MAX - sizeof(uint32_t))
+		return NULL;
+
+	output = malloc(sizeof(uint32_t) + output_size);
+	if (output == NULL)
+		return NULL;
+
+	if (decompress_into(NULL, input, output_precision, output + sizeof(uint32_t), elem_count) != 0) {
+		free(output);
 		return NULL;
+	}
 
+	*(uint32_t *) output = output_size;
+
+	return output;
 }
 
-compressed_array
-compress_float(uint32_t elem_count, uint8_t accuracy, float *input)
+// Same as decompress_float, except that the numbers are always returned
+// in double precision, whatever the precision of the original array
+uint8_t *
+decompress_double(compressed_array input)
 {
-	return(approximate_compress(elem_count, PRECISION_SINGLE, accuracy, input));
+	return(decompress_owned(input, PRECISION_DOUBLE));
 }
 
-compressed_array
-compress_double(uint32_t elem_count, uint8_t accuracy, double *input)
+// Same as decompress_double, the numbers are returned as half precision
+// or bfloat16 numbers
+uint8_t *
+decompress_half(compressed_array input)
+{
+	return(decompress_owned(input, PRECISION_HALF));
+}
+
+uint8_t *
+decompress_bfloat16(compressed_array input)
 {
-float *input2;
+	return(decompress_owned(input, PRECISION_BFLOAT16));
+}
 
-	input2 = malloc(elem_count * sizeof(float));
-	if (input2 == NULL)
-		return NULL;
+// Returns the largest possible size in bytes of the compressed array
+// of elem_count numbers. The output buffer given to the compressor must
+// be at least this large. Unencoded numbers of half precision and bfloat16
+// arrays are stored in single precision. The bound includes the index of
+// the batches, whether the array has one or not, and the room left
+// between chunks by the parallel compressor
+size_t
+compress_bound(uint64_t elem_count, uint8_t precision)
+{
+size_t value_size;
 
-	for (int i = 0; i < elem_count; i++) {
-		input2[i] = (float) input[i];
-	}
+	value_size = precision_size(precision);
+	if (value_size < sizeof(float))
+		value_size = sizeof(float);
 
-	// RESOLVE: Free input2
-	return (approximate_compress(elem_count, PRECISION_DOUBLE, accuracy, input2));
+	return HEADER_SIZE + elem_count * (sizeof(uint16_t) + value_size) 
+		+ (elem_count / INDEX_INTERVAL + elem_count / CHUNK_SIZE + 1) * INDEX_ENTRY_SIZE + sizeof(uint64_t) 
+		+ (elem_count / CHUNK_SIZE + 1) * BOUND_SLACK;
 }
 
-uint32_t
+// Size in bytes of the compressed array, read from the header only
+uint64_t
 get_compressed_length(compressed_array c)
 {
-uint32_t *p;
-
-	p = (uint32_t *) c;
+array_header header;
 
-    if (p == NULL)
+	if (read_header(c, &header) != 0)
 		return 0;
 
-    return(*p);
+	return header.size;
 }
 
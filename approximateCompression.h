@@ -1,12 +1,168 @@
 
+#define PRECISION_HALF		1
+#define PRECISION_SINGLE	2
+#define PRECISION_DOUBLE	3
+#define PRECISION_BFLOAT16	4
+
 #define ACCURACY_HALF_PERCENT		1
 #define ACCURACY_QUARTER_PERCENT	2
 #define ACCURACY_ONE_TENTH_PERCENT	3
 
 typedef struct compressed_array_structure *compressed_array;
 
-compressed_array compress_float(uint32_t elem_count, uint8_t accuracy, float *input);
-compressed_array compress_double(uint32_t elem_count, uint8_t accuracy, double *input);
+// Element counts and sizes of compressed arrays are 64 bit. The functions
+// below that return the length N followed by N bytes fail if N does not
+// fit in 32 bits, use the functions that decompress to caller provided
+// buffers for larger arrays
+
+compressed_array compress_float(uint64_t elem_count, uint8_t accuracy, float *input);
+compressed_array compress_double(uint64_t elem_count, uint8_t accuracy, double *input);
 uint8_t * decompress_float(compressed_array  input);
 uint8_t * decompress_double(compressed_array  input);
-uint32_t get_compressed_length(compressed_array c);
+
+// IEEE half precision and bfloat16 numbers are passed as their 16 bit
+// patterns. The decompressors return the length N followed by N bytes
+// of 16 bit numbers, whatever the precision of the original array. The
+// rounding to the 16 bit format adds up to 0.05% (half precision) or
+// 0.4% (bfloat16) to the error
+compressed_array compress_half(uint64_t elem_count, uint8_t accuracy, uint16_t *input);
+compressed_array compress_bfloat16(uint64_t elem_count, uint8_t accuracy, uint16_t *input);
+uint8_t * decompress_half(compressed_array  input);
+uint8_t * decompress_bfloat16(compressed_array  input);
+uint64_t get_compressed_length(compressed_array c);
+
+// Largest possible size of the compressed array of elem_count numbers
+size_t compress_bound(uint64_t elem_count, uint8_t precision);
+
+// Header queries, so that the output of the decompressor can be allocated
+// before decoding. The size does not include the 4 byte length returned by
+// decompress_float
+uint64_t get_element_count(compressed_array c);
+
+size_t get_decompressed_size(compressed_array c);
+
+// A context owns reusable scratch memory, so that compressing many
+// arrays does no allocation once the arenas have grown to size. The
+// result of a call is kept in the context and remains valid until
+// the next call of the same kind using the same context
+typedef struct ac_context ac_context;
+
+ac_context *ac_context_create(void);
+void ac_context_free(ac_context *ctx);
+compressed_array ac_compress_float(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, float *input);
+compressed_array ac_compress_double(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, double *input);
+compressed_array ac_compress_half(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, uint16_t *input);
+compressed_array ac_compress_bfloat16(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, uint16_t *input);
+uint8_t * ac_decompress(ac_context *ctx, compressed_array input);
+
+// Arrays compressed using a context with the index enabled end with an
+// index of their batches, which costs 16 bytes per 1024 or more elements
+void ac_context_set_index(ac_context *ctx, int enable);
+
+// The encoded batches of arrays compressed using a context with checkpoints
+// have a checkpoint every interval elements, rounded down to a power of two
+// from 16 to 2^20. A checkpoint costs 5 bytes, 17 in batches with zeros,
+// and allows get_element to decode at most interval elements of a batch.
+// 0 disables the checkpoints
+void ac_context_set_checkpoints(ac_context *ctx, uint32_t interval);
+
+// Arrays compressed using a context with more than one thread are split in
+// chunks of 256K elements, which are compressed in parallel. The chunks are
+// found through the index of the batches, which such arrays always have.
+// Large arrays decompressed using such a context are decoded in parallel,
+// using the index if they have one
+void ac_context_set_threads(ac_context *ctx, int thread_count);
+
+// Compress to or decompress from caller provided buffers. ctx may be NULL.
+// The compressors return the number of bytes written, 0 in case of error
+// or if output_capacity is too small. Passing compress_bound bytes avoids
+// a copy. The decompressors write get_element_count numbers to output,
+// which has space for output_count numbers, and return 0 on success,
+// -1 in case of error
+size_t ac_compress_float_into(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, float *input, uint8_t *output, size_t output_capacity);
+size_t ac_compress_double_into(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, double *input, uint8_t *output, size_t output_capacity);
+int ac_decompress_float_into(ac_context *ctx, compressed_array input, float *output, uint64_t output_count);
+int ac_decompress_double_into(ac_context *ctx, compressed_array input, double *output, uint64_t output_count);
+size_t ac_compress_half_into(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, uint16_t *input, uint8_t *output, size_t output_capacity);
+size_t ac_compress_bfloat16_into(ac_context *ctx, uint64_t elem_count, uint8_t accuracy, uint16_t *input, uint8_t *output, size_t output_capacity);
+int ac_decompress_half_into(ac_context *ctx, compressed_array input, uint16_t *output, uint64_t output_count);
+int ac_decompress_bfloat16_into(ac_context *ctx, compressed_array input, uint16_t *output, uint64_t output_count);
+
+// Decompress the count numbers starting with element start to a caller
+// provided array. Only the batches that hold these numbers are decoded.
+// The batches before them are skipped, reading their sizes only, from the
+// index entry before element start if the array has an index, otherwise
+// from the first batch. ctx may be NULL. Returns 0 on success, -1 in case
+// of error
+int ac_decompress_range_float(ac_context *ctx, compressed_array input, uint64_t start, uint64_t count, float *output);
+int ac_decompress_range_double(ac_context *ctx, compressed_array input, uint64_t start, uint64_t count, double *output);
+int ac_decompress_range_half(ac_context *ctx, compressed_array input, uint64_t start, uint64_t count, uint16_t *output);
+int ac_decompress_range_bfloat16(ac_context *ctx, compressed_array input, uint64_t start, uint64_t count, uint16_t *output);
+
+// Sets value to element i of the compressed array, as decompress_double
+// returns it. Returns 0 on success, -1 in case of error. The lookup is
+// fastest for arrays compressed with an index and checkpoints, see
+// ac_context_set_index and ac_context_set_checkpoints
+int get_element(compressed_array c, uint64_t i, double *value);
+
+// Append count numbers to a compressed array of the same precision without
+// decompressing it. The numbers are compressed into new batches, or join the
+// last batch if it is small and they fit within its bounds. The numbers of a
+// double precision array must not need wide values unless the array has
+// them, and an array without negative numbers takes no negative numbers,
+// unless the array is empty.
+// Only the end of the array is read and written, from its last index entry
+// on. Arrays that are appended to always have an index, the first append to
+// an array without one reads all its batches. ctx may be NULL
+//
+// ac_append_* append to an array with space for capacity bytes, which is
+// enough if it is compress_bound of the new number of elements. They return
+// the new size of the array, 0 in case of error or if capacity is too small,
+// in which case the array is left as it was. ac_append_fd_* append to the
+// array at the start of the file fd, opened for reading and writing. They
+// return 0 on success, -1 in case of error. The file is left inconsistent
+// if the append fails after writing has started
+size_t ac_append_float(ac_context *ctx, compressed_array array, size_t capacity, uint64_t count, float *input);
+size_t ac_append_double(ac_context *ctx, compressed_array array, size_t capacity, uint64_t count, double *input);
+size_t ac_append_half(ac_context *ctx, compressed_array array, size_t capacity, uint64_t count, uint16_t *input);
+size_t ac_append_bfloat16(ac_context *ctx, compressed_array array, size_t capacity, uint64_t count, uint16_t *input);
+int ac_append_fd_float(ac_context *ctx, int fd, uint64_t count, float *input);
+int ac_append_fd_double(ac_context *ctx, int fd, uint64_t count, double *input);
+int ac_append_fd_half(ac_context *ctx, int fd, uint64_t count, uint16_t *input);
+int ac_append_fd_bfloat16(ac_context *ctx, int fd, uint64_t count, uint16_t *input);
+
+// A stream compresses numbers as they arrive, in memory bounded by its frame
+// size. The numbers pushed to a stream of the precision are compressed in
+// frames of frame_size numbers (65536 if 0), each frame being a complete
+// compressed array. A frame is passed to write, which returns 0 on success,
+// or kept until taken with ac_stream_output if write is NULL. The frames of
+// a stream follow each other, get_compressed_length of a frame tells where
+// the next one starts. ctx may be NULL, otherwise its options apply to the
+// frames. ac_stream_flush writes out the numbers pushed so far as a shorter
+// frame. The functions return 0 on success, -1 in case of error
+typedef struct ac_stream ac_stream;
+typedef int (*ac_stream_write)(void *opaque, uint8_t *data, size_t size);
+
+ac_stream *ac_stream_init(ac_context *ctx, uint8_t precision, uint8_t accuracy, uint64_t frame_size, 
+		ac_stream_write write, void *opaque);
+int ac_stream_push(ac_stream *stream, void *values, uint64_t count);
+int ac_stream_flush(ac_stream *stream);
+int ac_stream_finish(ac_stream *stream);
+uint8_t *ac_stream_output(ac_stream *stream, size_t *size);
+void ac_stream_free(ac_stream *stream);
+
+// A reader decodes compressed arrays, or the frames of a stream, one after
+// the other as their bytes arrive from a buffer, a file descriptor or a
+// read function. read writes up to size bytes to data and returns their
+// number, 0 at the end of the input, -1 in case of error. ac_reader_next
+// writes the next count numbers to output in output_precision and returns
+// their number, less than count only at the end of the input, -1 in case
+// of error. A reader keeps about one batch of the input and of the output
+typedef struct ac_reader ac_reader;
+typedef int64_t (*ac_reader_read)(void *opaque, uint8_t *data, size_t size);
+
+ac_reader *ac_reader_init_buffer(uint8_t *data, size_t size, uint8_t output_precision);
+ac_reader *ac_reader_init_fd(int fd, uint8_t output_precision);
+ac_reader *ac_reader_init(ac_reader_read read, void *opaque, uint8_t output_precision);
+int64_t ac_reader_next(ac_reader *reader, void *output, uint64_t count);
+void ac_reader_free(ac_reader *reader);
@@ -2,6 +2,7 @@
 #define PRECISION_HALF		1
 #define PRECISION_SINGLE	2
 #define PRECISION_DOUBLE	3
+#define PRECISION_BFLOAT16	4
 
 #define ACCURACY_HALF_PERCENT		1
 #define ACCURACY_QUARTER_PERCENT	2
@@ -9,3 +10,21 @@
 
 typedef struct compressed_array_structure *compressed_array;
 
+typedef struct ac_context ac_context;
+
+ac_context *ac_context_create(void);
+void ac_context_free(ac_context *ctx);
+void ac_context_set_index(ac_context *ctx, int enable);
+void ac_context_set_checkpoints(ac_context *ctx, uint32_t interval);
+size_t compress_bound(uint64_t elem_count, uint8_t precision);
+uint64_t get_compressed_length(compressed_array c);
+
+typedef struct ac_stream ac_stream;
+typedef int (*ac_stream_write)(void *opaque, uint8_t *data, size_t size);
+
+typedef struct ac_reader ac_reader;
+typedef int64_t (*ac_reader_read)(void *opaque, uint8_t *data, size_t size);
+
+// Same as the ac_compress_*_into functions, ctx must not be NULL
+size_t context_compress_into(ac_context *ctx, uint64_t elem_count, uint8_t precision, uint8_t accuracy, void *input, 
+		uint8_t *output, size_t output_capacity);
@@ -161,6 +161,124 @@ uint64_t n;
 	return bit_count;
 }
 
+// Starts writing at the first bit of bit_array
+void
+bit_writer_init(bit_writer *bw, uint8_t *bit_array)
+{
+	bw->start = bit_array;
+	bw->ptr = bit_array;
+	bw->acc = 0;
+	bw->acc_bits = 0;
+}
+
+// Stores the bits left in the accumulator, the unused bits of the last
+// byte are set to zero. Returns the number of bytes written
+uint32_t
+bit_writer_finish(bit_writer *bw)
+{
+	for (int i = 0; i < bw->acc_bits; i += 8) {
+		*bw->ptr++ = (uint8_t) bw->acc;
+		bw->acc = bw->acc >> 8;
+	}
+
+	bw->acc = 0;
+	bw->acc_bits = 0;
+
+	return (bw->ptr - bw->start);
+}
+
+// Starts reading at the first bit of bit_array, which contains byte_count bytes
+void
+bit_reader_init(bit_reader *br, uint8_t *bit_array, uint32_t byte_count)
+{
+	br->start = bit_array;
+	br->ptr = bit_array;
+	br->end = bit_array + byte_count;
+	br->buf = 0;
+	br->buf_bits = 0;
+}
+
+// Refill one byte at a time near the end of the array, the bytes past
+// the end are read as zero. Keeps ptr moving so that bit_reader_position
+// reports reads beyond the end
+void
+bit_reader_refill_tail(bit_reader *br)
+{
+uint64_t byte;
+
+	while (br->buf_bits <= BIT_READER_MIN_BITS) {
+		byte = (br->ptr < br->end) ? *br->ptr : 0;
+		br->buf |= byte << br->buf_bits;
+		br->buf_bits += 8;
+		br->ptr++;
+	}
+}
+
+// A varint holds an unsigned number in 7 bits per byte, low bits first.
+// The top bit of a byte is set if another byte follows. Returns the
+// number of bytes of the varint of val
+uint32_t
+varint_size(uint64_t val)
+{
+uint32_t size;
+
+	for (size = 1; val >= 0x80; size++)
+		val >>= 7;
+
+	return size;
+}
+
+// Writes the varint of val at ptr, returns the position after it
+uint8_t *
+put_varint(uint8_t *ptr, uint64_t val)
+{
+	while (val >= 0x80) {
+		*ptr++ = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	*ptr++ = val;
+
+	return ptr;
+}
+
+// Writes the varint of val at ptr in exactly size bytes, which must be at
+// least varint_size(val). The bytes that are not needed hold 0 with the
+// top bit set, get_varint reads the value as usual. Returns the position
+// after it
+uint8_t *
+put_varint_padded(uint8_t *ptr, uint64_t val, uint32_t size)
+{
+	for (uint32_t i = 1; i < size; i++) {
+		*ptr++ = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	*ptr++ = val;
+
+	return ptr;
+}
+
+// Reads a varint at ptr, which must not go past end. Returns the position
+// after it, NULL if the varint goes past end or is longer than 64 bits
+uint8_t *
+get_varint(uint8_t *ptr, uint8_t *end, uint64_t *val)
+{
+uint64_t n;
+
+	n = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (ptr >= end)
+			return NULL;
+
+		n |= (uint64_t) (*ptr & 0x7f) << shift;
+		if ((*ptr++ & 0x80) == 0) {
+			*val = n;
+			return ptr;
+		}
+	}
+
+	return NULL;
+}
+
 // Useful for debugging
 void
 print_bits_from_byte(uint8_t this_byte)
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 /* Function declarations */
 
@@ -12,3 +13,114 @@ int cnt_0_bits_from_byte(uint8_t this_byte);
 int write_bitstream(uint8_t *bit_array, int bit_pos, int bit_count, uint64_t val);
 int read_bitstream(uint8_t *bit_array, int bit_pos, int bit_count, uint64_t *ptr_val);
 void print_bits_from_byte(uint8_t this_byte);
+uint32_t varint_size(uint64_t val);
+uint8_t *put_varint(uint8_t *ptr, uint64_t val);
+uint8_t *put_varint_padded(uint8_t *ptr, uint64_t val, uint32_t size);
+uint8_t *get_varint(uint8_t *ptr, uint8_t *end, uint64_t *val);
+
+// A bit writer appends codes to a byte array using the same bit order
+// as write_bitstream (bit 0 of a code goes first). Codes are collected
+// in a 64 bit accumulator which is stored 8 bytes at a time, instead of
+// a read-modify-write of a byte for every bit
+typedef struct {
+	uint8_t *start;
+	uint8_t *ptr;
+	uint64_t acc;
+	int acc_bits;
+} bit_writer;
+
+void bit_writer_init(bit_writer *bw, uint8_t *bit_array);
+uint32_t bit_writer_finish(bit_writer *bw);
+
+// Appends the low bit_count bits of val, bit_count must not exceed 32 and
+// the bits of val above bit_count must be zero
+static inline void
+bit_writer_put(bit_writer *bw, uint64_t val, int bit_count)
+{
+	bw->acc |= val << bw->acc_bits;
+	bw->acc_bits += bit_count;
+
+	if (bw->acc_bits >= 64) {
+		memcpy(bw->ptr, &bw->acc, sizeof(uint64_t));
+		bw->ptr += sizeof(uint64_t);
+		bw->acc_bits -= 64;
+		// Bits of val that did not fit in the accumulator
+		bw->acc = (bw->acc_bits == 0) ? 0 : val >> (bit_count - bw->acc_bits);
+	}
+}
+
+// Number of bits written so far
+static inline uint64_t
+bit_writer_position(bit_writer *bw)
+{
+	return (uint64_t) (bw->ptr - bw->start) * 8 + bw->acc_bits;
+}
+
+// A bit reader returns the bits of a byte array in the order written by
+// write_bitstream and the bit writer. Up to 64 bits are kept in buf, bit 0
+// being the next bit of the stream. A refill tops buf up to at least 56
+// bits with a single unaligned 8 byte load, without any branch
+typedef struct {
+	uint8_t *start;
+	uint8_t *ptr;
+	uint8_t *end;
+	uint64_t buf;
+	int buf_bits;
+} bit_reader;
+
+#define BIT_READER_MIN_BITS 56
+
+void bit_reader_init(bit_reader *br, uint8_t *bit_array, uint32_t byte_count);
+void bit_reader_refill_tail(bit_reader *br);
+
+// The fast refill is allowed as long as 8 bytes are left in the array
+static inline int
+bit_reader_can_refill_fast(bit_reader *br)
+{
+	return (br->end - br->ptr >= 8);
+}
+
+// Refill without bounds check, see bit_reader_can_refill_fast
+static inline void
+bit_reader_refill_fast(bit_reader *br)
+{
+uint64_t word;
+
+	memcpy(&word, br->ptr, sizeof(uint64_t));
+	br->buf |= word << br->buf_bits;
+	br->ptr += (63 - br->buf_bits) >> 3;
+	br->buf_bits |= BIT_READER_MIN_BITS;
+}
+
+// Refill that reads bytes beyond the end of the array as zero
+static inline void
+bit_reader_refill(bit_reader *br)
+{
+	if (bit_reader_can_refill_fast(br))
+		bit_reader_refill_fast(br);
+	else
+		bit_reader_refill_tail(br);
+}
+
+// Returns the next bit_count bits without consuming them, bit_count
+// must not exceed the number of bits available since the last refill
+static inline uint64_t
+bit_reader_peek(bit_reader *br, int bit_count)
+{
+	return br->buf & ((1ULL << bit_count) - 1);
+}
+
+static inline void
+bit_reader_consume(bit_reader *br, int bit_count)
+{
+	br->buf >>= bit_count;
+	br->buf_bits -= bit_count;
+}
+
+// Number of bits consumed so far. A value larger than 8 times the byte
+// count means the reader ran past the end of the array
+static inline uint64_t
+bit_reader_position(bit_reader *br)
+{
+	return (uint64_t) (br->ptr - br->start) * 8 - br->buf_bits;
+}
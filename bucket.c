@@ -3,11 +3,19 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "bitUtils.h"
 #include "bucket.h"
 #include "bucketArray.h"
+#include "uint8.h"
 #include "approximateCompression_internal.h"
+#include "cpuFeatures.h"
+#include "halfFloat.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
 
 #define DEBUG 0
 
@@ -22,38 +30,153 @@
 // floating point number, there is an error, the maximum
 // error is half the width of the bucket
 
+// Returns the bucket array for the accuracy and its number of buckets
+static float *
+get_bucket_arr(uint8_t accuracy, uint8_t *max_bucket)
+{
+	if (accuracy == ACCURACY_HALF_PERCENT) {
+		*max_bucket = sizeof(bucket_arr1) / sizeof(float);
+		return bucket_arr1;
+	} else if (accuracy == ACCURACY_QUARTER_PERCENT) {
+		*max_bucket = sizeof(bucket_arr2) / sizeof(float);
+		return bucket_arr2;
+	} else {
+		*max_bucket = sizeof(bucket_arr3) / sizeof(float);
+		return bucket_arr3;
+	}
+}
+
+// A value in the range 1.0 .. 2.0 has a fixed exponent, the top
+// QUANTIZER_BITS bits of its mantissa tell which of the QUANTIZER_SIZE
+// equal parts of the range it belongs to. Each part is narrower than
+// the narrowest bucket (0.00397 for ACCURACY_ONE_TENTH_PERCENT), so at
+// most one bucket boundary falls within a part. bucket_index gives the
+// bucket of the lowest value of each part, any other value of the part
+// belongs to the same bucket or the next one. The entries are 32 bit
+// so that the SIMD kernels can gather them
+#define QUANTIZER_BITS 9
+#define QUANTIZER_SIZE (1 << QUANTIZER_BITS)
+#define FLOAT_MANTISSA_BITS 23
+
+static int32_t bucket_index[ACCURACY_ONE_TENTH_PERCENT + 1][QUANTIZER_SIZE];
+static pthread_once_t bucket_index_once = PTHREAD_ONCE_INIT;
+
+static void
+build_bucket_index(uint8_t accuracy)
+{
+uint8_t bucket;
+uint8_t max_bucket;
+float *bucket_arr;
+float lowest;
+
+	bucket_arr = get_bucket_arr(accuracy, &max_bucket);
+
+	bucket = 0;
+	for (int i = 0; i < QUANTIZER_SIZE; i++) {
+		lowest = 1.0 + (float) i / QUANTIZER_SIZE;
+		while (lowest >= bucket_arr[bucket])
+			bucket++;
+
+		bucket_index[accuracy][i] = bucket;
+	}
+}
+
+// The indexes of the bucket arrays are built once, on first use by any
+// thread
+static void
+build_bucket_indexes(void)
+{
+	build_bucket_index(ACCURACY_HALF_PERCENT);
+	build_bucket_index(ACCURACY_QUARTER_PERCENT);
+	build_bucket_index(ACCURACY_ONE_TENTH_PERCENT);
+}
+
 // The function value_to_bucket takes as input a floating point
-// in the range 1.0 .. 2.0 and returns the bucket number
+// in the range 1.0 .. 2.0 and returns the bucket number, that
+// is the first bucket whose upper bound is larger than the value
+// 0.0 has a bucket of its own, ZERO_BUCKET
 uint8_t
 value_to_bucket(float value, uint8_t accuracy)
 {
 uint8_t bucket;
 uint8_t max_bucket;
 float *bucket_arr;
+uint32_t bits;
 
-	if (accuracy == ACCURACY_HALF_PERCENT) {
-		bucket_arr = bucket_arr1;
-		max_bucket = sizeof(bucket_arr1) / sizeof(float);
-	} else if (accuracy == ACCURACY_QUARTER_PERCENT) {
-		bucket_arr = bucket_arr2;
-		max_bucket = sizeof(bucket_arr2) / sizeof(float);
-	} else {
-		bucket_arr = bucket_arr3;
-		max_bucket = sizeof(bucket_arr3) / sizeof(float);
+	// Same choice of bucket array as get_bucket_arr
+	if (accuracy != ACCURACY_HALF_PERCENT && accuracy != ACCURACY_QUARTER_PERCENT)
+		accuracy = ACCURACY_ONE_TENTH_PERCENT;
+
+	bucket_arr = get_bucket_arr(accuracy, &max_bucket);
+
+	if (value == 0.0)
+		return ZERO_BUCKET;
+
+	if (value < 1.0)
+		return 0;
+
+	if (!(value < 2.0)) {
+		if (DEBUG)
+			printf("Internal error at file %s line %d: input value out of range %f\n", __FILE__, __LINE__, value); 
+
+		return INVALID_BUCKET;
 	}
 
-//	RESOLVE: Use binary search
+	pthread_once(&bucket_index_once, build_bucket_indexes);
+
+	memcpy(&bits, &value, sizeof(float));
+	bucket = bucket_index[accuracy][(bits >> (FLOAT_MANTISSA_BITS - QUANTIZER_BITS)) & (QUANTIZER_SIZE - 1)];
+
+	// The value may be above the only boundary within its part
+	if (value >= bucket_arr[bucket])
+		bucket++;
+
+	return bucket;
+}
+
+// Mid point of every bucket, for each accuracy. The tables have 256
+// entries so that any uint8_t bucket number can be looked up without a
+// range check, the entries past the last bucket are zero, which is the
+// mid point of ZERO_BUCKET
+static float midpoint_table[ACCURACY_ONE_TENTH_PERCENT + 1][256];
+static pthread_once_t midpoint_table_once = PTHREAD_ONCE_INIT;
+
+static void
+build_midpoint_table(uint8_t accuracy)
+{
+uint8_t max_bucket;
+float *bucket_arr;
+float prev;
+float next;
 
-	for (bucket = 0; bucket < max_bucket; bucket++){
+	bucket_arr = get_bucket_arr(accuracy, &max_bucket);
 
-		if (value < bucket_arr[bucket])
-			return bucket;
+	for (int bucket = 0; bucket < max_bucket; bucket++) {
+		prev = (bucket == 0) ? 1.0 : bucket_arr[bucket - 1];
+		next = bucket_arr[bucket];
+		midpoint_table[accuracy][bucket] = (prev + next) / 2.0;
 	}
 
-	if (DEBUG)
-		printf("Internal error at file %s line %d: input value out of range %f\n", __FILE__, __LINE__, value); 
+	midpoint_table[accuracy][ZERO_BUCKET] = 0.0;
+}
+
+static void
+build_midpoint_tables(void)
+{
+	build_midpoint_table(ACCURACY_HALF_PERCENT);
+	build_midpoint_table(ACCURACY_QUARTER_PERCENT);
+	build_midpoint_table(ACCURACY_ONE_TENTH_PERCENT);
+}
+
+static float *
+get_midpoint_table(uint8_t accuracy)
+{
+	if (accuracy != ACCURACY_HALF_PERCENT && accuracy != ACCURACY_QUARTER_PERCENT)
+		accuracy = ACCURACY_ONE_TENTH_PERCENT;
+
+	pthread_once(&midpoint_table_once, build_midpoint_tables);
 
-	return INVALID_BUCKET;
+	return midpoint_table[accuracy];
 }
 
 // The function bucket_to_value takes as input a bucket number 
@@ -61,50 +184,341 @@ float *bucket_arr;
 float
 bucket_to_value(uint8_t bucket, uint8_t accuracy)
 {
-float prev;
-float next;
-float average;
-float *bucket_arr;
+	return get_midpoint_table(accuracy)[bucket];
+}
 
-	if (accuracy == ACCURACY_HALF_PERCENT)
-		bucket_arr = bucket_arr1;
-	else if (accuracy == ACCURACY_QUARTER_PERCENT)
-		bucket_arr = bucket_arr2;
-	else 
-		bucket_arr = bucket_arr3;
+// The bucketize kernels divide each element by min, clamp values at or
+// above 2.0 to the last bucket and quantize as value_to_bucket does, 0.0
+// goes to ZERO_BUCKET. The SIMD kernels use the same division and
+// comparisons as the scalar one, so all kernels produce identical bucket
+// numbers. A kernel returns 0 on success and -1 if an element other than
+// 0.0 is below min (or is not a number). The kernels are in
+// bucketKernels.h, for float, double, half and bfloat16 elements
 
-	if (bucket == 0) {
-		prev = 1.0;
-		next = bucket_arr[0];
-	}
-	else {
-		prev = bucket_arr[bucket - 1];
-		next = bucket_arr[bucket];
+// Largest float below 2.0, it belongs to the last bucket
+#define BELOW_TWO 0x1.fffffep0
+
+#define QUANTIZER_SHIFT (FLOAT_MANTISSA_BITS - QUANTIZER_BITS)
+
+// The magnitudes of the numbers are bucketized, the signs are stored
+// apart. Single precision numbers are divided in single precision. Double
+// precision numbers are divided in double precision and the ratio,
+// which is in the range 1.0 .. 2.0, is then rounded to single precision.
+// Half precision and bfloat16 numbers are converted to single precision
+// as they are loaded and then divided like single precision numbers
+
+#define ELEM float
+#define VALUE float
+#define ELEM_NAME(name) name##_float
+#define AVX2_TARGET "avx2"
+#define HAS_AVX2() cpu_has_avx2()
+
+static inline float
+ratio_float(float *input, float min)
+{
+	return fabsf(*input) / min;
+}
+
+#if HAVE_X86_SIMD
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128
+ratio_sse41_float(float *input, float min)
+{
+	return _mm_div_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_loadu_ps(input)), _mm_set1_ps(min));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256
+ratio_avx2_float(float *input, float min)
+{
+	return _mm256_div_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_loadu_ps(input)), _mm256_set1_ps(min));
+}
+
+__attribute__((target("avx512f"), always_inline))
+static inline __m512
+ratio_avx512_float(float *input, float min)
+{
+	return _mm512_div_ps(_mm512_abs_ps(_mm512_loadu_ps(input)), _mm512_set1_ps(min));
+}
+#endif
+
+#include "bucketKernels.h"
+
+#undef ELEM
+#undef VALUE
+#undef ELEM_NAME
+
+#define ELEM double
+#define VALUE double
+#define ELEM_NAME(name) name##_double
+
+static inline float
+ratio_double(double *input, double min)
+{
+	return fabs(*input) / min;
+}
+
+#if HAVE_X86_SIMD
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128
+ratio_sse41_double(double *input, double min)
+{
+__m128d divisor;
+
+__m128d sign;
+
+	divisor = _mm_set1_pd(min);
+	sign = _mm_set1_pd(-0.0);
+	return _mm_movelh_ps(_mm_cvtpd_ps(_mm_div_pd(_mm_andnot_pd(sign, _mm_loadu_pd(input)), divisor)),
+			_mm_cvtpd_ps(_mm_div_pd(_mm_andnot_pd(sign, _mm_loadu_pd(input + 2)), divisor)));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256
+ratio_avx2_double(double *input, double min)
+{
+__m256d divisor;
+__m256d sign;
+
+	divisor = _mm256_set1_pd(min);
+	sign = _mm256_set1_pd(-0.0);
+	return _mm256_set_m128(_mm256_cvtpd_ps(_mm256_div_pd(_mm256_andnot_pd(sign, _mm256_loadu_pd(input + 4)), divisor)),
+			_mm256_cvtpd_ps(_mm256_div_pd(_mm256_andnot_pd(sign, _mm256_loadu_pd(input)), divisor)));
+}
+
+__attribute__((target("avx512f"), always_inline))
+static inline __m512
+ratio_avx512_double(double *input, double min)
+{
+__m512d divisor;
+__m512d low;
+
+	divisor = _mm512_set1_pd(min);
+	low = _mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(_mm512_div_pd(_mm512_abs_pd(_mm512_loadu_pd(input)), divisor))));
+	return _mm512_castpd_ps(_mm512_insertf64x4(low, 
+			_mm256_castps_pd(_mm512_cvtpd_ps(_mm512_div_pd(_mm512_abs_pd(_mm512_loadu_pd(input + 8)), divisor))), 1));
+}
+#endif
+
+#include "bucketKernels.h"
+
+#undef ELEM
+#undef VALUE
+#undef ELEM_NAME
+#undef AVX2_TARGET
+#undef HAS_AVX2
+
+#define ELEM uint16_t
+#define VALUE float
+#define ELEM_NAME(name) name##_half
+#define AVX2_TARGET "avx2,f16c"
+#define HAS_AVX2() (cpu_has_avx2() && cpu_has_f16c())
+
+static inline float
+ratio_half(uint16_t *input, float min)
+{
+	return half_to_float(*input & 0x7fff) / min;
+}
+
+#if HAVE_X86_SIMD
+// F16C is not available to the SSE4.1 kernel, the 4 numbers are converted
+// one at a time
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128
+ratio_sse41_half(uint16_t *input, float min)
+{
+	return _mm_div_ps(_mm_setr_ps(half_to_float(input[0] & 0x7fff), half_to_float(input[1] & 0x7fff), 
+				half_to_float(input[2] & 0x7fff), half_to_float(input[3] & 0x7fff)), _mm_set1_ps(min));
+}
+
+__attribute__((target("avx2,f16c"), always_inline))
+static inline __m256
+ratio_avx2_half(uint16_t *input, float min)
+{
+__m128i bits;
+
+	bits = _mm_and_si128(_mm_loadu_si128((__m128i *) input), _mm_set1_epi16(0x7fff));
+	return _mm256_div_ps(_mm256_cvtph_ps(bits), _mm256_set1_ps(min));
+}
+
+__attribute__((target("avx512f"), always_inline))
+static inline __m512
+ratio_avx512_half(uint16_t *input, float min)
+{
+__m256i bits;
+
+	bits = _mm256_and_si256(_mm256_loadu_si256((__m256i *) input), _mm256_set1_epi16(0x7fff));
+	return _mm512_div_ps(_mm512_cvtph_ps(bits), _mm512_set1_ps(min));
+}
+#endif
+
+#include "bucketKernels.h"
+
+#undef ELEM_NAME
+#undef AVX2_TARGET
+#undef HAS_AVX2
+
+#define ELEM_NAME(name) name##_bfloat16
+#define AVX2_TARGET "avx2"
+#define HAS_AVX2() cpu_has_avx2()
+
+static inline float
+ratio_bfloat16(uint16_t *input, float min)
+{
+	return bfloat16_to_float(*input & 0x7fff) / min;
+}
+
+#if HAVE_X86_SIMD
+// A bfloat16 number is the top half of a single precision number
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128
+ratio_sse41_bfloat16(uint16_t *input, float min)
+{
+__m128i bits;
+
+	bits = _mm_and_si128(_mm_loadl_epi64((__m128i *) input), _mm_set1_epi16(0x7fff));
+	bits = _mm_slli_epi32(_mm_cvtepu16_epi32(bits), 16);
+	return _mm_div_ps(_mm_castsi128_ps(bits), _mm_set1_ps(min));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256
+ratio_avx2_bfloat16(uint16_t *input, float min)
+{
+__m128i packed;
+__m256i bits;
+
+	packed = _mm_and_si128(_mm_loadu_si128((__m128i *) input), _mm_set1_epi16(0x7fff));
+	bits = _mm256_slli_epi32(_mm256_cvtepu16_epi32(packed), 16);
+	return _mm256_div_ps(_mm256_castsi256_ps(bits), _mm256_set1_ps(min));
+}
+
+__attribute__((target("avx512f"), always_inline))
+static inline __m512
+ratio_avx512_bfloat16(uint16_t *input, float min)
+{
+__m256i packed;
+__m512i bits;
+
+	packed = _mm256_and_si256(_mm256_loadu_si256((__m256i *) input), _mm256_set1_epi16(0x7fff));
+	bits = _mm512_slli_epi32(_mm512_cvtepu16_epi32(packed), 16);
+	return _mm512_div_ps(_mm512_castsi512_ps(bits), _mm512_set1_ps(min));
+}
+#endif
+
+#include "bucketKernels.h"
+
+#undef ELEM
+#undef VALUE
+#undef ELEM_NAME
+#undef AVX2_TARGET
+#undef HAS_AVX2
+
+// Checks the bounds of a batch and chooses the bucket array and the
+// index for the accuracy. Returns 0 on success, -1 in case of error
+static int
+bucketize_prepare(double max, double min, uint8_t *accuracy, float **bucket_arr)
+{
+uint8_t max_bucket;
+
+	// Sanity check
+	if (max > (2.0 * min)) {
+		if (DEBUG)
+			printf("Internal error at file %s line %d: input of bucketize out of range\t",  __FILE__, __LINE__);
+		return (-1);
 	}
 
-	average = (prev + next) / 2.0;
-    return(average);
+	if (*accuracy != ACCURACY_HALF_PERCENT && *accuracy != ACCURACY_QUARTER_PERCENT)
+		*accuracy = ACCURACY_ONE_TENTH_PERCENT;
+
+	pthread_once(&bucket_index_once, build_bucket_indexes);
+
+	*bucket_arr = get_bucket_arr(*accuracy, &max_bucket);
+
+	return 0;
 }
 
-// The function bucketize converts a floating point array
+// The function bucketize_into converts a floating point array
 // to an integer array, where each element represents the
 // bucket number. The input array can contain numbers in 
 // any range but the maximum number can not be larger than
 // 2.0 * minimum number. THe elements of the array are
 // mapped into the range 1.0 .. 2.0 by dividing with minimum
-// and then converted using function value_to_bucket
-// The parameter precision is ignored for now
-uint8_t *
-bucketize(uint32_t batch_size, float *input, float max, float min, uint8_t precision, uint8_t accuracy)
+// and then converted the same way as function value_to_bucket
+// The bucket numbers are written to bucketized_array, provided
+// by the caller. Returns 0 on success, -1 in case of error
+int
+bucketize_into(uint32_t batch_size, float *input, float max, float min, uint8_t accuracy, uint8_t *bucketized_array)
 {
-uint8_t bucket;
-uint8_t *bucketized_array;
-float val;
+float *bucket_arr;
 float val2;
 float val3;
 float err_percent;
 
-	// RESOLVE: Print bucket delta statistics
+	if (bucketize_prepare(max, min, &accuracy, &bucket_arr) != 0)
+		return (-1);
+
+	if (get_bucketize_kernel_float()(batch_size, input, min, bucket_index[accuracy], bucket_arr, bucketized_array) != 0)
+		return (-1);
+
+	if (DEBUG) {
+		for (int i = 0; i < batch_size; i++) {
+			val2 = bucket_to_value(bucketized_array[i], accuracy);
+			val3 = val2 * min;
+			err_percent = fabs(((val3 - input[i]) * 100.0) / input[i]);
+
+			printf("input[%d] = %.9f\t bucket = %d\tcompressed value = %.9f\terr_percent = %.9f\%\n", 
+					i, input[i], bucketized_array[i], val3, err_percent);
+		}
+	}
+
+	return 0;
+}
+
+// Same as bucketize_into for double precision numbers
+int
+bucketize_double_into(uint32_t batch_size, double *input, double max, double min, uint8_t accuracy, uint8_t *bucketized_array)
+{
+float *bucket_arr;
+
+	if (bucketize_prepare(max, min, &accuracy, &bucket_arr) != 0)
+		return (-1);
+
+	return get_bucketize_kernel_double()(batch_size, input, min, bucket_index[accuracy], bucket_arr, bucketized_array);
+}
+
+// Same as bucketize_into for half precision numbers
+int
+bucketize_half_into(uint32_t batch_size, uint16_t *input, float max, float min, uint8_t accuracy, uint8_t *bucketized_array)
+{
+float *bucket_arr;
+
+	if (bucketize_prepare(max, min, &accuracy, &bucket_arr) != 0)
+		return (-1);
+
+	return get_bucketize_kernel_half()(batch_size, input, min, bucket_index[accuracy], bucket_arr, bucketized_array);
+}
+
+// Same as bucketize_into for bfloat16 numbers
+int
+bucketize_bfloat16_into(uint32_t batch_size, uint16_t *input, float max, float min, uint8_t accuracy, uint8_t *bucketized_array)
+{
+float *bucket_arr;
+
+	if (bucketize_prepare(max, min, &accuracy, &bucket_arr) != 0)
+		return (-1);
+
+	return get_bucketize_kernel_bfloat16()(batch_size, input, min, bucket_index[accuracy], bucket_arr, bucketized_array);
+}
+
+// The function bucketize is same as bucketize_into, except that
+// the bucket numbers are returned in an array allocated by this 
+// function. The caller must free it. Returns NULL in case of error
+// The parameter precision is ignored for now
+uint8_t *
+bucketize(uint32_t batch_size, float *input, float max, float min, uint8_t precision, uint8_t accuracy)
+{
+uint8_t *bucketized_array;
 
 	bucketized_array = malloc(batch_size * sizeof(uint8_t));
 	if (bucketized_array == NULL) {
@@ -113,130 +527,422 @@ float err_percent;
 		return NULL;
 	}
 
-	// Sanity check
-	if (max > (2.0 * min)) {
-		if (DEBUG)
-			printf("Internal error at file %s line %d: input of bucketize out of range\t",  __FILE__, __LINE__);
+	if (bucketize_into(batch_size, input, max, min, accuracy, bucketized_array) != 0) {
+		free(bucketized_array);
 		return NULL;
 	}
 
-	for (int i = 0; i < batch_size; i++) {
+	return bucketized_array;
+}
 
-		val = input[i] / min;
-		if (val >= 2.0) {
-			val = 1.99999999;
-		}
+// Reconstruction of a batch is a lookup of the mid point of each bucket
+// scaled by the minimum of the batch. The AVX2 kernels gather the mid
+// points of 8 buckets at a time. The multiplication is always done in
+// single precision, so all kernels produce identical results
 
-		if (val < 1.0) {
-			if (DEBUG) {
-				printf("Internal error at file %s line %d: input of bucketize out of range\t",  __FILE__, __LINE__);
-				printf("i = %d, val = %f, input = %f, min = %f\t", i, val, input[i], min);
-			}
-			return NULL;
-		}
+static void
+unbucketize_float_scalar(uint32_t length, uint8_t *bucket_array, float *output, float min, float *midpoint)
+{
+	for (uint32_t i = 0; i < length; i++)
+		output[i] = midpoint[bucket_array[i]] * min;
+}
 
-		bucket = value_to_bucket(val, accuracy);
-		if (bucket == INVALID_BUCKET)
-			return NULL;
+static void
+unbucketize_double_scalar(uint32_t length, uint8_t *bucket_array, double *output, float min, float *midpoint)
+{
+float val;
 
-		bucketized_array[i] = bucket;
+	for (uint32_t i = 0; i < length; i++) {
+		val = midpoint[bucket_array[i]] * min;
+		output[i] = (double) val;
+	}
+}
 
-		if (DEBUG) {
-			val2 = bucket_to_value(bucket, accuracy);
-			val3 = val2 * min;
-			err_percent = fabs(((val3 - input[i]) * 100.0) / input[i]);
+#if HAVE_X86_SIMD
+__attribute__((target("avx2")))
+static void
+unbucketize_float_avx2(uint32_t length, uint8_t *bucket_array, float *output, float min, float *midpoint)
+{
+__m256 scale;
+__m256i index;
+__m256 val;
+uint32_t i;
 
-			printf("input[%d] = %.9f\t bucket = %d\tcompressed value = %.9f\terr_percent = %.9f\%\n", 
-					i, bucket, input[i], val3, err_percent);
-		}
+	scale = _mm256_set1_ps(min);
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *) (bucket_array + i)));
+		val = _mm256_i32gather_ps(midpoint, index, sizeof(float));
+		_mm256_storeu_ps(output + i, _mm256_mul_ps(val, scale));
 	}
 
-	return bucketized_array;
+	unbucketize_float_scalar(length - i, bucket_array + i, output + i, min, midpoint);
+}
+
+__attribute__((target("avx2")))
+static void
+unbucketize_double_avx2(uint32_t length, uint8_t *bucket_array, double *output, float min, float *midpoint)
+{
+__m256 scale;
+__m256i index;
+__m256 val;
+uint32_t i;
+
+	scale = _mm256_set1_ps(min);
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *) (bucket_array + i)));
+		val = _mm256_mul_ps(_mm256_i32gather_ps(midpoint, index, sizeof(float)), scale);
+		_mm256_storeu_pd(output + i, _mm256_cvtps_pd(_mm256_castps256_ps128(val)));
+		_mm256_storeu_pd(output + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(val, 1)));
+	}
+
+	unbucketize_double_scalar(length - i, bucket_array + i, output + i, min, midpoint);
+}
+#endif
+
+// Half precision and bfloat16 output is rounded to the nearest number of
+// the format, numbers beyond its range are set to its largest number. The
+// rounding adds up to half a unit in the last place of the format to the
+// error, 0.05% for half precision and 0.4% for bfloat16
+
+static void
+unbucketize_half_scalar(uint32_t length, uint8_t *bucket_array, uint16_t *output, float min, float *midpoint)
+{
+float val;
+
+	for (uint32_t i = 0; i < length; i++) {
+		val = midpoint[bucket_array[i]] * min;
+		if (val > HALF_MAX)
+			val = HALF_MAX;
+		output[i] = float_to_half(val);
+	}
 }
 
+static void
+unbucketize_bfloat16_scalar(uint32_t length, uint8_t *bucket_array, uint16_t *output, float min, float *midpoint)
+{
+float val;
+
+	for (uint32_t i = 0; i < length; i++) {
+		val = midpoint[bucket_array[i]] * min;
+		if (val > BFLOAT16_MAX)
+			val = BFLOAT16_MAX;
+		output[i] = float_to_bfloat16(val);
+	}
+}
+
+#if HAVE_X86_SIMD
+// The limit is the first operand of the minimum, so that a lane which is
+// not a number stays so, as in the scalar kernel
+__attribute__((target("avx2,f16c")))
+static void
+unbucketize_half_avx2(uint32_t length, uint8_t *bucket_array, uint16_t *output, float min, float *midpoint)
+{
+__m256 scale;
+__m256 limit;
+__m256i index;
+__m256 val;
+uint32_t i;
+
+	scale = _mm256_set1_ps(min);
+	limit = _mm256_set1_ps(HALF_MAX);
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *) (bucket_array + i)));
+		val = _mm256_mul_ps(_mm256_i32gather_ps(midpoint, index, sizeof(float)), scale);
+		val = _mm256_min_ps(limit, val);
+		_mm_storeu_si128((__m128i *) (output + i), _mm256_cvtps_ph(val, _MM_FROUND_TO_NEAREST_INT));
+	}
+
+	unbucketize_half_scalar(length - i, bucket_array + i, output + i, min, midpoint);
+}
+
+// Rounds to nearest even by adding 0x7fff plus the lowest kept bit, as
+// float_to_bfloat16 does, numbers which are not a number are made quiet
+__attribute__((target("avx2")))
+static void
+unbucketize_bfloat16_avx2(uint32_t length, uint8_t *bucket_array, uint16_t *output, float min, float *midpoint)
+{
+__m256 scale;
+__m256 limit;
+__m256i index;
+__m256 val;
+__m256i bits;
+__m256i rounded;
+__m256i quiet;
+__m128i packed;
+uint32_t i;
+
+	scale = _mm256_set1_ps(min);
+	limit = _mm256_set1_ps(BFLOAT16_MAX);
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *) (bucket_array + i)));
+		val = _mm256_mul_ps(_mm256_i32gather_ps(midpoint, index, sizeof(float)), scale);
+		val = _mm256_min_ps(limit, val);
+
+		bits = _mm256_castps_si256(val);
+		rounded = _mm256_add_epi32(bits, _mm256_set1_epi32(0x7fff));
+		rounded = _mm256_add_epi32(rounded, _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1)));
+		rounded = _mm256_srli_epi32(rounded, 16);
+		quiet = _mm256_or_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(0x40));
+		rounded = _mm256_blendv_epi8(rounded, quiet, _mm256_castps_si256(_mm256_cmp_ps(val, val, _CMP_UNORD_Q)));
+
+		packed = _mm_packus_epi32(_mm256_castsi256_si128(rounded), _mm256_extracti128_si256(rounded, 1));
+		_mm_storeu_si128((__m128i *) (output + i), packed);
+	}
+
+	unbucketize_bfloat16_scalar(length - i, bucket_array + i, output + i, min, midpoint);
+}
+#endif
+
 // The function unbucketize converts an array of bucket numbers (uint8_t)
-// to single or double precision floating point array. A bucket number is
+// to a single, double or half precision or bfloat16 floating point array. A bucket number is
 // mapped into the mid point of a bucket. There are multiple buckets defined
 // in bucketArray.h, with various degrees of accuracy, one of them is chosen
 // based on the input parameter accuracy. 
 void
 unbucketize(uint32_t length, uint8_t *bucket_array, uint8_t *float_or_double_array, float min, uint8_t precision, uint8_t accuracy)
 {
-float val;
-float *p_float;
-double *p_double;
+float *midpoint;
+int use_avx2;
 
 	if (DEBUG)
 		printf("unbucketize: precision = %d, accuracy = %d\n", precision, accuracy);
 
-	if (precision == PRECISION_SINGLE)
-		p_float = (float *) float_or_double_array;
+	midpoint = get_midpoint_table(accuracy);
+	use_avx2 = HAVE_X86_SIMD && cpu_has_avx2();
+
+	if (precision == PRECISION_SINGLE) {
+#if HAVE_X86_SIMD
+		if (use_avx2) {
+			unbucketize_float_avx2(length, bucket_array, (float *) float_or_double_array, min, midpoint);
+			return;
+		}
+#endif
+		unbucketize_float_scalar(length, bucket_array, (float *) float_or_double_array, min, midpoint);
+	} else if (precision == PRECISION_DOUBLE) {
+#if HAVE_X86_SIMD
+		if (use_avx2) {
+			unbucketize_double_avx2(length, bucket_array, (double *) float_or_double_array, min, midpoint);
+			return;
+		}
+#endif
+		unbucketize_double_scalar(length, bucket_array, (double *) float_or_double_array, min, midpoint);
+	} else if (precision == PRECISION_HALF) {
+#if HAVE_X86_SIMD
+		if (use_avx2 && cpu_has_f16c()) {
+			unbucketize_half_avx2(length, bucket_array, (uint16_t *) float_or_double_array, min, midpoint);
+			return;
+		}
+#endif
+		unbucketize_half_scalar(length, bucket_array, (uint16_t *) float_or_double_array, min, midpoint);
+	} else if (precision == PRECISION_BFLOAT16) {
+#if HAVE_X86_SIMD
+		if (use_avx2) {
+			unbucketize_bfloat16_avx2(length, bucket_array, (uint16_t *) float_or_double_array, min, midpoint);
+			return;
+		}
+#endif
+		unbucketize_bfloat16_scalar(length, bucket_array, (uint16_t *) float_or_double_array, min, midpoint);
+	}
+}
+
+// Batches of double precision numbers have a double precision minimum,
+// the mid points are scaled in double precision. The AVX2 kernels gather
+// the mid points of 4 buckets at a time and give the same results as the
+// scalar kernels
 
-	if (precision == PRECISION_DOUBLE)
-		p_double = (double *) float_or_double_array;
+static void
+unbucketize_wide_double_scalar(uint32_t length, uint8_t *bucket_array, double *output, double min, float *midpoint)
+{
+	for (uint32_t i = 0; i < length; i++)
+		output[i] = midpoint[bucket_array[i]] * min;
+}
 
-	for (int i = 0; i < length; i++) {
-		val = bucket_to_value(bucket_array[i], accuracy) * min;
+static void
+unbucketize_wide_float_scalar(uint32_t length, uint8_t *bucket_array, float *output, double min, float *midpoint)
+{
+	for (uint32_t i = 0; i < length; i++)
+		output[i] = (float) (midpoint[bucket_array[i]] * min);
+}
 
-		if (precision == PRECISION_SINGLE) {
-			p_float[i] = val;
+// Numbers of a double precision batch are far beyond the range of the
+// 16 bit formats, they are set to the largest number of the format
+static void
+unbucketize_wide_16_scalar(uint32_t length, uint8_t *bucket_array, uint16_t *output, double min, uint8_t precision, float *midpoint)
+{
+double val;
 
-			if (DEBUG)
-				printf("%d\t%.9f\n", bucket_array[i], val);
-		} else if (precision == PRECISION_DOUBLE) {
-			p_double[i] = (double) val;
+	for (uint32_t i = 0; i < length; i++) {
+		val = midpoint[bucket_array[i]] * min;
+		if (precision == PRECISION_HALF)
+			output[i] = float_to_half((val > HALF_MAX) ? HALF_MAX : val);
+		else
+			output[i] = float_to_bfloat16((val > BFLOAT16_MAX) ? BFLOAT16_MAX : val);
+	}
+}
 
-			if (DEBUG)
-				printf("%d\t%lf\n", bucket_array[i], p_double[i]);
-		}
+#if HAVE_X86_SIMD
+__attribute__((target("avx2")))
+static void
+unbucketize_wide_double_avx2(uint32_t length, uint8_t *bucket_array, double *output, double min, float *midpoint)
+{
+__m256d scale;
+__m128i index;
+__m256d val;
+uint32_t i;
+
+	scale = _mm256_set1_pd(min);
+
+	for (i = 0; i + 4 <= length; i += 4) {
+		index = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(int32_t *) (bucket_array + i)));
+		val = _mm256_cvtps_pd(_mm_i32gather_ps(midpoint, index, sizeof(float)));
+		_mm256_storeu_pd(output + i, _mm256_mul_pd(val, scale));
+	}
+
+	unbucketize_wide_double_scalar(length - i, bucket_array + i, output + i, min, midpoint);
+}
+
+__attribute__((target("avx2")))
+static void
+unbucketize_wide_float_avx2(uint32_t length, uint8_t *bucket_array, float *output, double min, float *midpoint)
+{
+__m256d scale;
+__m128i index;
+__m256d val;
+uint32_t i;
+
+	scale = _mm256_set1_pd(min);
+
+	for (i = 0; i + 4 <= length; i += 4) {
+		index = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(int32_t *) (bucket_array + i)));
+		val = _mm256_cvtps_pd(_mm_i32gather_ps(midpoint, index, sizeof(float)));
+		_mm_storeu_ps(output + i, _mm256_cvtpd_ps(_mm256_mul_pd(val, scale)));
 	}
+
+	unbucketize_wide_float_scalar(length - i, bucket_array + i, output + i, min, midpoint);
 }
+#endif
+
+// Same as unbucketize, for batches with a double precision minimum
+void
+unbucketize_wide(uint32_t length, uint8_t *bucket_array, uint8_t *float_or_double_array, double min, uint8_t precision, uint8_t accuracy)
+{
+float *midpoint;
+int use_avx2;
+
+	midpoint = get_midpoint_table(accuracy);
+	use_avx2 = HAVE_X86_SIMD && cpu_has_avx2();
 
-// If two successive numbers are more than DELTA_HIGH, no encoding is done
-// Numbers are simply copied
-#define DELTA_HIGH 26
+	if (precision == PRECISION_SINGLE) {
+#if HAVE_X86_SIMD
+		if (use_avx2) {
+			unbucketize_wide_float_avx2(length, bucket_array, (float *) float_or_double_array, min, midpoint);
+			return;
+		}
+#endif
+		unbucketize_wide_float_scalar(length, bucket_array, (float *) float_or_double_array, min, midpoint);
+	} else if (precision == PRECISION_DOUBLE) {
+#if HAVE_X86_SIMD
+		if (use_avx2) {
+			unbucketize_wide_double_avx2(length, bucket_array, (double *) float_or_double_array, min, midpoint);
+			return;
+		}
+#endif
+		unbucketize_wide_double_scalar(length, bucket_array, (double *) float_or_double_array, min, midpoint);
+	} else if (precision == PRECISION_HALF || precision == PRECISION_BFLOAT16)
+		unbucketize_wide_16_scalar(length, bucket_array, (uint16_t *) float_or_double_array, min, precision, midpoint);
+}
+
+// The delta statistics used to choose the encode key can be collected
+// in parts, so that the compressor can count the deltas of a few thousand
+// buckets right after they are bucketized, while they are still in cache
+void
+bucket_stats_init(delta_stats *stats)
+{
+	memset(stats, 0, sizeof(delta_stats));
+	stats->prev = -1;
+}
+
+// Counts the deltas between successive buckets of buf, leaving out the
+// zero buckets, which are counted apart. The parts of a batch are
+// collected in order, the first delta of a part is taken with respect
+// to the last bucket of the previous parts
+void
+bucket_stats_collect(delta_stats *stats, uint32_t len, uint8_t *buf)
+{
+int n;
+
+	// Once a delta is out of range, no encoding is done
+	if (stats->out_of_range)
+		return;
+
+	for (uint32_t i = 0; i < len; i++) {
+		if (buf[i] == ZERO_BUCKET) {
+			stats->zero_count++;
+			continue;
+		}
+
+		if (stats->prev < 0) {
+			stats->prev = buf[i];
+			continue;
+		}
+
+		n = buf[i] - stats->prev;
+		stats->prev = buf[i];
+
+		if (n == 0)
+			stats->delta_zero++;
+		else if (n > 0 && n <= DELTA_HIGH)
+			stats->delta_plus[n]++;
+		else if (n < 0 && n >= -DELTA_HIGH)
+			stats->delta_minus[-n]++;
+		else {
+			if (DEBUG) {
+				printf("bucket_analyze: Out of range delta = %d at position %d, ", n, i);
+				printf("encode key = 0\n");
+			}
+			stats->out_of_range = 1;
+			return;
+		}
+	}
+}
 
 // Bucket values are compressed using a delta approach, that is a number
 // is represented as delta with respect to the previous value. The delta
 // is encoded using variable number of bits. One of about 20 encoding
 // schemes are considered and one of them is chosen by this function
 uint8_t
-bucket_analyze(uint16_t len, uint8_t *buf)
+bucket_analyze(uint32_t len, uint8_t *buf)
+{
+delta_stats stats;
+
+	bucket_stats_init(&stats);
+	bucket_stats_collect(&stats, len, buf);
+
+	return bucket_choose_key(&stats);
+}
+
+// Chooses the encode key from the delta statistics
+uint8_t
+bucket_choose_key(delta_stats *stats)
 {
-int n;
-int abs_n;
 int retval;
 int delta_zero;
-int delta_plus[DELTA_HIGH + 1];
-int delta_minus[DELTA_HIGH + 1];
+int *delta_plus;
+int *delta_minus;
 int max_delta_plus;
 int max_delta_minus;
 int max_delta;
 
-	delta_zero = 0;
-	for (int i = 0; i < DELTA_HIGH + 1; i++) {
-		delta_plus[i] = 0;
-		delta_minus[i] = 0;
-	}
+	if (stats->out_of_range)
+		return 0;
 
-	for (int i = 1; i < len; i++) {
-		n = buf[i] - buf[i - 1];
-		abs_n = abs(n);
-		if (abs_n > DELTA_HIGH) {
-			if (DEBUG) {
-				printf("bucket_analyze: Out of range delta = %d at position %d, ", n, i);
-				printf("encode key = 0\n");
-			}
-			return 0;
-		}
-
-		if (n == 0)
-			delta_zero++;
-		else if (n > 0)
-			delta_plus[abs_n]++;
-		else
-			delta_minus[abs_n]++;
-	}
+	delta_zero = stats->delta_zero;
+	delta_plus = stats->delta_plus;
+	delta_minus = stats->delta_minus;
 
 	// Find highest +ve delta
 	max_delta_plus = 0;
@@ -384,6 +1090,10 @@ int max_delta;
 			retval = 18;
 	}
 
+	// The zero buckets are encoded apart from the deltas
+	if (retval != 0 && stats->zero_count > 0)
+		retval |= ENCODE_KEY_ZEROS;
+
 	if (DEBUG)
 		printf("encode key = %d\n", retval);
 
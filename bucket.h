@@ -1,7 +1,34 @@
+// If two successive numbers are more than DELTA_HIGH, no encoding is done
+// Numbers are simply copied
+#define DELTA_HIGH 26
+
+// Bucket number of 0.0 within a batch, it is above the buckets of every
+// accuracy and its mid point is 0.0. Deltas are taken between the other
+// buckets, see uint8.c for how the zero buckets of a batch are encoded
+#define ZERO_BUCKET 254
+
+// Delta statistics of a bucketized batch, used to choose the encode key
+typedef struct {
+	int delta_zero;
+	int delta_plus[DELTA_HIGH + 1];
+	int delta_minus[DELTA_HIGH + 1];
+	int out_of_range;
+	int zero_count;		// Number of zero buckets
+	int prev;		// Last bucket which is not a zero bucket, -1 if none
+} delta_stats;
+
 
 uint8_t value_to_bucket(float value, uint8_t accuracy);
 float bucket_to_value(uint8_t bucke, uint8_t accuracyt);
+int bucketize_into(uint32_t batch_size, float *input, float max, float min, uint8_t accuracy, uint8_t *bucketized_array);
+int bucketize_double_into(uint32_t batch_size, double *input, double max, double min, uint8_t accuracy, uint8_t *bucketized_array);
+int bucketize_half_into(uint32_t batch_size, uint16_t *input, float max, float min, uint8_t accuracy, uint8_t *bucketized_array);
+int bucketize_bfloat16_into(uint32_t batch_size, uint16_t *input, float max, float min, uint8_t accuracy, uint8_t *bucketized_array);
 uint8_t *bucketize(uint32_t batch_size, float *input, float max, float min, uint8_t precision, uint8_t accuracy);
 void unbucketize(uint32_t length, uint8_t *bucket_array, uint8_t *float_array, float min, uint8_t precision, uint8_t accuracy);
-uint8_t bucket_analyze(uint16_t len, uint8_t *buf);
+void unbucketize_wide(uint32_t length, uint8_t *bucket_array, uint8_t *float_or_double_array, double min, uint8_t precision, uint8_t accuracy);
+uint8_t bucket_analyze(uint32_t len, uint8_t *buf);
+void bucket_stats_init(delta_stats *stats);
+void bucket_stats_collect(delta_stats *stats, uint32_t len, uint8_t *buf);
+uint8_t bucket_choose_key(delta_stats *stats);
 
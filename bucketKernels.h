@@ -0,0 +1,213 @@
+// Bucketize kernels for one element type. This file has no include guard,
+// bucket.c includes it once for each element type (float, double, half
+// and bfloat16), after defining
+//	ELEM		the element type as stored
+//	VALUE		the type of the minimum of a batch
+//	ELEM_NAME(name)	the name of a function for this element type
+//	AVX2_TARGET	the target attribute of the AVX2 kernel
+//	HAS_AVX2()	1 if the processor can run the AVX2 kernel
+// and the functions ELEM_NAME(ratio), ELEM_NAME(ratio_sse41),
+// ELEM_NAME(ratio_avx2) and ELEM_NAME(ratio_avx512), which return 1, 4,
+// 8 or 16 elements divided by min as single precision numbers. All
+// kernels quantize the single precision ratios the same way, so the
+// SIMD kernels produce the same bucket numbers as the scalar one
+
+static int
+ELEM_NAME(bucketize_scalar)(uint32_t batch_size, ELEM *input, VALUE min, int32_t *index, float *bucket_arr, uint8_t *bucketized_array)
+{
+float val;
+uint32_t bits;
+int32_t bucket;
+
+	for (uint32_t i = 0; i < batch_size; i++) {
+		val = ELEM_NAME(ratio)(input + i, min);
+		if (val >= 2.0)
+			val = BELOW_TWO;
+
+		if (val == 0.0) {
+			bucketized_array[i] = ZERO_BUCKET;
+			continue;
+		}
+
+		if (!(val >= 1.0)) {
+			if (DEBUG) {
+				printf("Internal error at file %s line %d: input of bucketize out of range\t",  __FILE__, __LINE__);
+				printf("i = %d, val = %f, min = %f\n", i, val, (double) min);
+			}
+			return (-1);
+		}
+
+		memcpy(&bits, &val, sizeof(float));
+		bucket = index[(bits >> QUANTIZER_SHIFT) & (QUANTIZER_SIZE - 1)];
+		if (val >= bucket_arr[bucket])
+			bucket++;
+
+		bucketized_array[i] = bucket;
+	}
+
+	return 0;
+}
+
+#if HAVE_X86_SIMD
+// SSE4.1 has no gather, the table lookups of the 4 lanes are scalar
+__attribute__((target("sse4.1")))
+static int
+ELEM_NAME(bucketize_sse41)(uint32_t batch_size, ELEM *input, VALUE min, int32_t *index, float *bucket_arr, uint8_t *bucketized_array)
+{
+__m128 zero;
+__m128 one;
+__m128 two;
+__m128 below_two;
+__m128 val;
+__m128 bound;
+__m128 zero_lanes;
+__m128i part;
+__m128i bucket;
+__m128i packed;
+uint32_t i;
+int32_t bytes;
+
+	zero = _mm_setzero_ps();
+	one = _mm_set1_ps(1.0);
+	two = _mm_set1_ps(2.0);
+	below_two = _mm_set1_ps(BELOW_TWO);
+
+	for (i = 0; i + 4 <= batch_size; i += 4) {
+		val = ELEM_NAME(ratio_sse41)(input + i, min);
+		val = _mm_blendv_ps(val, below_two, _mm_cmpge_ps(val, two));
+		zero_lanes = _mm_cmpeq_ps(val, zero);
+		if (_mm_movemask_ps(_mm_andnot_ps(zero_lanes, _mm_cmpnge_ps(val, one))))
+			return (-1);
+
+		part = _mm_srli_epi32(_mm_castps_si128(val), QUANTIZER_SHIFT);
+		part = _mm_and_si128(part, _mm_set1_epi32(QUANTIZER_SIZE - 1));
+		bucket = _mm_setr_epi32(index[_mm_extract_epi32(part, 0)], index[_mm_extract_epi32(part, 1)],
+				index[_mm_extract_epi32(part, 2)], index[_mm_extract_epi32(part, 3)]);
+		bound = _mm_setr_ps(bucket_arr[_mm_extract_epi32(bucket, 0)], bucket_arr[_mm_extract_epi32(bucket, 1)],
+				bucket_arr[_mm_extract_epi32(bucket, 2)], bucket_arr[_mm_extract_epi32(bucket, 3)]);
+
+		// The comparison is all ones (-1) where the value is above the boundary
+		bucket = _mm_sub_epi32(bucket, _mm_castps_si128(_mm_cmpge_ps(val, bound)));
+		bucket = _mm_blendv_epi8(bucket, _mm_set1_epi32(ZERO_BUCKET), _mm_castps_si128(zero_lanes));
+
+		packed = _mm_packus_epi32(bucket, bucket);
+		packed = _mm_packus_epi16(packed, packed);
+		bytes = _mm_cvtsi128_si32(packed);
+		memcpy(bucketized_array + i, &bytes, sizeof(int32_t));
+	}
+
+	return ELEM_NAME(bucketize_scalar)(batch_size - i, input + i, min, index, bucket_arr, bucketized_array + i);
+}
+
+__attribute__((target(AVX2_TARGET)))
+static int
+ELEM_NAME(bucketize_avx2)(uint32_t batch_size, ELEM *input, VALUE min, int32_t *index, float *bucket_arr, uint8_t *bucketized_array)
+{
+__m256 zero;
+__m256 one;
+__m256 two;
+__m256 below_two;
+__m256 val;
+__m256 bound;
+__m256 zero_lanes;
+__m256i part;
+__m256i bucket;
+__m128i packed;
+uint32_t i;
+
+	zero = _mm256_setzero_ps();
+	one = _mm256_set1_ps(1.0);
+	two = _mm256_set1_ps(2.0);
+	below_two = _mm256_set1_ps(BELOW_TWO);
+
+	for (i = 0; i + 8 <= batch_size; i += 8) {
+		val = ELEM_NAME(ratio_avx2)(input + i, min);
+		val = _mm256_blendv_ps(val, below_two, _mm256_cmp_ps(val, two, _CMP_GE_OQ));
+		zero_lanes = _mm256_cmp_ps(val, zero, _CMP_EQ_OQ);
+		if (_mm256_movemask_ps(_mm256_andnot_ps(zero_lanes, _mm256_cmp_ps(val, one, _CMP_NGE_UQ))))
+			return (-1);
+
+		part = _mm256_srli_epi32(_mm256_castps_si256(val), QUANTIZER_SHIFT);
+		part = _mm256_and_si256(part, _mm256_set1_epi32(QUANTIZER_SIZE - 1));
+		bucket = _mm256_i32gather_epi32((int *) index, part, sizeof(int32_t));
+		bound = _mm256_i32gather_ps(bucket_arr, bucket, sizeof(float));
+		bucket = _mm256_sub_epi32(bucket, _mm256_castps_si256(_mm256_cmp_ps(val, bound, _CMP_GE_OQ)));
+		bucket = _mm256_blendv_epi8(bucket, _mm256_set1_epi32(ZERO_BUCKET), _mm256_castps_si256(zero_lanes));
+
+		packed = _mm_packus_epi32(_mm256_castsi256_si128(bucket), _mm256_extracti128_si256(bucket, 1));
+		packed = _mm_packus_epi16(packed, packed);
+		_mm_storel_epi64((__m128i *) (bucketized_array + i), packed);
+	}
+
+	return ELEM_NAME(bucketize_scalar)(batch_size - i, input + i, min, index, bucket_arr, bucketized_array + i);
+}
+
+__attribute__((target("avx512f")))
+static int
+ELEM_NAME(bucketize_avx512)(uint32_t batch_size, ELEM *input, VALUE min, int32_t *index, float *bucket_arr, uint8_t *bucketized_array)
+{
+__m512 one;
+__m512 two;
+__m512 below_two;
+__m512 val;
+__m512 bound;
+__m512i part;
+__m512i bucket;
+__mmask16 zero_lanes;
+uint32_t i;
+
+	one = _mm512_set1_ps(1.0);
+	two = _mm512_set1_ps(2.0);
+	below_two = _mm512_set1_ps(BELOW_TWO);
+
+	for (i = 0; i + 16 <= batch_size; i += 16) {
+		val = ELEM_NAME(ratio_avx512)(input + i, min);
+		val = _mm512_mask_mov_ps(val, _mm512_cmp_ps_mask(val, two, _CMP_GE_OQ), below_two);
+		zero_lanes = _mm512_cmp_ps_mask(val, _mm512_setzero_ps(), _CMP_EQ_OQ);
+		if (_mm512_cmp_ps_mask(val, one, _CMP_NGE_UQ) & ~zero_lanes)
+			return (-1);
+
+		part = _mm512_srli_epi32(_mm512_castps_si512(val), QUANTIZER_SHIFT);
+		part = _mm512_and_si512(part, _mm512_set1_epi32(QUANTIZER_SIZE - 1));
+		bucket = _mm512_i32gather_epi32(part, index, sizeof(int32_t));
+		bound = _mm512_i32gather_ps(bucket, bucket_arr, sizeof(float));
+		bucket = _mm512_mask_add_epi32(bucket, _mm512_cmp_ps_mask(val, bound, _CMP_GE_OQ), 
+				bucket, _mm512_set1_epi32(1));
+		bucket = _mm512_mask_mov_epi32(bucket, zero_lanes, _mm512_set1_epi32(ZERO_BUCKET));
+
+		_mm_storeu_si128((__m128i *) (bucketized_array + i), _mm512_cvtepi32_epi8(bucket));
+	}
+
+	return ELEM_NAME(bucketize_scalar)(batch_size - i, input + i, min, index, bucket_arr, bucketized_array + i);
+}
+#endif
+
+typedef int (*ELEM_NAME(bucketize_kernel))(uint32_t batch_size, ELEM *input, VALUE min, 
+		int32_t *index, float *bucket_arr, uint8_t *bucketized_array);
+
+static ELEM_NAME(bucketize_kernel) ELEM_NAME(bucketize_kernel_chosen);
+static pthread_once_t ELEM_NAME(bucketize_kernel_once) = PTHREAD_ONCE_INIT;
+
+static void
+ELEM_NAME(choose_bucketize_kernel)(void)
+{
+	ELEM_NAME(bucketize_kernel_chosen) = ELEM_NAME(bucketize_scalar);
+#if HAVE_X86_SIMD
+	if (cpu_has_avx512())
+		ELEM_NAME(bucketize_kernel_chosen) = ELEM_NAME(bucketize_avx512);
+	else if (HAS_AVX2())
+		ELEM_NAME(bucketize_kernel_chosen) = ELEM_NAME(bucketize_avx2);
+	else if (cpu_has_sse41())
+		ELEM_NAME(bucketize_kernel_chosen) = ELEM_NAME(bucketize_sse41);
+#endif
+}
+
+// The widest kernel supported by the processor, chosen once on first use,
+// by whichever thread gets there first
+static ELEM_NAME(bucketize_kernel)
+ELEM_NAME(get_bucketize_kernel)(void)
+{
+	pthread_once(&ELEM_NAME(bucketize_kernel_once), ELEM_NAME(choose_bucketize_kernel));
+
+	return ELEM_NAME(bucketize_kernel_chosen);
+}
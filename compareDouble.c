@@ -18,10 +18,12 @@ double val2;
 double err_percent;
 double err_percent_max;
 double err_percent_total;
-double input[UINT16_MAX];
-double input2[UINT16_MAX];
-uint32_t elem_count;
-uint32_t elem_count2;
+double *input;
+size_t input_capacity;
+double *input2;
+size_t input2_capacity;
+uint64_t elem_count;
+uint64_t elem_count2;
 uint8_t verbose;
 
 	if ((argc < 3) || (argc > 4)) {
@@ -67,28 +69,55 @@ uint8_t verbose;
 	}
 	elem_count = 0;
 
+	input = NULL;
+	input_capacity = 0;
+
+	// The array grows as the file is read, there is no limit
+	// on the size of the file
 	while (fread((void *) &val, sizeof(double), 1, fp1) == 1) {
+		if (elem_count == input_capacity) {
+			input_capacity = (input_capacity == 0) ? 65536 : 2 * input_capacity;
+			input = realloc(input, input_capacity * sizeof(double));
+			if (input == NULL) {
+				fprintf(stderr, "Could not allocate memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
 		input[elem_count++] = val;
 	}
 
 	elem_count2 = 0;
 
+	input2 = NULL;
+	input2_capacity = 0;
+
+	// The array grows as the file is read, there is no limit
+	// on the size of the file
 	while (fread((void *) &val, sizeof(double), 1, fp2) == 1) {
+		if (elem_count2 == input2_capacity) {
+			input2_capacity = (input2_capacity == 0) ? 65536 : 2 * input2_capacity;
+			input2 = realloc(input2, input2_capacity * sizeof(double));
+			if (input2 == NULL) {
+				fprintf(stderr, "Could not allocate memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
 		input2[elem_count2++] = val;
 	}
 
 	if (elem_count != elem_count2) {
-		fprintf(stderr, "Warning!! Size of input files mismatch %d %d\n", elem_count, elem_count2);
+		fprintf(stderr, "Warning!! Size of input files mismatch %llu %llu\n", 
+				(unsigned long long) elem_count, (unsigned long long) elem_count2);
 		if (elem_count2 < elem_count)
 			elem_count = elem_count2;
 	}
 
-	printf("Both files contain %d numbers\n", elem_count);
+	printf("Both files contain %llu numbers\n", (unsigned long long) elem_count);
 
 	err_percent_max = 0.0;
 	err_percent_total = 0.0;
 
-	for (int i = 0; i < elem_count; i++) {
+	for (uint64_t i = 0; i < elem_count; i++) {
 		val1 = input[i];
 		val2 = input2[i];
 		if (val1 == 0.0) {
@@ -96,12 +125,12 @@ uint8_t verbose;
 			val = 0.0;
 			err_percent = 0.0;
 			} else {
-				printf("Mismatch: input[%d] = %.9lf\tcompressed value = %.9lf\n", i, val1, val2);
+				printf("Mismatch: input[%llu] = %.9lf\tcompressed value = %.9lf\n", (unsigned long long) i, val1, val2);
 				continue;
 			}
 		} else {
-			val = fabs(val1 - val2) * 100.0 / val1;
-			err_percent = fabs(val1 - val2) * 100.0 / val1;
+			val = fabs(val1 - val2) * 100.0 / fabs(val1);
+			err_percent = fabs(val1 - val2) * 100.0 / fabs(val1);
 		}
 
 		if (err_percent > err_percent_max)
@@ -109,8 +138,8 @@ uint8_t verbose;
 
 		err_percent_total += err_percent;
 		if (verbose == 1) {
-			printf("input[%d] = %lf\tcompressed value = %lf\terr_percent = %.9f\%\n", i, val1, val2, val);
-			printf("input[%d] = %lf\tcompressed value in hex = 0x%016llx\n", i, val1, (uint64_t) val2);
+			printf("input[%llu] = %lf\tcompressed value = %lf\terr_percent = %.9f\%\n", (unsigned long long) i, val1, val2, val);
+			printf("input[%llu] = %lf\tcompressed value in hex = 0x%016llx\n", (unsigned long long) i, val1, (uint64_t) val2);
 		}
 	}
 
@@ -18,10 +18,12 @@ float val2;
 float err_percent;
 float err_percent_max;
 float err_percent_total;
-float input[UINT16_MAX];
-float input2[UINT16_MAX];
-uint32_t elem_count;
-uint32_t elem_count2;
+float *input;
+size_t input_capacity;
+float *input2;
+size_t input2_capacity;
+uint64_t elem_count;
+uint64_t elem_count2;
 uint8_t verbose;
 
 	if ((argc < 3) || (argc > 4)) {
@@ -67,28 +69,55 @@ uint8_t verbose;
 	}
 	elem_count = 0;
 
+	input = NULL;
+	input_capacity = 0;
+
+	// The array grows as the file is read, there is no limit
+	// on the size of the file
 	while (fread((void *) &val, sizeof(float), 1, fp1) == 1) {
+		if (elem_count == input_capacity) {
+			input_capacity = (input_capacity == 0) ? 65536 : 2 * input_capacity;
+			input = realloc(input, input_capacity * sizeof(float));
+			if (input == NULL) {
+				fprintf(stderr, "Could not allocate memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
 		input[elem_count++] = val;
 	}
 
 	elem_count2 = 0;
 
+	input2 = NULL;
+	input2_capacity = 0;
+
+	// The array grows as the file is read, there is no limit
+	// on the size of the file
 	while (fread((void *) &val, sizeof(float), 1, fp2) == 1) {
+		if (elem_count2 == input2_capacity) {
+			input2_capacity = (input2_capacity == 0) ? 65536 : 2 * input2_capacity;
+			input2 = realloc(input2, input2_capacity * sizeof(float));
+			if (input2 == NULL) {
+				fprintf(stderr, "Could not allocate memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
 		input2[elem_count2++] = val;
 	}
 
 	if (elem_count != elem_count2) {
-		fprintf(stderr, "Warning!! Size of input files mismatch %d %d\n", elem_count, elem_count2);
+		fprintf(stderr, "Warning!! Size of input files mismatch %llu %llu\n", 
+				(unsigned long long) elem_count, (unsigned long long) elem_count2);
 		if (elem_count2 < elem_count)
 			elem_count = elem_count2;
 	}
 
-	printf("Both files contain %d numbers\n", elem_count);
+	printf("Both files contain %llu numbers\n", (unsigned long long) elem_count);
 
 	err_percent_max = 0.0;
 	err_percent_total = 0.0;
 
-	for (int i = 0; i < elem_count; i++) {
+	for (uint64_t i = 0; i < elem_count; i++) {
 		val1 = input[i];
 		val2 = input2[i];
 		if (val1 == 0.0) {
@@ -96,12 +125,12 @@ uint8_t verbose;
 			val = 0.0;
 			err_percent = 0.0;
 			} else {
-				printf("Mismatch: input[%d] = %.9f\tcompressed value = %.9f\n", i, val1, val2);
+				printf("Mismatch: input[%llu] = %.9f\tcompressed value = %.9f\n", (unsigned long long) i, val1, val2);
 				continue;
 			}
 		} else {
-			val = fabs(val1 - val2) * 100.0 / val1;
-			err_percent = fabs(val1 - val2) * 100.0 / val1;
+			val = fabs(val1 - val2) * 100.0 / fabs(val1);
+			err_percent = fabs(val1 - val2) * 100.0 / fabs(val1);
 		}
 
 		if (err_percent > err_percent_max)
@@ -109,7 +138,7 @@ uint8_t verbose;
 
 		err_percent_total += err_percent;
 		if (verbose == 1) {
-			printf("input[%d] = %.9f\tcompressed value = %.9f\terr_percent = %.9f\%\n", i, val1, val2, val);
+			printf("input[%llu] = %.9f\tcompressed value = %.9f\terr_percent = %.9f\%\n", (unsigned long long) i, val1, val2, val);
 		}
 	}
 
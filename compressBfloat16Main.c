@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "approximateCompression.h"
+#include "fileMap.h"
+
+/*
+** This program reads an input file containing bfloat16 floating
+** point numbers (16 bit each) and generates a compressed file using
+** the function compress_bfloat16. The numbers are converted to single precision
+** as they are compressed, the input is never widened in memory. It is
+** a lossy compression with an average error of 0.5%. The maximum error
+** is guaranteed to be below one percent.
+**
+** Command to compile: gcc -std=gnu99 -o compressBfloat16 compressBfloat16Main.c
+**                         approximateCompression.o bitUtils.o bucket.o uint8.o fileMap.o
+** Usage:    ./compressBfloat16 [-L|M|H] [-q] <uncompressed file> <compressed file>
+**           Either file may be -, the standard input or output
+**
+** There is another program decompressBfloat16 to generate approximate
+** version of the original file.
+*/
+
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: compressBfloat16 [-L|M|H] [-q] <bfloat16 file> <compressed binary file>\n");
+	fprintf(stderr, "\t -L : Maximum error < 1%, Average error < 0.5%\n");
+	fprintf(stderr, "\t -M : Maximum error < 0.5%, Average error < 0.25%\n");
+	fprintf(stderr, "\t -H : Maximum error < 0.1%, Average error < 0.05%\n");
+	fprintf(stderr, "\t -q : No messages\n");
+	fprintf(stderr, "\t A file named - is the standard input or output\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+file_map input_map;
+file_map output_map;
+FILE *log;
+char *input_file;
+char *output_file;
+uint8_t accuracy;
+uint64_t elem_count;
+uint64_t output_size;
+int quiet;
+int arg;
+
+	accuracy = ACCURACY_HALF_PERCENT;
+	quiet = 0;
+
+	for (arg = 1; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+		if (strcmp(argv[arg], "-L") == 0) 
+			accuracy = ACCURACY_HALF_PERCENT;
+		else if (strcmp(argv[arg], "-M") == 0)
+			accuracy = ACCURACY_QUARTER_PERCENT;
+		else if (strcmp(argv[arg], "-H") == 0)
+			accuracy = ACCURACY_ONE_TENTH_PERCENT;
+		else if (strcmp(argv[arg], "-q") == 0)
+			quiet = 1;
+		else
+			usage();
+	}
+
+	if (argc - arg != 2)
+		usage();
+
+	input_file = argv[arg];
+	output_file = argv[arg + 1];
+
+	// The messages go to the standard error if the compressed
+	// array goes to the standard output
+	log = NULL;
+	if (!quiet)
+		log = strcmp(output_file, "-") == 0 ? stderr : stdout;
+
+	// The standard input and output are compressed as a stream of
+	// frames, which are written as the numbers arrive
+	if (strcmp(input_file, "-") == 0 || strcmp(output_file, "-") == 0) {
+		if (pipe_compress(input_file, output_file, PRECISION_BFLOAT16, accuracy, &elem_count, &output_size) != 0) {
+			fprintf(stderr, "Compression of %s to %s failed\n", input_file, output_file);
+			exit(EXIT_FAILURE);
+		}
+
+		if (log != NULL)
+			fprintf(log, "Compressed %llu bfloat16 floating point numbers to a stream of %llu bytes\n", 
+					(unsigned long long) elem_count, (unsigned long long) output_size);
+
+		exit(EXIT_SUCCESS);
+	}
+
+	if (file_map_read(&input_map, input_file) != 0) {
+		fprintf(stderr, "Could not open input file %s\n", input_file);
+		exit(EXIT_FAILURE);
+	}
+
+	// The numbers are compressed where they are mapped, a partial
+	// number at the end of the file is ignored
+	elem_count = input_map.size / sizeof(uint16_t);
+
+	if (log != NULL)
+		fprintf(log, "Input file %s has %llu bfloat16 floating point numbers\n", input_file, (unsigned long long) elem_count);
+
+	// The compressed array is written straight to the output file,
+	// which is mapped with room for the largest possible result
+	if (file_map_write(&output_map, output_file, compress_bound(elem_count, PRECISION_BFLOAT16)) != 0) {
+		fprintf(stderr, "Could not open output file %s\n", output_file);
+		exit(EXIT_FAILURE);
+	}
+
+	output_size = ac_compress_bfloat16_into(NULL, elem_count, accuracy, (uint16_t *) input_map.data, output_map.data, 
+			output_map.size);
+	if (output_size == 0) {
+		fprintf(stderr, "Internal error: Compression failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (file_map_close(&output_map, output_size) != 0) {
+		fprintf(stderr, "Internal error: write to output file %s failed\n", output_file); 
+		exit(EXIT_FAILURE);
+	}
+
+	if (log != NULL)
+		fprintf(log, "Sucessfully generated compressed output file %s of size %llu bytes\n", output_file, 
+				(unsigned long long) output_size);
+
+	file_map_close(&input_map, 0);
+
+	exit(EXIT_SUCCESS);
+}
+
@@ -4,9 +4,7 @@
 #include <string.h>
 
 #include "approximateCompression.h"
-
-// For handling larger input files, increase the constant below
-#define MAX_SIZE 65536
+#include "fileMap.h"
 
 /*
 ** This program reads an input file containing floating point
@@ -17,8 +15,9 @@
 ** of the original size
 **
 ** Command to compile: gcc -std=gnu99 -o compressFloat compressFloatMain.c
-**                         approximateCompression.o bitUtils.o bucket.o uint8.o
-** Usage:    ./compressFloat <uncompressed file> <compressed file>
+**                         approximateCompression.o bitUtils.o bucket.o uint8.o fileMap.o
+** Usage:    ./compressFloat [-L|M|H] [-q] <uncompressed file> <compressed file>
+**           Either file may be -, the standard input or output
 **
 ** There is another program uncompressFloat to generate approximate
 ** version of the original file. The accuracy of compression can
@@ -26,100 +25,111 @@
 */
 
 
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: compressFloat [-L|M|H] [-q] <floating point file> <compressed binary file>\n");
+	fprintf(stderr, "\t -L : Maximum error < 1%, Average error < 0.5%\n");
+	fprintf(stderr, "\t -M : Maximum error < 0.5%, Average error < 0.25%\n");
+	fprintf(stderr, "\t -H : Maximum error < 0.1%, Average error < 0.05%\n");
+	fprintf(stderr, "\t -q : No messages\n");
+	fprintf(stderr, "\t A file named - is the standard input or output\n");
+	exit(EXIT_FAILURE);
+}
+
 int
 main(int argc, char **argv)
 {
-FILE * fp1;
-FILE * fp2;
+file_map input_map;
+file_map output_map;
+FILE *log;
 char *input_file;
 char *output_file;
-float val;
-float *p_val;
-float input[MAX_SIZE];
-compressed_array compressed_buffer;
-uint8_t *batch_ptr;
 uint8_t accuracy;
-uint32_t val32;
-uint32_t *p_val32;
-uint32_t elem_count;
-uint32_t start;
-uint32_t end;
-uint32_t output_size;
-uint32_t byte_count;
-
-	if (argc == 3) {
-		accuracy = ACCURACY_HALF_PERCENT;
-		input_file = argv[1];
-		output_file = argv[2];
-	}
+uint64_t elem_count;
+uint64_t output_size;
+int quiet;
+int arg;
+
+	accuracy = ACCURACY_HALF_PERCENT;
+	quiet = 0;
 
-	else if (argc == 4) {
-		if (strcmp(argv[1], "-L") == 0) 
+	for (arg = 1; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+		if (strcmp(argv[arg], "-L") == 0) 
 			accuracy = ACCURACY_HALF_PERCENT;
-		else if (strcmp(argv[1], "-M") == 0)
+		else if (strcmp(argv[arg], "-M") == 0)
 			accuracy = ACCURACY_QUARTER_PERCENT;
-		else if (strcmp(argv[1], "-H") == 0)
+		else if (strcmp(argv[arg], "-H") == 0)
 			accuracy = ACCURACY_ONE_TENTH_PERCENT;
-		else {
-			fprintf(stderr, "Usage: compressFloat [-L|M|N] <floating point file> <compressed binary file>\n");
-			fprintf(stderr, "\t -L : Maximum error < 1%, Average error < 0.5%\n");
-			fprintf(stderr, "\t -M : Maximum error < 0.5%, Average error < 0.25%\n");
-			fprintf(stderr, "\t -H : Maximum error < 0.1%, Average error < 0.05%\n");
+		else if (strcmp(argv[arg], "-q") == 0)
+			quiet = 1;
+		else
+			usage();
+	}
+
+	if (argc - arg != 2)
+		usage();
+
+	input_file = argv[arg];
+	output_file = argv[arg + 1];
+
+	// The messages go to the standard error if the compressed
+	// array goes to the standard output
+	log = NULL;
+	if (!quiet)
+		log = strcmp(output_file, "-") == 0 ? stderr : stdout;
+
+	// The standard input and output are compressed as a stream of
+	// frames, which are written as the numbers arrive
+	if (strcmp(input_file, "-") == 0 || strcmp(output_file, "-") == 0) {
+		if (pipe_compress(input_file, output_file, PRECISION_SINGLE, accuracy, &elem_count, &output_size) != 0) {
+			fprintf(stderr, "Compression of %s to %s failed\n", input_file, output_file);
 			exit(EXIT_FAILURE);
 		}
 
-		input_file = argv[2];
-		output_file = argv[3];
+		if (log != NULL)
+			fprintf(log, "Compressed %llu floating point numbers to a stream of %llu bytes\n", 
+					(unsigned long long) elem_count, (unsigned long long) output_size);
 
-	} else {
-		fprintf(stderr, "Usage: compressFloat [-L|M] <floating point file> <compressed binary file>\n");
-		fprintf(stderr, "\t -L : Maximum error < 1%, Average error < 0.5%\n");
-		fprintf(stderr, "\t -M : Maximum error < 0.5%, Average error < 0.25%\n");
-		fprintf(stderr, "\t -H : Maximum error < 0.1%, Average error < 0.05%\n");
-		exit(EXIT_FAILURE);
+		exit(EXIT_SUCCESS);
 	}
 
-	fp1 = fopen(input_file, "rb");
-	if (fp1 == NULL) {
+	if (file_map_read(&input_map, input_file) != 0) {
 		fprintf(stderr, "Could not open input file %s\n", input_file);
 		exit(EXIT_FAILURE);
 	}
 
-	fp2 = fopen(output_file, "wb");
-	if (fp2 == NULL) {
-		fprintf(stderr, "Could not open output file %s\n", output_file);
-		exit(EXIT_FAILURE);
-	}
-
-	p_val = &val;
+	// The numbers are compressed where they are mapped, a partial
+	// number at the end of the file is ignored
+	elem_count = input_map.size / sizeof(float);
 
-	elem_count = 0;
+	if (log != NULL)
+		fprintf(log, "Input file %s has %llu floating point numbers\n", input_file, (unsigned long long) elem_count);
 
-	while (fread((void *) p_val, sizeof(float), 1, fp1) == 1) {
-		input[elem_count++] = val;
+	// The compressed array is written straight to the output file,
+	// which is mapped with room for the largest possible result
+	if (file_map_write(&output_map, output_file, compress_bound(elem_count, PRECISION_SINGLE)) != 0) {
+		fprintf(stderr, "Could not open output file %s\n", output_file);
+		exit(EXIT_FAILURE);
 	}
 
-	printf("Input file %s has %d floating point numbers\n", input_file, elem_count);
-
-	compressed_buffer = compress_float(elem_count, accuracy,  input);
-	if (compressed_buffer == NULL) {
+	output_size = ac_compress_float_into(NULL, elem_count, accuracy, (float *) input_map.data, output_map.data, 
+			output_map.size);
+	if (output_size == 0) {
 		fprintf(stderr, "Internal error: Compression failed\n");
 		exit(EXIT_FAILURE);
 	}
 
-	// Extract the length of the opaque object
-	output_size = get_compressed_length(compressed_buffer);
-
-	// Now flush the output buffer to fp2
-	if ((byte_count = fwrite(compressed_buffer , sizeof(uint8_t), output_size, fp2)) != output_size) {
-		fprintf(stderr, "Internal error: write to output file failed %d bytes written\n", byte_count); 
+	if (file_map_close(&output_map, output_size) != 0) {
+		fprintf(stderr, "Internal error: write to output file %s failed\n", output_file); 
 		exit(EXIT_FAILURE);
-	};
+	}
 
-	printf("Sucessfully generated compressed output file %s of size %d bytes\n", output_file, output_size);
+	if (log != NULL)
+		fprintf(log, "Sucessfully generated compressed output file %s of size %llu bytes\n", output_file, 
+				(unsigned long long) output_size);
 
-	fclose(fp1);
-	fclose(fp2);
+	file_map_close(&input_map, 0);
 
 	exit(EXIT_SUCCESS);
 }
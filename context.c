@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "approximateCompression_internal.h"
+#include "context.h"
+
+#define DEBUG 0
+
+// Command to compile: gcc -std=gnu99 -c context.c
+
+// This file contains the compression context. A context owns the
+// scratch memory of the compressor and the decompressor. The arenas
+// are sized on first use and reused afterwards, so that in steady
+// state compressing or decompressing an array does no allocation.
+// A context may be used by one thread at a time.
+
+ac_context *
+ac_context_create(void)
+{
+ac_context *ctx;
+
+	ctx = calloc(1, sizeof(ac_context));
+	if (ctx == NULL) {
+		if (DEBUG)
+			printf("Internal error at file %s line %d: memory allocation failed\n",  __FILE__, __LINE__);
+		return NULL;
+	}
+
+	ctx->thread_count = 1;
+
+	return ctx;
+}
+
+void
+ac_context_free(ac_context *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	free(ctx->compressed.base);
+	free(ctx->decompressed.base);
+	free(ctx->staging.base);
+	free(ctx->batch.base);
+	free(ctx->index_staging.base);
+	free(ctx->chunks.base);
+	for (int i = 0; i < MAX_THREADS; i++)
+		free(ctx->thread_staging[i].base);
+	free(ctx);
+}
+
+// Arrays compressed using the context end with an index of their batches
+// if enable is not 0, which allows decompressing a range of elements
+// without decoding the batches before it
+void
+ac_context_set_index(ac_context *ctx, int enable)
+{
+	ctx->index = enable;
+}
+
+// The encoded batches of arrays compressed using the context have a
+// checkpoint every interval elements, which allows decoding a single
+// element without decoding the elements before it. The interval is
+// rounded down to a power of two between MIN_CHECKPOINT_INTERVAL and
+// MAX_CHECKPOINT_INTERVAL. There are no checkpoints if interval is 0
+void
+ac_context_set_checkpoints(ac_context *ctx, uint32_t interval)
+{
+	ctx->checkpoint_interval = 0;
+	if (interval == 0)
+		return;
+
+	ctx->checkpoint_interval = MIN_CHECKPOINT_INTERVAL;
+	while (ctx->checkpoint_interval <= interval / 2 && ctx->checkpoint_interval < MAX_CHECKPOINT_INTERVAL)
+		ctx->checkpoint_interval *= 2;
+}
+
+// Arrays compressed or decompressed using the context are processed by up
+// to thread_count threads, the calling thread being one of them. The
+// context is still used by one call at a time
+void
+ac_context_set_threads(ac_context *ctx, int thread_count)
+{
+	if (thread_count < 1)
+		thread_count = 1;
+	if (thread_count > MAX_THREADS)
+		thread_count = MAX_THREADS;
+
+	ctx->thread_count = thread_count;
+}
+
+// Makes sure the arena has at least size bytes and returns its base,
+// NULL if memory could not be allocated. The content of the arena is
+// not preserved when it grows
+void *
+arena_reserve(ac_arena *arena, size_t size)
+{
+uint8_t *base;
+
+	if (arena->size >= size)
+		return arena->base;
+
+	// Grow at least by half, so that slowly growing requests do
+	// not reallocate every time
+	if (size < arena->size + arena->size / 2)
+		size = arena->size + arena->size / 2;
+
+	base = malloc(size);
+	if (base == NULL) {
+		if (DEBUG)
+			printf("Internal error at file %s line %d: memory allocation failed\n",  __FILE__, __LINE__);
+		return NULL;
+	}
+
+	free(arena->base);
+	arena->base = base;
+	arena->size = size;
+
+	return base;
+}
+
+// Same as arena_reserve, the content of the arena is preserved when it
+// grows
+void *
+arena_grow(ac_arena *arena, size_t size)
+{
+uint8_t *base;
+
+	if (arena->size >= size)
+		return arena->base;
+
+	if (size < arena->size + arena->size / 2)
+		size = arena->size + arena->size / 2;
+
+	base = realloc(arena->base, size);
+	if (base == NULL) {
+		if (DEBUG)
+			printf("Internal error at file %s line %d: memory allocation failed\n",  __FILE__, __LINE__);
+		return NULL;
+	}
+
+	arena->base = base;
+	arena->size = size;
+
+	return base;
+}
@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include <stddef.h>
+
+// An arena is a scratch buffer owned by a context. It grows on demand
+// and is reused by all later calls, it is released only when the
+// context is freed
+typedef struct {
+	uint8_t *base;
+	size_t size;
+} ac_arena;
+
+// Largest number of threads used by one call
+#define MAX_THREADS 64
+
+// Bounds of the distance between checkpoints, see uint8.c. A checkpoint
+// takes 5 bytes, which at the smallest interval adds 2.5 bits to each
+// element of a batch. In batches with zeros a checkpoint takes 17 bytes,
+// more than a byte per element at the smallest interval, such batches
+// call for a larger interval. The largest interval is the largest batch,
+// MAX_BATCH_SIZE in approximateCompression.c
+#define MIN_CHECKPOINT_INTERVAL 16
+#define MAX_CHECKPOINT_INTERVAL (1 << 20)
+
+// Compression context, all memory needed by the compressor and the
+// decompressor comes from its arenas
+struct ac_context {
+	ac_arena compressed;	// Output of the compressor
+	ac_arena decompressed;	// Output of the decompressor
+	ac_arena staging;	// Bucket numbers of one batch
+	ac_arena batch;		// Numbers of a batch decompressed in part
+	ac_arena index_staging;	// Index entries of the compressor
+	ac_arena chunks;	// Chunks of the parallel compressor and decompressor
+	ac_arena thread_staging[MAX_THREADS];	// Bucket numbers of the decompressor threads
+	int index;		// Write the index of the batches
+	uint32_t checkpoint_interval;	// Power of two, 0 for no checkpoints
+	int thread_count;	// Threads of a call, at most MAX_THREADS
+};
+
+/* Function declarations */
+
+void *arena_reserve(ac_arena *arena, size_t size);
+void *arena_grow(ac_arena *arena, size_t size);
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cpuFeatures.h"
+
+// This file contains the run time detection of the instruction set
+// extensions used by the SIMD kernels
+//
+// Command to compile: gcc -std=gnu99 -c cpuFeatures.c
+
+// The widest instruction set the kernels may use. The environment variable
+// AC_SIMD lowers it to none, sse4.1 or avx2 (avx512 is the default), so
+// that the SIMD kernels can be compared with the scalar ones. It is read
+// once, the kernels are chosen on first use
+#if HAVE_X86_SIMD
+#define SIMD_NONE	0
+#define SIMD_SSE41	1
+#define SIMD_AVX2	2
+#define SIMD_AVX512	3
+
+static int simd_limit;
+static pthread_once_t simd_limit_once = PTHREAD_ONCE_INIT;
+
+static void
+read_simd_limit(void)
+{
+const char *name;
+
+	simd_limit = SIMD_AVX512;
+
+	name = getenv("AC_SIMD");
+	if (name == NULL)
+		return;
+
+	if (strcmp(name, "none") == 0)
+		simd_limit = SIMD_NONE;
+	else if (strcmp(name, "sse4.1") == 0)
+		simd_limit = SIMD_SSE41;
+	else if (strcmp(name, "avx2") == 0)
+		simd_limit = SIMD_AVX2;
+}
+
+// Returns 1 if the kernels may use the instruction set, 0 otherwise
+static int
+simd_allowed(int level)
+{
+	pthread_once(&simd_limit_once, read_simd_limit);
+
+	return level <= simd_limit;
+}
+#endif
+
+// Returns 1 if the processor supports SSE4.1 and AC_SIMD allows it, 0
+// otherwise
+int
+cpu_has_sse41(void)
+{
+#if HAVE_X86_SIMD
+	return simd_allowed(SIMD_SSE41) && __builtin_cpu_supports("sse4.1");
+#else
+	return 0;
+#endif
+}
+
+// Returns 1 if the processor supports AVX2 and AC_SIMD allows it, 0
+// otherwise
+int
+cpu_has_avx2(void)
+{
+#if HAVE_X86_SIMD
+	return simd_allowed(SIMD_AVX2) && __builtin_cpu_supports("avx2");
+#else
+	return 0;
+#endif
+}
+
+// Returns 1 if the processor supports AVX-512 foundation and AC_SIMD
+// allows it, 0 otherwise
+int
+cpu_has_avx512(void)
+{
+#if HAVE_X86_SIMD
+	return simd_allowed(SIMD_AVX512) && __builtin_cpu_supports("avx512f");
+#else
+	return 0;
+#endif
+}
+
+// Returns 1 if the processor supports the half precision conversions
+// of F16C and AC_SIMD allows AVX2, 0 otherwise
+int
+cpu_has_f16c(void)
+{
+#if HAVE_X86_SIMD
+	return simd_allowed(SIMD_AVX2) && __builtin_cpu_supports("f16c");
+#else
+	return 0;
+#endif
+}
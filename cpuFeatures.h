@@ -0,0 +1,17 @@
+#include <stdint.h>
+
+// SIMD kernels are compiled with the GCC target attribute and selected
+// at run time, so the library runs on any x86 processor and elsewhere
+// falls back to the scalar code
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+/* Function declarations */
+
+int cpu_has_sse41(void);
+int cpu_has_avx2(void);
+int cpu_has_avx512(void);
+int cpu_has_f16c(void);
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "approximateCompression.h"
+#include "fileMap.h"
+
+/*
+** This program reads a compressed file and generates approximate
+** version of the original file containing bfloat16 floating point
+** numbers (16 bit each) using the function decompress_bfloat16. The compressed
+** file may come from any of the compress programs, the numbers are
+** converted to bfloat16 as they are decompressed. The rounding to
+** bfloat16 adds to the error of the compression.
+**
+** Command to compile: gcc -std=gnu99 -o decompressBfloat16 decompressBfloat16Main.c 
+**                         approximateCompression.o bitUtils.o bucket.o uint8.o fileMap.o
+** Usage:    ./decompressBfloat16 [-q] compressed_file decompressed_file
+**           Either file may be -, the standard input or output
+*/
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: decompressBfloat16 [-q] <compressed binary file> <bfloat16 file>\n");
+	fprintf(stderr, "\t -q : No messages\n");
+	fprintf(stderr, "\t A file named - is the standard input or output\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+file_map input_map;
+file_map output_map;
+compressed_array input;
+FILE *log;
+char *input_file;
+char *output_file;
+uint64_t elem_count;
+int quiet;
+int arg;
+
+	quiet = 0;
+
+	for (arg = 1; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+		if (strcmp(argv[arg], "-q") == 0)
+			quiet = 1;
+		else
+			usage();
+	}
+
+	if (argc - arg != 2)
+		usage();
+
+	input_file = argv[arg];
+	output_file = argv[arg + 1];
+
+	// The messages go to the standard error if the numbers go to
+	// the standard output
+	log = NULL;
+	if (!quiet)
+		log = strcmp(output_file, "-") == 0 ? stderr : stdout;
+
+	input = NULL;
+	input_map.fd = (-1);
+	if (strcmp(input_file, "-") != 0 && strcmp(output_file, "-") != 0) {
+		if (file_map_read(&input_map, input_file) != 0) {
+			fprintf(stderr, "Could not open input compressed file %s\n", input_file);
+			exit(EXIT_FAILURE);
+		}
+		input = (compressed_array) input_map.data;
+	}
+
+	// The standard input and output, files that hold several arrays
+	// such as the frames of a stream, and empty files, which are streams
+	// without frames, are decompressed as they are read
+	if (input_map.fd < 0 || input_map.size == 0 || (input_map.size >= 4 * sizeof(uint32_t) && get_compressed_length(input) > 0 
+			&& get_compressed_length(input) < input_map.size)) {
+		if (input_map.fd >= 0)
+			file_map_close(&input_map, 0);
+
+		if (pipe_decompress(input_file, output_file, PRECISION_BFLOAT16, &elem_count) != 0) {
+			fprintf(stderr, "Error decompressing input file\n");
+			exit(EXIT_FAILURE);
+		}
+
+		if (log != NULL)
+			fprintf(log, "Decompression successful, wrote %llu bfloat16 floating point numbers to %s\n", 
+					(unsigned long long) elem_count, output_file);
+
+		exit(EXIT_SUCCESS);
+	}
+
+	if (log != NULL)
+		fprintf(log, "Compressed file %s contains %llu bytes\n", input_file, (unsigned long long) input_map.size);
+
+	// The file must hold at least the smallest header, and the whole
+	// compressed array
+	if (input_map.size < 4 * sizeof(uint32_t) || get_compressed_length(input) == 0 
+			|| get_compressed_length(input) > input_map.size) {
+		fprintf(stderr, "Error decompressing input file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	elem_count = get_element_count(input);
+	if (elem_count > SIZE_MAX / sizeof(uint16_t)) {
+		fprintf(stderr, "Error decompressing input file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// The numbers are decompressed straight to the output file, which
+	// is mapped with their size
+	if (file_map_write(&output_map, output_file, elem_count * sizeof(uint16_t)) != 0) {
+		fprintf(stderr, "Could not open output file %s\n", output_file);
+		exit(EXIT_FAILURE);
+	}
+
+	if (ac_decompress_bfloat16_into(NULL, input, (uint16_t *) output_map.data, elem_count) != 0) {
+		fprintf(stderr, "Error decompressing input file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (file_map_close(&output_map, elem_count * sizeof(uint16_t)) != 0) {
+		fprintf(stderr, "Error writing output file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (log != NULL)
+		fprintf(log, "Decompression successful, wrote %llu bfloat16 floating point numbers to the file %s\n", 
+				(unsigned long long) elem_count, output_file);
+
+	file_map_close(&input_map, 0);
+
+	exit(EXIT_SUCCESS);
+}
@@ -4,9 +4,7 @@
 #include <string.h>
 
 #include "approximateCompression.h"
-
-// For handling larger input files, increase the constant below
-#define MAX_SIZE 65536
+#include "fileMap.h"
 
 /*
 ** This program reads a compressed file previously generated using
@@ -18,84 +16,125 @@
 ** in other words about 2 bits per floating point number (32 bit).
 **
 ** Command to compile: gcc -std=gnu99 -o decompressFloat decompressFloatMain.c 
-**                         approximateCompression.o bitUtils.o bucket.o uint8.o
-** Usage:    ./decompressFloatMain compressed_file decompressed_file
+**                         approximateCompression.o bitUtils.o bucket.o uint8.o fileMap.o
+** Usage:    ./decompressFloat [-q] compressed_file decompressed_file
+**           Either file may be -, the standard input or output
 **
 ** The accuracy of compression can be checked using a program compareFloat.
 */
 
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: decompressFloat [-q] <compressed binary file> <floating point file>\n");
+	fprintf(stderr, "\t -q : No messages\n");
+	fprintf(stderr, "\t A file named - is the standard input or output\n");
+	exit(EXIT_FAILURE);
+}
+
 int
 main(int argc, char **argv)
 {
-FILE * fp1;
-FILE * fp2;
-uint8_t input[MAX_SIZE];
-uint32_t input_size;
-uint8_t *output;
-uint32_t output_size;
-uint16_t batch_size;
-uint32_t batch_count;
-uint32_t elem_count;
-uint8_t val;
-uint32_t *p_val32;
-float *p_float;
-
-	if (argc != 3) {
-		fprintf(stderr, "Usage: decompressFloat <compressed binary file> <floating point file>\n");
-		exit(EXIT_FAILURE);
+file_map input_map;
+file_map output_map;
+compressed_array input;
+FILE *log;
+char *input_file;
+char *output_file;
+uint64_t elem_count;
+int quiet;
+int arg;
+
+	quiet = 0;
+
+	for (arg = 1; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+		if (strcmp(argv[arg], "-q") == 0)
+			quiet = 1;
+		else
+			usage();
 	}
 
-	fp1 = fopen(argv[1], "rb");
-	if (fp1 == NULL) {
-		fprintf(stderr, "Could not open input compressed file %s\n", argv[1]);
-		exit(EXIT_FAILURE);
+	if (argc - arg != 2)
+		usage();
+
+	input_file = argv[arg];
+	output_file = argv[arg + 1];
+
+	// The messages go to the standard error if the numbers go to
+	// the standard output
+	log = NULL;
+	if (!quiet)
+		log = strcmp(output_file, "-") == 0 ? stderr : stdout;
+
+	input = NULL;
+	input_map.fd = (-1);
+	if (strcmp(input_file, "-") != 0 && strcmp(output_file, "-") != 0) {
+		if (file_map_read(&input_map, input_file) != 0) {
+			fprintf(stderr, "Could not open input compressed file %s\n", input_file);
+			exit(EXIT_FAILURE);
+		}
+		input = (compressed_array) input_map.data;
 	}
 
-	fp2 = fopen(argv[2], "wb");
-	if (fp2 == NULL) {
-		fprintf(stderr, "Could not open output file %s\n", argv[2]);
-		exit(EXIT_FAILURE);
-	}
+	// The standard input and output, files that hold several arrays
+	// such as the frames of a stream, and empty files, which are streams
+	// without frames, are decompressed as they are read
+	if (input_map.fd < 0 || input_map.size == 0 || (input_map.size >= 4 * sizeof(uint32_t) && get_compressed_length(input) > 0 
+			&& get_compressed_length(input) < input_map.size)) {
+		if (input_map.fd >= 0)
+			file_map_close(&input_map, 0);
+
+		if (pipe_decompress(input_file, output_file, PRECISION_SINGLE, &elem_count) != 0) {
+			fprintf(stderr, "Error decompressing input file\n");
+			exit(EXIT_FAILURE);
+		}
 
-	input_size = 0;
+		if (log != NULL)
+			fprintf(log, "Decompression successful, wrote %llu floating point numbers to %s\n", 
+					(unsigned long long) elem_count, output_file);
 
-	while (fread((void *) &val, sizeof(uint8_t), 1, fp1) == 1) {
-		input[input_size++] = val;
+		exit(EXIT_SUCCESS);
 	}
 
-	printf("Compressed file %s contains %d bytes\n", argv[1], input_size);
+	if (log != NULL)
+		fprintf(log, "Compressed file %s contains %llu bytes\n", input_file, (unsigned long long) input_map.size);
 
-	output = decompress_float((compressed_array) input);
-	if (output == NULL) {
+	// The file must hold at least the smallest header, and the whole
+	// compressed array
+	if (input_map.size < 4 * sizeof(uint32_t) || get_compressed_length(input) == 0 
+			|| get_compressed_length(input) > input_map.size) {
 		fprintf(stderr, "Error decompressing input file\n");
 		exit(EXIT_FAILURE);
 	}
 
-	// First four bytes of the returned BLOB contains the size
-	// followed by the floating point numbers
-	p_val32 = (uint32_t *) output;
-	output_size = *p_val32; 
-	if (output_size == 0) {
+	elem_count = get_element_count(input);
+	if (elem_count > SIZE_MAX / sizeof(float)) {
 		fprintf(stderr, "Error decompressing input file\n");
 		exit(EXIT_FAILURE);
 	}
 
-	elem_count = output_size / sizeof(float);
+	// The numbers are decompressed straight to the output file, which
+	// is mapped with their size
+	if (file_map_write(&output_map, output_file, elem_count * sizeof(float)) != 0) {
+		fprintf(stderr, "Could not open output file %s\n", output_file);
+		exit(EXIT_FAILURE);
+	}
 
-	// Skip the first four bytes before writing the
-	// floating points to the output file
-	output += sizeof(uint32_t);
-	p_float = (float *) output;
+	if (ac_decompress_float_into(NULL, input, (float *) output_map.data, elem_count) != 0) {
+		fprintf(stderr, "Error decompressing input file\n");
+		exit(EXIT_FAILURE);
+	}
 
-	if (fwrite((void *) p_float, sizeof(float), elem_count, fp2) != elem_count) {
+	if (file_map_close(&output_map, elem_count * sizeof(float)) != 0) {
 		fprintf(stderr, "Error writing output file\n");
 		exit(EXIT_FAILURE);
 	}
 
-	printf("Decompression successful, wrote %d floating point numbers to the file %s\n", elem_count, argv[2]);
+	if (log != NULL)
+		fprintf(log, "Decompression successful, wrote %llu floating point numbers to the file %s\n", 
+				(unsigned long long) elem_count, output_file);
 
-	fclose(fp1);
-	fclose(fp2);
+	file_map_close(&input_map, 0);
 
 	exit(EXIT_SUCCESS);
 }
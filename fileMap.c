@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "approximateCompression.h"
+#include "fileMap.h"
+
+// This file contains the file input and output of the compress and
+// decompress programs. An input file is mapped in memory and handed to the
+// library as it is, an output file is grown to the largest size of the
+// result, mapped, written by the library and truncated to the size of the
+// result. Nothing is copied and the page cache does the reading and the
+// writing, so the size of a file is limited only by the address space.
+// The standard input and output, "-", are compressed and decompressed as
+// a stream instead
+//
+// Command to compile: gcc -std=gnu99 -c fileMap.c
+
+// Size of the reads and writes of files that are not mapped
+#define IO_SIZE (1 << 20)
+
+// Reads the file into a buffer, in reads of IO_SIZE bytes. Returns 0 on
+// success, -1 in case of error
+static int
+read_all(file_map *map)
+{
+size_t capacity;
+uint8_t *data;
+ssize_t n;
+
+	capacity = 0;
+	for (;;) {
+		if (map->size + IO_SIZE > capacity) {
+			capacity = (capacity == 0) ? 2 * IO_SIZE : 2 * capacity;
+			data = realloc(map->data, capacity);
+			if (data == NULL)
+				return (-1);
+			map->data = data;
+		}
+
+		n = read(map->fd, map->data + map->size, IO_SIZE);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return (-1);
+		if (n == 0)
+			return 0;
+
+		map->size += n;
+	}
+}
+
+// Writes size bytes of data to the file fd, in writes of at most IO_SIZE
+// bytes. Returns 0 on success, -1 in case of error
+static int
+write_all(int fd, uint8_t *data, size_t size)
+{
+size_t done;
+size_t chunk;
+ssize_t n;
+
+	for (done = 0; done < size; done += n) {
+		chunk = size - done < IO_SIZE ? size - done : IO_SIZE;
+		n = write(fd, data + done, chunk);
+		if (n < 0 && errno == EINTR) {
+			n = 0;
+			continue;
+		}
+		if (n <= 0)
+			return (-1);
+	}
+
+	return 0;
+}
+
+// Maps the file path for reading. The file is read into a buffer if it is
+// not a regular file. Returns 0 on success, -1 in case of error
+int
+file_map_read(file_map *map, const char *path)
+{
+struct stat st;
+
+	memset(map, 0, sizeof(file_map));
+
+	map->fd = open(path, O_RDONLY);
+	if (map->fd < 0)
+		return (-1);
+
+	if (fstat(map->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		map->size = st.st_size;
+		if (map->size == 0)
+			return 0;
+
+		map->data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, map->fd, 0);
+		if (map->data != MAP_FAILED) {
+			map->mapped = 1;
+			madvise(map->data, map->size, MADV_SEQUENTIAL);
+			return 0;
+		}
+
+		map->data = NULL;
+		map->size = 0;
+	}
+
+	return read_all(map);
+}
+
+// Creates the file path and maps capacity bytes of it for writing. The
+// bytes are written from a buffer if the file can not be mapped. Returns
+// 0 on success, -1 in case of error
+int
+file_map_write(file_map *map, const char *path, size_t capacity)
+{
+struct stat st;
+
+	memset(map, 0, sizeof(file_map));
+	map->writable = 1;
+	map->size = capacity;
+
+	map->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (map->fd < 0)
+		return (-1);
+
+	if (capacity > 0 && fstat(map->fd, &st) == 0 && S_ISREG(st.st_mode) && ftruncate(map->fd, capacity) == 0) {
+		map->data = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+		if (map->data != MAP_FAILED) {
+			map->mapped = 1;
+			return 0;
+		}
+
+		if (ftruncate(map->fd, 0) != 0)
+			return (-1);
+	}
+
+	map->data = malloc(capacity > 0 ? capacity : 1);
+	if (map->data == NULL)
+		return (-1);
+
+	return 0;
+}
+
+// Unmaps the file, or frees its buffer, and closes it. A file mapped for
+// writing keeps its first size bytes. Returns 0 on success, -1 in case
+// of error
+int
+file_map_close(file_map *map, size_t size)
+{
+int status;
+
+	status = 0;
+	if (map->mapped) {
+		if (munmap(map->data, map->size) != 0)
+			status = (-1);
+		if (map->writable && ftruncate(map->fd, size) != 0)
+			status = (-1);
+	} else {
+		if (map->writable && write_all(map->fd, map->data, size) != 0)
+			status = (-1);
+		free(map->data);
+	}
+
+	if (map->fd >= 0 && close(map->fd) != 0)
+		status = (-1);
+
+	memset(map, 0, sizeof(file_map));
+	map->fd = (-1);
+
+	return status;
+}
+
+// Opens the file path for reading, or creates it for writing, "-" being
+// the standard input or output. Returns the file descriptor, -1 in case
+// of error
+static int
+open_path(const char *path, int writable)
+{
+	if (strcmp(path, "-") == 0)
+		return writable ? STDOUT_FILENO : STDIN_FILENO;
+
+	if (writable)
+		return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	return open(path, O_RDONLY);
+}
+
+// Closes the file descriptor unless it is the standard input or output.
+// Returns 0 on success, -1 in case of error
+static int
+close_path(int fd)
+{
+	if (fd == STDIN_FILENO || fd == STDOUT_FILENO)
+		return 0;
+
+	return close(fd);
+}
+
+// Size in bytes of a number of the precision
+static size_t
+value_size(uint8_t precision)
+{
+	if (precision == PRECISION_DOUBLE)
+		return sizeof(double);
+	else if (precision == PRECISION_SINGLE)
+		return sizeof(float);
+	else // PRECISION_HALF or PRECISION_BFLOAT16
+		return sizeof(uint16_t);
+}
+
+// Counts the bytes written by a stream to its file
+typedef struct {
+	int fd;
+	uint64_t size;
+} pipe_output;
+
+static int
+write_frame(void *opaque, uint8_t *data, size_t size)
+{
+pipe_output *output;
+
+	output = opaque;
+	output->size += size;
+
+	return write_all(output->fd, data, size);
+}
+
+// Compresses the numbers of the file input_path, whose precision is
+// precision, to the file output_path as a stream. The numbers are read in
+// blocks of IO_SIZE bytes and compressed in frames as they arrive, so the
+// files may be pipes and memory does not grow with their size. A partial
+// number at the end of the input is ignored. Sets elem_count and
+// output_size to the numbers read and the bytes written. Returns 0 on
+// success, -1 in case of error
+int
+pipe_compress(const char *input_path, const char *output_path, uint8_t precision, uint8_t accuracy, 
+		uint64_t *elem_count, uint64_t *output_size)
+{
+pipe_output output;
+ac_stream *stream;
+uint8_t *block;
+size_t size;
+size_t used;
+ssize_t n;
+int input_fd;
+int status;
+
+	*elem_count = 0;
+	*output_size = 0;
+
+	input_fd = open_path(input_path, 0);
+	if (input_fd < 0)
+		return (-1);
+
+	output.fd = open_path(output_path, 1);
+	output.size = 0;
+	if (output.fd < 0) {
+		close_path(input_fd);
+		return (-1);
+	}
+
+	stream = ac_stream_init(NULL, precision, accuracy, 0, write_frame, &output);
+	block = malloc(IO_SIZE);
+
+	status = (stream == NULL || block == NULL) ? (-1) : 0;
+
+	// The bytes of a partial number stay at the start of the block
+	size = 0;
+	while (status == 0) {
+		n = read(input_fd, block + size, IO_SIZE - size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			status = (-1);
+		if (n <= 0)
+			break;
+
+		size += n;
+		used = size - size % value_size(precision);
+		if (ac_stream_push(stream, block, used / value_size(precision)) != 0)
+			status = (-1);
+
+		*elem_count += used / value_size(precision);
+		memmove(block, block + used, size - used);
+		size -= used;
+	}
+
+	if (status == 0)
+		status = ac_stream_finish(stream);
+
+	*output_size = output.size;
+
+	ac_stream_free(stream);
+	free(block);
+	if (close_path(output.fd) != 0)
+		status = (-1);
+	close_path(input_fd);
+
+	return status;
+}
+
+// Decompresses the file input_path, which holds compressed arrays or the
+// frames of a stream, to the file output_path as numbers of precision
+// output_precision. The arrays are read and decoded in blocks of IO_SIZE
+// bytes, see ac_reader_init_fd, so the files may be pipes. Sets elem_count
+// to the numbers written. Returns 0 on success, -1 in case of error
+int
+pipe_decompress(const char *input_path, const char *output_path, uint8_t output_precision, uint64_t *elem_count)
+{
+ac_reader *reader;
+uint8_t *block;
+uint64_t block_count;
+int64_t n;
+int input_fd;
+int output_fd;
+int status;
+
+	*elem_count = 0;
+
+	input_fd = open_path(input_path, 0);
+	if (input_fd < 0)
+		return (-1);
+
+	output_fd = open_path(output_path, 1);
+	if (output_fd < 0) {
+		close_path(input_fd);
+		return (-1);
+	}
+
+	reader = ac_reader_init_fd(input_fd, output_precision);
+	block = malloc(IO_SIZE);
+	block_count = IO_SIZE / value_size(output_precision);
+
+	status = (reader == NULL || block == NULL) ? (-1) : 0;
+
+	while (status == 0) {
+		n = ac_reader_next(reader, block, block_count);
+		if (n < 0) {
+			status = (-1);
+			break;
+		}
+
+		if (write_all(output_fd, block, n * value_size(output_precision)) != 0)
+			status = (-1);
+
+		*elem_count += n;
+		if (n < block_count)
+			break;
+	}
+
+	ac_reader_free(reader);
+	free(block);
+	if (close_path(output_fd) != 0)
+		status = (-1);
+	close_path(input_fd);
+
+	return status;
+}
@@ -0,0 +1,22 @@
+#include <stdint.h>
+#include <stddef.h>
+
+// A file mapped in memory by the compress and decompress programs. Files
+// that can not be mapped, for example pipes, are read into or written from
+// a buffer instead
+typedef struct {
+	uint8_t *data;
+	size_t size;
+	int fd;
+	int mapped;		// data is a mapping of the file, not a buffer
+	int writable;
+} file_map;
+
+/* Function declarations */
+
+int file_map_read(file_map *map, const char *path);
+int file_map_write(file_map *map, const char *path, size_t capacity);
+int file_map_close(file_map *map, size_t size);
+int pipe_compress(const char *input_path, const char *output_path, uint8_t precision, uint8_t accuracy, 
+		uint64_t *elem_count, uint64_t *output_size);
+int pipe_decompress(const char *input_path, const char *output_path, uint8_t output_precision, uint64_t *elem_count);
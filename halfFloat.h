@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <string.h>
+
+// Conversions between single precision and the two 16 bit formats,
+// IEEE half precision (1 sign, 5 exponent, 10 mantissa bits) and
+// bfloat16 (the top 16 bits of a single precision number). Both are
+// stored as uint16_t. The SIMD kernels convert 8 or 16 numbers at a
+// time, these are used by the scalar kernels and give the same results
+
+// Largest finite numbers of the two formats
+#define HALF_MAX	65504.0f
+#define BFLOAT16_MAX	0x1.fep127f
+
+static inline float
+half_to_float(uint16_t half)
+{
+uint32_t sign;
+uint32_t exponent;
+uint32_t mantissa;
+uint32_t bits;
+float val;
+
+	sign = (uint32_t) (half & 0x8000) << 16;
+	exponent = (half >> 10) & 0x1f;
+	mantissa = half & 0x3ff;
+
+	if (exponent == 0x1f) {
+		// Infinity or not a number
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	} else if (exponent != 0) {
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	} else {
+		// Zero or subnormal, mantissa X 2^-24 is exact in single precision
+		val = (float) mantissa * 0x1p-24f;
+		memcpy(&bits, &val, sizeof(float));
+		bits |= sign;
+	}
+
+	memcpy(&val, &bits, sizeof(float));
+	return val;
+}
+
+// Rounds to the nearest half precision number, ties to even, as the
+// F16C instruction vcvtps2ph does with _MM_FROUND_TO_NEAREST_INT
+static inline uint16_t
+float_to_half(float val)
+{
+uint32_t bits;
+uint32_t sign;
+uint32_t abs_bits;
+uint32_t mantissa;
+int32_t exponent;
+int shift;
+
+	memcpy(&bits, &val, sizeof(float));
+	sign = (bits >> 16) & 0x8000;
+	abs_bits = bits & 0x7fffffff;
+
+	// Infinity or not a number, not a number stays quiet
+	if (abs_bits >= 0x7f800000) {
+		if (abs_bits == 0x7f800000)
+			return sign | 0x7c00;
+		return sign | 0x7e00 | ((abs_bits >> 13) & 0x3ff);
+	}
+
+	exponent = (int32_t) (abs_bits >> 23) - 127 + 15;
+
+	// Overflow, anything at or above 65520 rounds to infinity
+	if (exponent >= 0x1f)
+		return sign | 0x7c00;
+
+	if (exponent <= 0) {
+		// Subnormal or zero
+		if (exponent < -10)
+			return sign;
+
+		mantissa = (abs_bits & 0x7fffff) | 0x800000;
+		shift = 14 - exponent;
+		bits = mantissa >> shift;
+		mantissa &= (1u << shift) - 1;
+		if (mantissa > (1u << (shift - 1)) || (mantissa == (1u << (shift - 1)) && (bits & 1)))
+			bits++;
+
+		return sign | bits;
+	}
+
+	// Normal, a carry out of the mantissa correctly bumps the exponent
+	bits = ((uint32_t) exponent << 10) | ((abs_bits >> 13) & 0x3ff);
+	mantissa = abs_bits & 0x1fff;
+	if (mantissa > 0x1000 || (mantissa == 0x1000 && (bits & 1)))
+		bits++;
+
+	return sign | bits;
+}
+
+static inline float
+bfloat16_to_float(uint16_t bf16)
+{
+uint32_t bits;
+float val;
+
+	bits = (uint32_t) bf16 << 16;
+	memcpy(&val, &bits, sizeof(float));
+	return val;
+}
+
+// Rounds to the nearest bfloat16 number, ties to even
+static inline uint16_t
+float_to_bfloat16(float val)
+{
+uint32_t bits;
+
+	memcpy(&bits, &val, sizeof(float));
+
+	// Not a number stays quiet
+	if ((bits & 0x7fffffff) > 0x7f800000)
+		return (bits >> 16) | 0x40;
+
+	return (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+}
@@ -0,0 +1,770 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "approximateCompression.h"
+
+// Command to compile: make roundTrip, command to run: make check
+
+// This program checks that the numbers that go through the library in
+// pieces come back as they do from a whole array: appended arrays in memory
+// and in a file, streams read back with a reader, ranges and single
+// elements of arrays with and without an index, numbers that are not a
+// number within a batch, and the SIMD kernels, which must give the same
+// arrays as the scalar ones. It is run by make check and exits with a failure
+// if a check fails
+
+#define SERIES_SIZE 200000
+
+// More than two chunks of 256K numbers, which are compressed in parallel
+#define LARGE_SIZE 600000
+
+// Not a multiple of the vector width, so that the kernels end with a
+// partial vector
+#define KERNEL_SERIES_SIZE 100003
+
+// With ACCURACY_HALF_PERCENT the maximum error is less than 1%
+#define MAX_ERROR 0.01
+
+static int failures;
+
+// A growing buffer that receives the frames of a stream, and is read back
+// in pieces of random size
+typedef struct {
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+	size_t read_offset;
+} byte_buffer;
+
+static void
+fail(const char *test, const char *what, uint64_t i)
+{
+	printf("%s: %s at element %llu\n", test, what, (unsigned long long) i);
+	failures++;
+}
+
+// A random walk that crosses zero and has some zeros, the numbers of a
+// series that arrives over time. It starts with a negative number, so
+// that an array that starts empty takes the numbers below zero that follow
+static void
+make_walk(uint64_t count, float *series)
+{
+float val;
+
+	val = 20.0;
+	for (uint64_t i = 0; i < count; i++) {
+		val += (rand() % 2001 - 1000) / 2000.0;
+		series[i] = (rand() % 50 == 0) ? 0.0 : val;
+	}
+	if (count > 0)
+		series[0] = -series[0];
+}
+
+// Positive numbers which change little, so that the batches are long and
+// appended numbers join the last batch
+static void
+make_level(uint64_t count, float *series)
+{
+	for (uint64_t i = 0; i < count; i++)
+		series[i] = 100.0 + (rand() % 1000) / 100.0;
+}
+
+// Returns the number of numbers of the next piece, mostly small ones
+static uint64_t
+piece_size(uint64_t left)
+{
+uint64_t count;
+
+	switch (rand() % 5) {
+	case 0:
+		count = 1;
+		break;
+	case 1:
+		count = 2;
+		break;
+	case 2:
+		count = 1 + rand() % 10;
+		break;
+	case 3:
+		count = 1 + rand() % 1000;
+		break;
+	default:
+		count = 1 + rand() % 20000;
+		break;
+	}
+
+	return count < left ? count : left;
+}
+
+// Checks that count decompressed numbers are within the error of the
+// original numbers, and that zeros stay zeros
+static void
+check_values(const char *test, uint64_t count, float *original, float *output)
+{
+	for (uint64_t i = 0; i < count; i++) {
+		if (fabs(output[i] - original[i]) > MAX_ERROR * fabs(original[i])) {
+			printf("%s: %.9f decompressed to %.9f\n", test, original[i], output[i]);
+			fail(test, "error too large", i);
+			return;
+		}
+	}
+}
+
+// Decompresses the whole array and checks it against the original numbers
+static void
+check_array(const char *test, compressed_array array, uint64_t count, float *original)
+{
+float *output;
+
+	if (get_element_count(array) != count) {
+		fail(test, "wrong number of elements", get_element_count(array));
+		return;
+	}
+
+	output = malloc(count * sizeof(float) + 1);
+	if (output == NULL) {
+		fprintf(stderr, "Could not allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (ac_decompress_float_into(NULL, array, output, count) != 0)
+		fail(test, "decompression failed", 0);
+	else
+		check_values(test, count, original, output);
+
+	free(output);
+}
+
+// The numbers of a series in the precision of an array, and the same
+// numbers in single precision, which the decompressed numbers are
+// checked against
+typedef struct {
+	uint8_t precision;
+	uint64_t count;
+	void *values;
+	float *expected;
+} typed_series;
+
+static size_t
+value_size(uint8_t precision)
+{
+	if (precision == PRECISION_DOUBLE)
+		return sizeof(double);
+	else if (precision == PRECISION_SINGLE)
+		return sizeof(float);
+	else // PRECISION_HALF or PRECISION_BFLOAT16
+		return sizeof(uint16_t);
+}
+
+// Makes a series of the precision from the single precision numbers of
+// series. The 16 bit numbers are truncated, half precision numbers keep
+// the sign and the low exponent bits of series, scaled to 1.0 .. 2.0 or
+// zero, so that they are not subnormal
+static void
+make_typed(uint8_t precision, uint64_t count, float *series, typed_series *typed)
+{
+uint32_t bits;
+uint16_t half;
+
+	typed->precision = precision;
+	typed->count = count;
+	typed->values = malloc(count * value_size(precision));
+	typed->expected = malloc(count * sizeof(float));
+	if (typed->values == NULL || typed->expected == NULL) {
+		fprintf(stderr, "Could not allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (uint64_t i = 0; i < count; i++) {
+		memcpy(&bits, series + i, sizeof(uint32_t));
+
+		if (precision == PRECISION_DOUBLE) {
+			((double *) typed->values)[i] = series[i];
+			typed->expected[i] = series[i];
+		} else if (precision == PRECISION_SINGLE) {
+			((float *) typed->values)[i] = series[i];
+			typed->expected[i] = series[i];
+		} else if (precision == PRECISION_BFLOAT16) {
+			((uint16_t *) typed->values)[i] = bits >> 16;
+			bits &= 0xffff0000;
+			memcpy(typed->expected + i, &bits, sizeof(uint32_t));
+		} else {
+			// Sign, exponent 15 and the top 10 bits of the
+			// mantissa of series
+			half = 0;
+			typed->expected[i] = 0.0;
+			if (series[i] != 0.0) {
+				half = ((bits >> 16) & 0x8000) | 0x3c00 | ((bits >> 13) & 0x3ff);
+				typed->expected[i] = (1.0 + (half & 0x3ff) / 1024.0) * ((half & 0x8000) ? -1.0 : 1.0);
+			}
+			((uint16_t *) typed->values)[i] = half;
+		}
+	}
+}
+
+static void
+free_typed(typed_series *typed)
+{
+	free(typed->values);
+	free(typed->expected);
+}
+
+static size_t
+compress_values(ac_context *ctx, typed_series *typed, uint64_t count, uint8_t *output, size_t capacity)
+{
+	if (typed->precision == PRECISION_DOUBLE)
+		return ac_compress_double_into(ctx, count, ACCURACY_HALF_PERCENT, typed->values, output, capacity);
+	else if (typed->precision == PRECISION_SINGLE)
+		return ac_compress_float_into(ctx, count, ACCURACY_HALF_PERCENT, typed->values, output, capacity);
+	else if (typed->precision == PRECISION_HALF)
+		return ac_compress_half_into(ctx, count, ACCURACY_HALF_PERCENT, typed->values, output, capacity);
+	else
+		return ac_compress_bfloat16_into(ctx, count, ACCURACY_HALF_PERCENT, typed->values, output, capacity);
+}
+
+// Appends count numbers of the series, starting with element start, to
+// the array, which has space for capacity bytes
+static size_t
+append_values(ac_context *ctx, typed_series *typed, uint64_t start, uint64_t count, uint8_t *array, size_t capacity)
+{
+void *input;
+
+	input = (uint8_t *) typed->values + start * value_size(typed->precision);
+
+	if (typed->precision == PRECISION_DOUBLE)
+		return ac_append_double(ctx, (compressed_array) array, capacity, count, input);
+	else if (typed->precision == PRECISION_SINGLE)
+		return ac_append_float(ctx, (compressed_array) array, capacity, count, input);
+	else if (typed->precision == PRECISION_HALF)
+		return ac_append_half(ctx, (compressed_array) array, capacity, count, input);
+	else
+		return ac_append_bfloat16(ctx, (compressed_array) array, capacity, count, input);
+}
+
+// Same as append_values for the array at the start of the file fd
+static int
+append_fd_values(ac_context *ctx, typed_series *typed, uint64_t start, uint64_t count, int fd)
+{
+void *input;
+
+	input = (uint8_t *) typed->values + start * value_size(typed->precision);
+
+	if (typed->precision == PRECISION_DOUBLE)
+		return ac_append_fd_double(ctx, fd, count, input);
+	else if (typed->precision == PRECISION_SINGLE)
+		return ac_append_fd_float(ctx, fd, count, input);
+	else if (typed->precision == PRECISION_HALF)
+		return ac_append_fd_half(ctx, fd, count, input);
+	else
+		return ac_append_fd_bfloat16(ctx, fd, count, input);
+}
+
+// Compresses the first initial_count numbers of the series, then appends
+// the rest in pieces, both to an array in memory and to the same array in
+// a file. The two must stay the same and hold the series. Every append to
+// the array in memory is given compress_bound of its new number of
+// elements, which must be enough
+static void
+test_append(const char *test, ac_context *ctx, typed_series *typed, uint64_t initial_count)
+{
+char path[] = "/tmp/roundTripXXXXXX";
+uint8_t *array;
+uint8_t *file_array;
+size_t capacity;
+size_t size;
+uint64_t done;
+uint64_t piece;
+int fd;
+
+	capacity = compress_bound(typed->count, typed->precision);
+	array = malloc(capacity);
+	file_array = malloc(capacity);
+	if (array == NULL || file_array == NULL) {
+		fprintf(stderr, "Could not allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	size = compress_values(ctx, typed, initial_count, array, compress_bound(initial_count, typed->precision));
+	if (size == 0) {
+		fail(test, "compression failed", 0);
+		return;
+	}
+
+	fd = mkstemp(path);
+	if (fd < 0 || write(fd, array, size) != (ssize_t) size) {
+		fprintf(stderr, "Could not write temporary file %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+	unlink(path);
+
+	for (done = initial_count; done < typed->count; done += piece) {
+		piece = piece_size(typed->count - done);
+
+		size = append_values(ctx, typed, done, piece, array, compress_bound(done + piece, typed->precision));
+		if (size == 0) {
+			fail(test, "append failed", done);
+			break;
+		}
+
+		if (append_fd_values(ctx, typed, done, piece, fd) != 0) {
+			fail(test, "append to the file failed", done);
+			break;
+		}
+	}
+
+	if (pread(fd, file_array, capacity, 0) != (ssize_t) size || memcmp(array, file_array, size) != 0)
+		fail(test, "the file differs from the array in memory", done);
+
+	check_array(test, (compressed_array) array, done, typed->expected);
+
+	close(fd);
+	free(array);
+	free(file_array);
+}
+
+// Appends count numbers of the series at once to an empty array, in a
+// buffer of exactly compress_bound of count bytes
+static void
+test_append_once(const char *test, ac_context *ctx, typed_series *typed, uint64_t count)
+{
+uint8_t *array;
+size_t capacity;
+
+	capacity = compress_bound(count, typed->precision);
+	array = malloc(capacity);
+	if (array == NULL) {
+		fprintf(stderr, "Could not allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (compress_values(ctx, typed, 0, array, capacity) == 0 || append_values(ctx, typed, 0, count, array, capacity) == 0)
+		fail(test, "append failed", count);
+	else
+		check_array(test, (compressed_array) array, count, typed->expected);
+
+	free(array);
+}
+
+static int
+write_frame(void *opaque, uint8_t *data, size_t size)
+{
+byte_buffer *buffer;
+
+	buffer = (byte_buffer *) opaque;
+
+	if (buffer->size + size > buffer->capacity) {
+		buffer->capacity = 2 * (buffer->size + size);
+		buffer->data = realloc(buffer->data, buffer->capacity);
+		if (buffer->data == NULL)
+			return (-1);
+	}
+
+	memcpy(buffer->data + buffer->size, data, size);
+	buffer->size += size;
+
+	return 0;
+}
+
+// Returns the bytes of the buffer a few hundred at a time, so that frames
+// and batches arrive in several pieces
+static int64_t
+read_piece(void *opaque, uint8_t *data, size_t size)
+{
+byte_buffer *buffer;
+size_t count;
+
+	buffer = (byte_buffer *) opaque;
+
+	count = 1 + rand() % 700;
+	if (count > size)
+		count = size;
+	if (count > buffer->size - buffer->read_offset)
+		count = buffer->size - buffer->read_offset;
+
+	memcpy(data, buffer->data + buffer->read_offset, count);
+	buffer->read_offset += count;
+
+	return count;
+}
+
+// Pushes the series to a stream in pieces, flushing it at random points,
+// and reads the frames back in pieces with a reader
+static void
+test_stream(const char *test, uint64_t count, float *series)
+{
+byte_buffer buffer;
+ac_stream *stream;
+ac_reader *reader;
+float *output;
+uint64_t done;
+uint64_t piece;
+int64_t read_count;
+
+	memset(&buffer, 0, sizeof(buffer));
+
+	stream = ac_stream_init(NULL, PRECISION_SINGLE, ACCURACY_HALF_PERCENT, 4096, write_frame, &buffer);
+	if (stream == NULL) {
+		fail(test, "stream creation failed", 0);
+		return;
+	}
+
+	for (done = 0; done < count; done += piece) {
+		piece = piece_size(count - done);
+		if (ac_stream_push(stream, series + done, piece) != 0) {
+			fail(test, "push failed", done);
+			break;
+		}
+
+		if (rand() % 4 == 0 && ac_stream_flush(stream) != 0) {
+			fail(test, "flush failed", done);
+			break;
+		}
+	}
+
+	if (ac_stream_finish(stream) != 0)
+		fail(test, "finish failed", done);
+	ac_stream_free(stream);
+
+	output = malloc(count * sizeof(float) + 1);
+	reader = ac_reader_init(read_piece, &buffer, PRECISION_SINGLE);
+	if (output == NULL || reader == NULL) {
+		fprintf(stderr, "Could not allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (done = 0; done < count; done += read_count) {
+		read_count = ac_reader_next(reader, output + done, piece_size(count - done));
+		if (read_count <= 0) {
+			fail(test, "reader stopped early", done);
+			break;
+		}
+	}
+
+	if (ac_reader_next(reader, output, 1) != 0)
+		fail(test, "reader did not end with the stream", done);
+
+	check_values(test, done, series, output);
+
+	ac_reader_free(reader);
+	free(output);
+	free(buffer.data);
+}
+
+// Decompresses random ranges and elements of the compressed series, which
+// must be the same as the numbers decompressed all at once
+static void
+test_range(const char *test, ac_context *ctx, uint64_t count, float *series)
+{
+compressed_array array;
+float *whole;
+float *range;
+uint8_t *output;
+size_t capacity;
+uint64_t start;
+uint64_t range_count;
+double value;
+
+	capacity = compress_bound(count, PRECISION_SINGLE);
+	output = malloc(capacity);
+	whole = malloc(count * sizeof(float));
+	range = malloc(count * sizeof(float));
+	if (output == NULL || whole == NULL || range == NULL) {
+		fprintf(stderr, "Could not allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	array = (compressed_array) output;
+	if (ac_compress_float_into(ctx, count, ACCURACY_HALF_PERCENT, series, output, capacity) == 0
+			|| ac_decompress_float_into(NULL, array, whole, count) != 0) {
+		fail(test, "compression failed", 0);
+		return;
+	}
+
+	check_values(test, count, series, whole);
+
+	for (int i = 0; i < 200; i++) {
+		start = rand() % (count + 1);
+		range_count = piece_size(count - start);
+		if (i == 0)
+			range_count = 0;
+
+		if (ac_decompress_range_float(ctx, array, start, range_count, range) != 0
+				|| memcmp(range, whole + start, range_count * sizeof(float)) != 0) {
+			fail(test, "range differs", start);
+			break;
+		}
+	}
+
+	for (int i = 0; i < 2000; i++) {
+		start = rand() % count;
+		if (get_element(array, start, &value) != 0 || value != (double) whole[start]) {
+			fail(test, "element differs", start);
+			break;
+		}
+	}
+
+	if (get_element(array, count, &value) != -1)
+		fail(test, "element past the end", count);
+
+	free(output);
+	free(whole);
+	free(range);
+}
+
+// Compresses numbers within one batch with numbers that are not a number
+// among them, which end the batch and are stored as they are
+static void
+test_nan(const char *test)
+{
+float series[1000];
+float output[1000];
+double series_double[1000];
+double output_double[1000];
+uint8_t array[8192];
+
+	for (int i = 0; i < 1000; i++)
+		series[i] = 5.0 + i * 0.001;
+	series[4] = NAN;
+	series[37] = NAN;
+	series[500] = NAN;
+	series[501] = NAN;
+	for (int i = 0; i < 1000; i++)
+		series_double[i] = series[i];
+
+	if (ac_compress_float_into(NULL, 1000, ACCURACY_HALF_PERCENT, series, array, sizeof(array)) == 0
+			|| ac_decompress_float_into(NULL, (compressed_array) array, output, 1000) != 0) {
+		fail(test, "single precision compression failed", 0);
+		return;
+	}
+
+	if (ac_compress_double_into(NULL, 1000, ACCURACY_HALF_PERCENT, series_double, array, sizeof(array)) == 0
+			|| ac_decompress_double_into(NULL, (compressed_array) array, output_double, 1000) != 0) {
+		fail(test, "double precision compression failed", 0);
+		return;
+	}
+
+	// The numbers that are not a number are left out of the error
+	for (int i = 0; i < 1000; i++) {
+		if (!isnan(series[i]) != !isnan(output[i]) || !isnan(series[i]) != !isnan(output_double[i])) {
+			fail(test, "not a number changed", i);
+			return;
+		}
+
+		if (isnan(series[i]))
+			series[i] = output[i] = output_double[i] = 0.0;
+	}
+
+	check_values(test, 1000, series, output);
+
+	for (int i = 0; i < 1000; i++)
+		output[i] = output_double[i];
+	check_values(test, 1000, series, output);
+}
+
+// The instruction sets that AC_SIMD limits the kernels to, the kernels of
+// the first one are the scalar kernels the others are compared with
+static const char *simd_limits[] = { "none", "sse4.1", "avx2", "avx512" };
+
+// Compresses a series in every precision and writes the arrays to the
+// standard output. Returns 0 on success, -1 in case of error. This is done
+// by roundTrip run with the argument kernels, after AC_SIMD has chosen the
+// kernels of the process
+static int
+write_kernel_arrays(void)
+{
+static const uint8_t precisions[] = { PRECISION_SINGLE, PRECISION_DOUBLE, PRECISION_HALF, PRECISION_BFLOAT16 };
+typed_series typed;
+float *series;
+uint8_t *array;
+size_t capacity;
+size_t size;
+
+	capacity = compress_bound(KERNEL_SERIES_SIZE, PRECISION_DOUBLE);
+	series = malloc(KERNEL_SERIES_SIZE * sizeof(float));
+	array = malloc(capacity);
+	if (series == NULL || array == NULL) {
+		fprintf(stderr, "Could not allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Spikes and numbers that are not a number end batches in every
+	// lane of the vectors
+	srand(2);
+	make_walk(KERNEL_SERIES_SIZE, series);
+	for (uint64_t i = 0; i < KERNEL_SERIES_SIZE; i += 61)
+		series[i] *= 4.0;
+	for (uint64_t i = 5; i < KERNEL_SERIES_SIZE; i += 997)
+		series[i] = NAN;
+
+	for (size_t p = 0; p < sizeof(precisions) / sizeof(precisions[0]); p++) {
+		make_typed(precisions[p], KERNEL_SERIES_SIZE, series, &typed);
+		size = compress_values(NULL, &typed, KERNEL_SERIES_SIZE, array, capacity);
+		free_typed(&typed);
+		if (size == 0 || fwrite(array, 1, size, stdout) != size)
+			return (-1);
+	}
+
+	free(series);
+	free(array);
+
+	return 0;
+}
+
+// Runs command and reads its standard output into the buffer. Returns 0
+// on success, -1 if the command fails
+static int
+read_command(const char *command, byte_buffer *buffer)
+{
+uint8_t data[65536];
+FILE *file;
+size_t count;
+
+	file = popen(command, "r");
+	if (file == NULL)
+		return (-1);
+
+	while ((count = fread(data, 1, sizeof(data), file)) > 0) {
+		if (write_frame(buffer, data, count) != 0) {
+			fprintf(stderr, "Could not allocate memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return pclose(file) == 0 ? 0 : (-1);
+}
+
+// Runs the program with AC_SIMD set to every instruction set in turn, and
+// checks that the kernels of each one give the same arrays byte for byte,
+// that is the same batches and the same buckets, as the scalar kernels.
+// An instruction set the processor does not have falls back to a narrower
+// one, and is compared all the same
+static void
+test_kernels(const char *test, const char *program)
+{
+char command[1024];
+byte_buffer scalar;
+byte_buffer simd;
+size_t i;
+
+	memset(&scalar, 0, sizeof(scalar));
+	snprintf(command, sizeof(command), "AC_SIMD=%s '%s' kernels", simd_limits[0], program);
+	if (read_command(command, &scalar) != 0) {
+		fail(test, "compression with the scalar kernels failed", 0);
+		free(scalar.data);
+		return;
+	}
+
+	for (size_t l = 1; l < sizeof(simd_limits) / sizeof(simd_limits[0]); l++) {
+		memset(&simd, 0, sizeof(simd));
+		snprintf(command, sizeof(command), "AC_SIMD=%s '%s' kernels", simd_limits[l], program);
+		if (read_command(command, &simd) != 0) {
+			printf("%s: AC_SIMD=%s\n", test, simd_limits[l]);
+			fail(test, "compression failed", 0);
+			free(simd.data);
+			continue;
+		}
+
+		for (i = 0; i < scalar.size && i < simd.size; i++) {
+			if (scalar.data[i] != simd.data[i])
+				break;
+		}
+		if (i < scalar.size || i < simd.size) {
+			printf("%s: AC_SIMD=%s differs from the scalar kernels at byte %llu\n", 
+				test, simd_limits[l], (unsigned long long) i);
+			failures++;
+		}
+
+		free(simd.data);
+	}
+
+	free(scalar.data);
+}
+
+int
+main(int argc, char **argv)
+{
+static const uint8_t precisions[] = { PRECISION_SINGLE, PRECISION_DOUBLE, PRECISION_HALF, PRECISION_BFLOAT16 };
+static const uint64_t once_counts[] = { 1, 2, 3, 1000, 2187, SERIES_SIZE };
+ac_context *ctx;
+ac_context *threaded_ctx;
+float *walk;
+float *level;
+typed_series typed;
+char test[100];
+
+	if (argc == 2 && strcmp(argv[1], "kernels") == 0)
+		exit(write_kernel_arrays() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+
+	srand(1);
+
+	walk = malloc(SERIES_SIZE * sizeof(float));
+	level = malloc(LARGE_SIZE * sizeof(float));
+	ctx = ac_context_create();
+	threaded_ctx = ac_context_create();
+	if (walk == NULL || level == NULL || ctx == NULL || threaded_ctx == NULL) {
+		fprintf(stderr, "Could not allocate memory\n");
+		exit(EXIT_FAILURE);
+	}
+	ac_context_set_threads(threaded_ctx, 4);
+
+	make_walk(SERIES_SIZE, walk);
+	make_level(LARGE_SIZE, level);
+
+	// An empty array takes numbers of both signs, the level series
+	// starts with one short batch of unencoded numbers or with one
+	// encoded batch which is reopened. The large level series starts
+	// with more than one chunk, so that it is compressed in parallel
+	for (size_t p = 0; p < sizeof(precisions) / sizeof(precisions[0]); p++) {
+		make_typed(precisions[p], SERIES_SIZE, walk, &typed);
+		for (size_t c = 0; c < sizeof(once_counts) / sizeof(once_counts[0]); c++) {
+			snprintf(test, sizeof(test), "append %llu numbers of precision %d at once",
+				(unsigned long long) once_counts[c], precisions[p]);
+			test_append_once(test, NULL, &typed, once_counts[c]);
+			test_append_once(test, threaded_ctx, &typed, once_counts[c]);
+		}
+		snprintf(test, sizeof(test), "append to an empty array of precision %d", precisions[p]);
+		test_append(test, NULL, &typed, 0);
+		free_typed(&typed);
+
+		make_typed(precisions[p], SERIES_SIZE, level, &typed);
+		snprintf(test, sizeof(test), "append to an unencoded tail of precision %d", precisions[p]);
+		test_append(test, ctx, &typed, 2);
+		snprintf(test, sizeof(test), "append to an open batch of precision %d", precisions[p]);
+		test_append(test, ctx, &typed, 100);
+		free_typed(&typed);
+
+		make_typed(precisions[p], LARGE_SIZE, level, &typed);
+		snprintf(test, sizeof(test), "append to a parallel array of precision %d", precisions[p]);
+		test_append(test, threaded_ctx, &typed, LARGE_SIZE / 2);
+		free_typed(&typed);
+	}
+
+	test_stream("stream and reader", SERIES_SIZE, walk);
+
+	test_nan("not a number within a batch");
+
+	test_range("range without index", NULL, SERIES_SIZE, walk);
+	ac_context_set_index(ctx, 1);
+	ac_context_set_checkpoints(ctx, 64);
+	test_range("range with index and checkpoints", ctx, SERIES_SIZE, walk);
+
+	test_kernels("SIMD kernels", argv[0]);
+
+	ac_context_free(ctx);
+	ac_context_free(threaded_ctx);
+	free(walk);
+	free(level);
+
+	if (failures != 0) {
+		printf("%d checks failed\n", failures);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("All checks passed\n");
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "segment.h"
+#include "cpuFeatures.h"
+#include "halfFloat.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define DEBUG 0
+
+// Command to compile: gcc -std=gnu99 -c segment.c
+
+// This file contains the search for the end of a batch. A batch is a
+// sequence of numbers such that the maximum is less than 2 X minimum.
+// A batch ends before the first number which
+//	- is larger than the maximum so far and at least 2 X minimum so far
+//	- is smaller than the minimum so far and at most 0.5 X maximum so far
+//	- is not a number, which can not be bucketized and is stored in a
+//	  batch of its own
+// The minimum and maximum so far start with the first number of the batch
+// which is not 0.0. The number 0.0 never ends a batch and never changes
+// the minimum or maximum.
+// The sign of the numbers is stored apart, batches are made of the
+// magnitudes (absolute values) of the numbers.
+
+// Lane i of the result is lane i - n of v, the first n lanes are fill
+#define SHIFT_LANES_PS(v, fill, n, ...) \
+	_mm256_blend_ps(_mm256_permutevar8x32_ps((v), _mm256_setr_epi32(__VA_ARGS__)), (fill), (1 << (n)) - 1)
+#define SHIFT_LANES_PD(v, fill, n, shuffle) \
+	_mm256_blend_pd(_mm256_permute4x64_pd((v), (shuffle)), (fill), (1 << (n)) - 1)
+
+#define ELEM float
+#define VALUE float
+#define ELEM_NAME(name) name##_float
+#define ELEM_LOAD(p) fabsf(*(p))
+#define AVX2_TARGET "avx2"
+#define HAS_AVX2() cpu_has_avx2()
+#define VEC __m256
+#define VEC_LOAD(p) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_loadu_ps(p))
+#define VEC_LANES 8
+#define VEC_OP(op) _mm256_##op##_ps
+#define VEC_SHIFT_1(v, fill) SHIFT_LANES_PS(v, fill, 1, 0, 0, 1, 2, 3, 4, 5, 6)
+#define VEC_SHIFT_2(v, fill) SHIFT_LANES_PS(v, fill, 2, 0, 0, 0, 1, 2, 3, 4, 5)
+#define VEC_SHIFT_4(v, fill) SHIFT_LANES_PS(v, fill, 4, 0, 0, 0, 0, 0, 1, 2, 3)
+#define VEC_SCAN_MAX(v, fill) scan_max_ps(v, fill)
+#define VEC_SCAN_MIN(v, fill) scan_min_ps(v, fill)
+#define VEC_LAST(v) _mm256_permutevar8x32_ps((v), _mm256_set1_epi32(7))
+#define VEC_FIRST(v) _mm256_cvtss_f32(v)
+
+#if HAVE_X86_SIMD
+__attribute__((target("avx2"), always_inline))
+static inline __m256
+scan_max_ps(__m256 v, __m256 fill)
+{
+	v = _mm256_max_ps(v, VEC_SHIFT_1(v, fill));
+	v = _mm256_max_ps(v, VEC_SHIFT_2(v, fill));
+	return _mm256_max_ps(v, VEC_SHIFT_4(v, fill));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256
+scan_min_ps(__m256 v, __m256 fill)
+{
+	v = _mm256_min_ps(v, VEC_SHIFT_1(v, fill));
+	v = _mm256_min_ps(v, VEC_SHIFT_2(v, fill));
+	return _mm256_min_ps(v, VEC_SHIFT_4(v, fill));
+}
+#endif
+
+#include "segmentKernels.h"
+
+#undef ELEM
+#undef ELEM_NAME
+#undef ELEM_LOAD
+#undef AVX2_TARGET
+#undef HAS_AVX2
+#undef VEC_LOAD
+
+// Half precision and bfloat16 numbers are compared in single precision,
+// the AVX2 kernels convert 8 numbers at a time as they are loaded
+
+#define ELEM uint16_t
+#define ELEM_NAME(name) name##_half
+#define ELEM_LOAD(p) half_to_float(*(p) & 0x7fff)
+#define AVX2_TARGET "avx2,f16c"
+#define HAS_AVX2() (cpu_has_avx2() && cpu_has_f16c())
+#define VEC_LOAD(p) _mm256_cvtph_ps(_mm_and_si128(_mm_loadu_si128((__m128i *) (p)), _mm_set1_epi16(0x7fff)))
+
+#include "segmentKernels.h"
+
+#undef ELEM_NAME
+#undef ELEM_LOAD
+#undef AVX2_TARGET
+#undef HAS_AVX2
+#undef VEC_LOAD
+
+#define ELEM_NAME(name) name##_bfloat16
+#define ELEM_LOAD(p) bfloat16_to_float(*(p) & 0x7fff)
+#define AVX2_TARGET "avx2"
+#define HAS_AVX2() cpu_has_avx2()
+#define VEC_LOAD(p) _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32( \
+			_mm_and_si128(_mm_loadu_si128((__m128i *) (p)), _mm_set1_epi16(0x7fff))), 16))
+
+#include "segmentKernels.h"
+
+#undef ELEM
+#undef VALUE
+#undef ELEM_NAME
+#undef ELEM_LOAD
+#undef AVX2_TARGET
+#undef HAS_AVX2
+#undef VEC
+#undef VEC_LOAD
+#undef VEC_LANES
+#undef VEC_OP
+#undef VEC_SHIFT_1
+#undef VEC_SHIFT_2
+#undef VEC_SHIFT_4
+#undef VEC_SCAN_MAX
+#undef VEC_SCAN_MIN
+#undef VEC_LAST
+#undef VEC_FIRST
+
+#define ELEM double
+#define VALUE double
+#define ELEM_NAME(name) name##_double
+#define ELEM_LOAD(p) fabs(*(p))
+#define AVX2_TARGET "avx2"
+#define HAS_AVX2() cpu_has_avx2()
+#define VEC __m256d
+#define VEC_LOAD(p) _mm256_andnot_pd(_mm256_set1_pd(-0.0), _mm256_loadu_pd(p))
+#define VEC_LANES 4
+#define VEC_OP(op) _mm256_##op##_pd
+#define VEC_SHIFT_1(v, fill) SHIFT_LANES_PD(v, fill, 1, _MM_SHUFFLE(2, 1, 0, 0))
+#define VEC_SHIFT_2(v, fill) SHIFT_LANES_PD(v, fill, 2, _MM_SHUFFLE(1, 0, 0, 0))
+#define VEC_SCAN_MAX(v, fill) scan_max_pd(v, fill)
+#define VEC_SCAN_MIN(v, fill) scan_min_pd(v, fill)
+#define VEC_LAST(v) _mm256_permute4x64_pd((v), _MM_SHUFFLE(3, 3, 3, 3))
+#define VEC_FIRST(v) _mm256_cvtsd_f64(v)
+
+#if HAVE_X86_SIMD
+__attribute__((target("avx2"), always_inline))
+static inline __m256d
+scan_max_pd(__m256d v, __m256d fill)
+{
+	v = _mm256_max_pd(v, VEC_SHIFT_1(v, fill));
+	return _mm256_max_pd(v, VEC_SHIFT_2(v, fill));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256d
+scan_min_pd(__m256d v, __m256d fill)
+{
+	v = _mm256_min_pd(v, VEC_SHIFT_1(v, fill));
+	return _mm256_min_pd(v, VEC_SHIFT_2(v, fill));
+}
+#endif
+
+#include "segmentKernels.h"
+
+// The function segment_batch scans count numbers that follow the first
+// number of a batch which is not 0.0. On input max and min hold the
+// magnitude of that number, on return they hold the maximum and minimum
+// magnitude of the batch. Returns the number of scanned numbers that
+// belong to the batch, count if the batch does not end within them
+uint32_t
+segment_batch(uint32_t count, float *input, float *max, float *min)
+{
+uint32_t batch_end;
+
+	batch_end = get_segment_kernel_float()(count, input, max, min);
+
+	if (DEBUG)
+		printf("segment_batch: batch ends after %d of %d numbers, max = %.9f, min = %.9f\n", 
+				batch_end, count, *max, *min);
+
+	return batch_end;
+}
+
+// Same as segment_batch for double precision numbers
+uint32_t
+segment_batch_double(uint32_t count, double *input, double *max, double *min)
+{
+uint32_t batch_end;
+
+	batch_end = get_segment_kernel_double()(count, input, max, min);
+
+	if (DEBUG)
+		printf("segment_batch_double: batch ends after %d of %d numbers, max = %.17g, min = %.17g\n", 
+				batch_end, count, *max, *min);
+
+	return batch_end;
+}
+
+// Same as segment_batch for half precision numbers, the maximum and
+// minimum are single precision
+uint32_t
+segment_batch_half(uint32_t count, uint16_t *input, float *max, float *min)
+{
+	return get_segment_kernel_half()(count, input, max, min);
+}
+
+// Same as segment_batch for bfloat16 numbers
+uint32_t
+segment_batch_bfloat16(uint32_t count, uint16_t *input, float *max, float *min)
+{
+	return get_segment_kernel_bfloat16()(count, input, max, min);
+}
@@ -0,0 +1,8 @@
+#include <stdint.h>
+
+/* Function declarations */
+
+uint32_t segment_batch(uint32_t count, float *input, float *max, float *min);
+uint32_t segment_batch_double(uint32_t count, double *input, double *max, double *min);
+uint32_t segment_batch_half(uint32_t count, uint16_t *input, float *max, float *min);
+uint32_t segment_batch_bfloat16(uint32_t count, uint16_t *input, float *max, float *min);
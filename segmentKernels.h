@@ -0,0 +1,155 @@
+// Batch boundary scan kernels for one element type. This file has no
+// include guard, segment.c includes it once for each element type
+// (float, double, half and bfloat16), after defining
+//	ELEM		the element type as stored
+//	VALUE		the type the elements are compared in
+//	ELEM_NAME(name)	the name of a function for this element type
+//	ELEM_LOAD(p)	the magnitude of the element at p as a VALUE
+//	AVX2_TARGET	the target attribute of the AVX2 kernel
+//	HAS_AVX2()	1 if the processor can run the AVX2 kernel
+//	VEC		the AVX2 vector type, VEC_LANES elements wide
+//	VEC_LOAD(p)	the magnitudes of VEC_LANES elements at p as a VEC
+//	VEC_OP(op)	the AVX2 intrinsic of operation op for this type
+//	VEC_SHIFT_1(v, fill)	lane i is lane i - 1 of v, lane 0 is fill
+//	VEC_SCAN_MAX(v, fill)	lane i is the maximum of lanes 0 .. i of v
+//	VEC_SCAN_MIN(v, fill)	lane i is the minimum of lanes 0 .. i of v
+//	VEC_LAST(v)	all lanes are the last lane of v
+//	VEC_FIRST(v)	the first lane of v as a scalar
+
+static uint32_t
+ELEM_NAME(segment_batch_scalar)(uint32_t count, ELEM *input, VALUE *p_max, VALUE *p_min)
+{
+VALUE max;
+VALUE min;
+VALUE val;
+uint32_t i;
+
+	max = *p_max;
+	min = *p_min;
+
+	for (i = 0; i < count; i++) {
+		val = ELEM_LOAD(input + i);
+		if (val == 0.0)
+			continue;
+
+		// A number that is not a number can not be bucketized
+		if (isnan(val))
+			break;
+
+		if (val > max) {
+			if (val >= 2.0 * min)
+				break;
+			max = val;
+		}
+		if (val < min) {
+			if (val <= 0.5 * max)
+				break;
+			min = val;
+		}
+	}
+
+	*p_max = max;
+	*p_min = min;
+	return i;
+}
+
+#if HAVE_X86_SIMD
+// Processes VEC_LANES numbers at a time. The maximum and minimum before
+// each lane are computed with a prefix scan seeded with the running values,
+// every lane is then checked at once and a movemask gives the first lane
+// that ends the batch. 2 X min and x + x <= max are exact and give the same
+// answers as the scalar comparisons
+__attribute__((target(AVX2_TARGET)))
+static uint32_t
+ELEM_NAME(segment_batch_avx2)(uint32_t count, ELEM *input, VALUE *p_max, VALUE *p_min)
+{
+VEC run_max;
+VEC run_min;
+VEC neg_inf;
+VEC pos_inf;
+VEC zero;
+VEC val;
+VEC skip_lanes;
+VEC nan_lanes;
+VEC scan_max;
+VEC scan_min;
+VEC prev_max;
+VEC prev_min;
+VEC end_lanes;
+int mask;
+int lane;
+VALUE lane_max[VEC_LANES];
+VALUE lane_min[VEC_LANES];
+uint32_t i;
+
+	neg_inf = VEC_OP(set1)(-INFINITY);
+	pos_inf = VEC_OP(set1)(INFINITY);
+	zero = VEC_OP(setzero)();
+	run_max = VEC_OP(set1)(*p_max);
+	run_min = VEC_OP(set1)(*p_min);
+
+	for (i = 0; i + VEC_LANES <= count; i += VEC_LANES) {
+		val = VEC_LOAD(input + i);
+
+		// 0.0 and numbers that are not a number are left out of the
+		// scan, a number that is not a number ends the batch
+		skip_lanes = VEC_OP(cmp)(val, zero, _CMP_EQ_UQ);
+		nan_lanes = VEC_OP(cmp)(val, val, _CMP_UNORD_Q);
+		scan_max = VEC_SCAN_MAX(VEC_OP(blendv)(val, neg_inf, skip_lanes), neg_inf);
+		scan_min = VEC_SCAN_MIN(VEC_OP(blendv)(val, pos_inf, skip_lanes), pos_inf);
+
+		// Maximum and minimum of the numbers before each lane
+		prev_max = VEC_OP(max)(run_max, VEC_SHIFT_1(scan_max, neg_inf));
+		prev_min = VEC_OP(min)(run_min, VEC_SHIFT_1(scan_min, pos_inf));
+
+		end_lanes = VEC_OP(and)(VEC_OP(cmp)(val, prev_max, _CMP_GT_OQ), 
+				VEC_OP(cmp)(val, VEC_OP(add)(prev_min, prev_min), _CMP_GE_OQ));
+		end_lanes = VEC_OP(or)(end_lanes, VEC_OP(and)(VEC_OP(cmp)(val, prev_min, _CMP_LT_OQ), 
+					VEC_OP(cmp)(VEC_OP(add)(val, val), prev_max, _CMP_LE_OQ)));
+		end_lanes = VEC_OP(or)(VEC_OP(andnot)(skip_lanes, end_lanes), nan_lanes);
+
+		mask = VEC_OP(movemask)(end_lanes);
+		if (mask) {
+			lane = __builtin_ctz(mask);
+			VEC_OP(storeu)(lane_max, prev_max);
+			VEC_OP(storeu)(lane_min, prev_min);
+			*p_max = lane_max[lane];
+			*p_min = lane_min[lane];
+			return i + lane;
+		}
+
+		run_max = VEC_OP(max)(run_max, VEC_LAST(scan_max));
+		run_min = VEC_OP(min)(run_min, VEC_LAST(scan_min));
+	}
+
+	*p_max = VEC_FIRST(run_max);
+	*p_min = VEC_FIRST(run_min);
+
+	return i + ELEM_NAME(segment_batch_scalar)(count - i, input + i, p_max, p_min);
+}
+#endif
+
+typedef uint32_t (*ELEM_NAME(segment_kernel))(uint32_t count, ELEM *input, VALUE *max, VALUE *min);
+
+static ELEM_NAME(segment_kernel) ELEM_NAME(segment_kernel_chosen);
+static pthread_once_t ELEM_NAME(segment_kernel_once) = PTHREAD_ONCE_INIT;
+
+static void
+ELEM_NAME(choose_segment_kernel)(void)
+{
+	ELEM_NAME(segment_kernel_chosen) = ELEM_NAME(segment_batch_scalar);
+#if HAVE_X86_SIMD
+	if (HAS_AVX2())
+		ELEM_NAME(segment_kernel_chosen) = ELEM_NAME(segment_batch_avx2);
+#endif
+}
+
+// The AVX2 kernel if the processor supports it, chosen once on first use,
+// by whichever thread gets there first
+static ELEM_NAME(segment_kernel)
+ELEM_NAME(get_segment_kernel)(void)
+{
+	pthread_once(&ELEM_NAME(segment_kernel_once), ELEM_NAME(choose_segment_kernel));
+
+	return ELEM_NAME(segment_kernel_chosen);
+}
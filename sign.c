@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bitUtils.h"
+#include "sign.h"
+#include "approximateCompression_internal.h"
+
+#define DEBUG 0
+
+// Command to compile: gcc -std=gnu99 -c sign.c
+//
+// This file contains the coding of the signs of a batch. Batches are made
+// of the magnitudes of the numbers, the signs of a batch of an array that
+// has negative numbers follow the encoded magnitudes. The first byte tells
+// how the signs are stored
+//
+//	SIGN_POSITIVE		all numbers are positive, nothing follows
+//	SIGN_NEGATIVE		all numbers are negative, nothing follows
+//	SIGN_RUNS_POSITIVE	the lengths of runs of numbers of the same sign,
+//	SIGN_RUNS_NEGATIVE	the first run is positive or negative, the signs
+//				of the runs alternate. A length is a varint, see
+//				bitUtils.c
+//	SIGN_BITMAP		one bit per number, set if it is negative, in
+//				the bit order of write_bitstream
+//
+// Runs are chosen unless the bitmap is smaller. Series that seldom cross
+// zero take a few bytes per batch
+
+// Returns 1 if element i of the array has its sign bit set
+static inline int
+sign_bit(void *input, uint8_t precision, size_t i)
+{
+	if (precision == PRECISION_SINGLE)
+		return ((uint32_t *) input)[i] >> 31;
+	else if (precision == PRECISION_DOUBLE)
+		return ((uint64_t *) input)[i] >> 63;
+	else // PRECISION_HALF or PRECISION_BFLOAT16
+		return ((uint16_t *) input)[i] >> 15;
+}
+
+// Returns 1 if some number of the array has its sign bit set, 0 otherwise
+int
+sign_any_negative(uint64_t count, void *input, uint8_t precision)
+{
+uint32_t any;
+
+	any = 0;
+	for (uint64_t i = 0; i < count; i++)
+		any |= sign_bit(input, precision, i);
+
+	return any;
+}
+
+// Writes the signs of count numbers of the array input to output, which
+// must have space for 1 + (count + 7) / 8 bytes. Returns the number of
+// bytes written
+uint32_t
+sign_encode(uint32_t count, void *input, uint8_t precision, uint8_t *output)
+{
+uint32_t run_count;
+uint32_t runs_size;
+uint32_t bitmap_size;
+uint32_t run_start;
+uint8_t *ptr;
+int first;
+int sign;
+int prev;
+
+	first = sign_bit(input, precision, 0);
+
+	// Size of the runs, all but the last run are counted in the loop
+	run_count = 1;
+	runs_size = 0;
+	run_start = 0;
+	prev = first;
+	for (uint32_t i = 1; i < count; i++) {
+		sign = sign_bit(input, precision, i);
+		if (sign != prev) {
+			runs_size += varint_size(i - run_start);
+			run_start = i;
+			run_count++;
+			prev = sign;
+		}
+	}
+	runs_size += varint_size(count - run_start);
+
+	if (run_count == 1) {
+		*output = first ? SIGN_NEGATIVE : SIGN_POSITIVE;
+		return 1;
+	}
+
+	bitmap_size = (count + 7) / 8;
+
+	if (DEBUG)
+		printf("sign_encode: %d numbers, %d runs, %d bytes of runs\n", count, run_count, runs_size);
+
+	if (bitmap_size < runs_size) {
+		*output++ = SIGN_BITMAP;
+		memset(output, 0, bitmap_size);
+		for (uint32_t i = 0; i < count; i++)
+			output[i / 8] |= sign_bit(input, precision, i) << (i % 8);
+
+		return 1 + bitmap_size;
+	}
+
+	*output = first ? SIGN_RUNS_NEGATIVE : SIGN_RUNS_POSITIVE;
+	ptr = output + 1;
+
+	run_start = 0;
+	prev = first;
+	for (uint32_t i = 1; i < count; i++) {
+		sign = sign_bit(input, precision, i);
+		if (sign != prev) {
+			ptr = put_varint(ptr, i - run_start);
+			run_start = i;
+			prev = sign;
+		}
+	}
+	ptr = put_varint(ptr, count - run_start);
+
+	return ptr - output;
+}
+
+// Negates count numbers of the array output starting with element start
+static void
+negate(uint8_t *output, uint8_t precision, uint32_t start, uint32_t count)
+{
+	if (precision == PRECISION_SINGLE) {
+		for (uint32_t i = start; i < start + count; i++)
+			((float *) output)[i] = -((float *) output)[i];
+	} else if (precision == PRECISION_DOUBLE) {
+		for (uint32_t i = start; i < start + count; i++)
+			((double *) output)[i] = -((double *) output)[i];
+	} else { // PRECISION_HALF or PRECISION_BFLOAT16
+		for (uint32_t i = start; i < start + count; i++)
+			((uint16_t *) output)[i] ^= 0x8000;
+	}
+}
+
+// Reads the signs of count numbers written by sign_encode and negates the
+// negative numbers of the array output, which holds the magnitudes in the
+// precision output_precision. The signs must end before input_end. Returns
+// the number of bytes read, -1 in case of error
+int
+sign_decode(uint32_t count, uint8_t *input, uint8_t *input_end, uint8_t *output, uint8_t output_precision)
+{
+uint8_t *ptr;
+uint64_t length;
+uint32_t done;
+int negative;
+
+	if (input >= input_end)
+		return (-1);
+
+	ptr = input;
+
+	switch (*ptr++) {
+	case SIGN_POSITIVE:
+		break;
+
+	case SIGN_NEGATIVE:
+		negate(output, output_precision, 0, count);
+		break;
+
+	case SIGN_BITMAP:
+		if (input_end - ptr < (count + 7) / 8)
+			return (-1);
+
+		for (uint32_t i = 0; i < count; i++) {
+			if ((ptr[i / 8] >> (i % 8)) & 1)
+				negate(output, output_precision, i, 1);
+		}
+		ptr += (count + 7) / 8;
+		break;
+
+	case SIGN_RUNS_POSITIVE:
+	case SIGN_RUNS_NEGATIVE:
+		negative = (*input == SIGN_RUNS_NEGATIVE);
+		for (done = 0; done < count; done += length) {
+			ptr = get_varint(ptr, input_end, &length);
+			if (ptr == NULL || length == 0 || length > count - done) {
+				if (DEBUG)
+					printf("sign_decode: bad run at %d of %d\n", done, count);
+				return (-1);
+			}
+
+			if (negative)
+				negate(output, output_precision, done, length);
+			negative = !negative;
+		}
+		break;
+
+	default:
+		return (-1);
+	}
+
+	return ptr - input;
+}
+
+// Returns the sign bit of element index of the count numbers whose signs
+// are read as by sign_decode, -1 in case of error
+int
+sign_get(uint32_t count, uint8_t *input, uint8_t *input_end, uint32_t index)
+{
+uint8_t *ptr;
+uint64_t length;
+uint32_t done;
+int negative;
+
+	if (input >= input_end || index >= count)
+		return (-1);
+
+	ptr = input;
+
+	switch (*ptr++) {
+	case SIGN_POSITIVE:
+		return 0;
+
+	case SIGN_NEGATIVE:
+		return 1;
+
+	case SIGN_BITMAP:
+		if (input_end - ptr < (count + 7) / 8)
+			return (-1);
+
+		return (ptr[index / 8] >> (index % 8)) & 1;
+
+	case SIGN_RUNS_POSITIVE:
+	case SIGN_RUNS_NEGATIVE:
+		negative = (*input == SIGN_RUNS_NEGATIVE);
+		for (done = 0; done < count; done += length) {
+			ptr = get_varint(ptr, input_end, &length);
+			if (ptr == NULL || length == 0 || length > count - done)
+				return (-1);
+
+			if (index < done + length)
+				return negative;
+			negative = !negative;
+		}
+		return (-1);
+
+	default:
+		return (-1);
+	}
+}
+
+// Returns the number of bytes of the signs of count numbers written by
+// sign_encode, -1 in case of error
+int
+sign_size(uint32_t count, uint8_t *input, uint8_t *input_end)
+{
+uint8_t *ptr;
+uint64_t length;
+uint32_t done;
+
+	if (input >= input_end)
+		return (-1);
+
+	ptr = input;
+
+	switch (*ptr++) {
+	case SIGN_POSITIVE:
+	case SIGN_NEGATIVE:
+		break;
+
+	case SIGN_BITMAP:
+		if (input_end - ptr < (count + 7) / 8)
+			return (-1);
+
+		ptr += (count + 7) / 8;
+		break;
+
+	case SIGN_RUNS_POSITIVE:
+	case SIGN_RUNS_NEGATIVE:
+		for (done = 0; done < count; done += length) {
+			ptr = get_varint(ptr, input_end, &length);
+			if (ptr == NULL || length == 0 || length > count - done)
+				return (-1);
+		}
+		break;
+
+	default:
+		return (-1);
+	}
+
+	return ptr - input;
+}
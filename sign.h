@@ -0,0 +1,16 @@
+#include <stdint.h>
+
+// The first byte of the signs of a batch, see sign.c
+#define SIGN_POSITIVE		0
+#define SIGN_NEGATIVE		1
+#define SIGN_RUNS_POSITIVE	2
+#define SIGN_RUNS_NEGATIVE	3
+#define SIGN_BITMAP		4
+
+/* Function declarations */
+
+int sign_any_negative(uint64_t count, void *input, uint8_t precision);
+uint32_t sign_encode(uint32_t count, void *input, uint8_t precision, uint8_t *output);
+int sign_decode(uint32_t count, uint8_t *input, uint8_t *input_end, uint8_t *output, uint8_t output_precision);
+int sign_get(uint32_t count, uint8_t *input, uint8_t *input_end, uint32_t index);
+int sign_size(uint32_t count, uint8_t *input, uint8_t *input_end);
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "approximateCompression_internal.h"
+#include "context.h"
+
+#define DEBUG 0
+
+// Command to compile: gcc -std=gnu99 -c stream.c
+
+// This file contains the streaming compressor. The numbers pushed to a
+// stream are kept until they fill a frame, which is then compressed as a
+// complete array and written out. A frame starts new batches, the header
+// of its array is written once its numbers are known. The memory of a
+// stream is bounded by the size of a frame, however many numbers go
+// through it. A stream is the frames one after the other, a reader finds
+// the next frame with get_compressed_length
+
+// Default number of elements of a frame, as many as the command line
+// tools used to read at a time
+#define DEFAULT_FRAME_SIZE 65536
+
+struct ac_stream {
+	ac_context *ctx;	// Compresses the frames
+	ac_context *own_ctx;	// Created by the stream, NULL if ctx was given
+	uint8_t precision;
+	uint8_t accuracy;
+	size_t value_size;	// Size in bytes of one number
+	uint64_t frame_size;	// Number of elements of a full frame
+	ac_stream_write write;	// NULL if the frames are kept in output
+	void *opaque;
+	ac_arena values;	// Numbers of the open frame
+	uint64_t value_count;
+	ac_arena frame;		// The compressed frame being written
+	ac_arena output;	// Frames not yet taken, if write is NULL
+	size_t output_size;
+	int finished;
+	int status;		// -1 once an error occurred
+};
+
+// Size in bytes of one number of the precision, 0 if it is not valid
+static size_t
+value_size(uint8_t precision)
+{
+	switch (precision) {
+	case PRECISION_SINGLE:
+		return sizeof(float);
+	case PRECISION_DOUBLE:
+		return sizeof(double);
+	case PRECISION_HALF:
+	case PRECISION_BFLOAT16:
+		return sizeof(uint16_t);
+	default:
+		return 0;
+	}
+}
+
+// Creates a stream of numbers of the precision, compressed with the
+// accuracy in frames of frame_size numbers, DEFAULT_FRAME_SIZE if 0. The
+// frames are compressed using ctx, which may be NULL, so that its options
+// apply. A frame is passed to write, which returns 0 on success, or kept
+// until taken with ac_stream_output if write is NULL. Returns NULL in
+// case of error
+ac_stream *
+ac_stream_init(ac_context *ctx, uint8_t precision, uint8_t accuracy, uint64_t frame_size, ac_stream_write write, 
+		void *opaque)
+{
+ac_stream *stream;
+
+	if (value_size(precision) == 0)
+		return NULL;
+
+	stream = calloc(1, sizeof(ac_stream));
+	if (stream == NULL) {
+		if (DEBUG)
+			printf("Internal error at file %s line %d: memory allocation failed\n",  __FILE__, __LINE__);
+		return NULL;
+	}
+
+	if (ctx == NULL) {
+		ctx = stream->own_ctx = ac_context_create();
+		if (ctx == NULL) {
+			free(stream);
+			return NULL;
+		}
+	}
+
+	stream->ctx = ctx;
+	stream->precision = precision;
+	stream->accuracy = accuracy;
+	stream->value_size = value_size(precision);
+	stream->frame_size = frame_size ? frame_size : DEFAULT_FRAME_SIZE;
+	stream->write = write;
+	stream->opaque = opaque;
+
+	return stream;
+}
+
+// Compresses count numbers of the stream as a frame and writes it out.
+// Returns 0 on success, -1 in case of error
+static int
+write_frame(ac_stream *stream, void *values, uint64_t count)
+{
+uint8_t *frame;
+uint8_t *output;
+size_t bound;
+size_t size;
+
+	bound = compress_bound(count, stream->precision);
+	frame = arena_reserve(&stream->frame, bound);
+	if (frame == NULL)
+		return (-1);
+
+	size = context_compress_into(stream->ctx, count, stream->precision, stream->accuracy, values, frame, bound);
+	if (size == 0)
+		return (-1);
+
+	if (stream->write != NULL) {
+		if (stream->write(stream->opaque, frame, size) != 0) {
+			if (DEBUG)
+				printf("Frame of %llu numbers could not be written\n", (unsigned long long) count);
+			return (-1);
+		}
+
+		return 0;
+	}
+
+	output = arena_grow(&stream->output, stream->output_size + size);
+	if (output == NULL)
+		return (-1);
+
+	memcpy(output + stream->output_size, frame, size);
+	stream->output_size += size;
+
+	return 0;
+}
+
+// Appends count numbers to the stream. Full frames are written out, the
+// numbers of frames pushed at once are compressed without being copied.
+// Returns 0 on success, -1 in case of error
+int
+ac_stream_push(ac_stream *stream, void *values, uint64_t count)
+{
+uint8_t *buffer;
+uint64_t n;
+
+	if (stream->status != 0 || stream->finished)
+		return (-1);
+
+	while (count > 0) {
+		if (stream->value_count == 0 && count >= stream->frame_size) {
+			if (write_frame(stream, values, stream->frame_size) != 0)
+				return (stream->status = (-1));
+
+			values = (uint8_t *) values + stream->frame_size * stream->value_size;
+			count -= stream->frame_size;
+			continue;
+		}
+
+		buffer = arena_grow(&stream->values, stream->frame_size * stream->value_size);
+		if (buffer == NULL)
+			return (stream->status = (-1));
+
+		n = stream->frame_size - stream->value_count;
+		if (n > count)
+			n = count;
+
+		memcpy(buffer + stream->value_count * stream->value_size, values, n * stream->value_size);
+		stream->value_count += n;
+		values = (uint8_t *) values + n * stream->value_size;
+		count -= n;
+
+		if (stream->value_count == stream->frame_size) {
+			if (write_frame(stream, buffer, stream->value_count) != 0)
+				return (stream->status = (-1));
+			stream->value_count = 0;
+		}
+	}
+
+	return 0;
+}
+
+// Writes out the numbers pushed since the last frame as a frame of their
+// own, if there are any. Returns 0 on success, -1 in case of error
+int
+ac_stream_flush(ac_stream *stream)
+{
+	if (stream->status != 0)
+		return (-1);
+
+	if (stream->value_count == 0)
+		return 0;
+
+	if (write_frame(stream, stream->values.base, stream->value_count) != 0)
+		return (stream->status = (-1));
+
+	stream->value_count = 0;
+
+	return 0;
+}
+
+// Writes out the last frame, no number may be pushed afterwards. Returns
+// 0 on success, -1 in case of error
+int
+ac_stream_finish(ac_stream *stream)
+{
+	if (ac_stream_flush(stream) != 0)
+		return (-1);
+
+	stream->finished = 1;
+
+	return 0;
+}
+
+// Returns the frames written since the last call and sets size to their
+// size in bytes, if the stream has no write function. The frames remain
+// valid until the next call using the stream
+uint8_t *
+ac_stream_output(ac_stream *stream, size_t *size)
+{
+	*size = stream->output_size;
+	stream->output_size = 0;
+
+	return stream->output.base;
+}
+
+void
+ac_stream_free(ac_stream *stream)
+{
+	if (stream == NULL)
+		return;
+
+	free(stream->values.base);
+	free(stream->frame.base);
+	free(stream->output.base);
+	ac_context_free(stream->own_ctx);
+	free(stream);
+}
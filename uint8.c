@@ -3,9 +3,11 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "bitUtils.h"
 #include "uint8.h"
+#include "bucket.h"
 
 #define DEBUG 0
 
@@ -62,1494 +64,870 @@
 //    Encoding 0, 110, 10, 11100, 11101, 111100, 111101, 1111100, 1111101, 1111110XXXX, 1111111XXXX
 // 18: delta values 0, +1, -1, +2, -2, +3, -3, +4 .. +10, -4 .. -10, +11 .. +26, -11 .. -26
 //    Encoding 000, 001, 010, 011, 100, 101, 110, 1110XXX, 1111XXX, 1110111XXXX, 1111111XXXX
+//
+// An encode key with ENCODE_KEY_ZEROS set is used for an array that has
+// ZERO_BUCKET elements. The encoded data then starts with the lengths of
+// the runs of elements which are and are not ZERO_BUCKET, as varints. The
+// runs alternate, the first one has no ZERO_BUCKET element and may be
+// empty. The deltas are taken between the other elements only
+//
+// If the array is encoded with checkpoints, every checkpoint_interval-th
+// element which is not ZERO_BUCKET, counting from 0, has a checkpoint. It
+// holds the bit offset of the code of the element, relative to the first
+// code, as uint32_t and the element before it as uint8_t. The checkpoints
+// precede the runs and the first element, which has none. A single element
+// is decoded starting with the checkpoint before it instead of the first
+// element. If the array has ZERO_BUCKET elements, the checkpoints are
+// preceded by the size in bytes of the runs and the number of elements
+// which are not ZERO_BUCKET as varints. A checkpoint then also holds the
+// position of the element, the offset of the length of its run from the
+// first run and the position of the first element of the run as uint32_t,
+// so that the runs are read from the run of the checkpoint on
 
 #define DELTA_HIGH 26
 
-//
-//  Input:
-// 	len, buf: length and location of the array that has to be encoded.
-// 	encode_key: Decides the encoding strategy to be used
-// 	Output:
-// 	encoded buffer: The encoded is returned at the location pointed by
-// 	encoded_buff. First two bytes contain the length followed by encoded
-// 	bits. In case of any error, the length is set to zero. It is the 
-// 	responsibility of the caller to provide space for the buffer and free it.
-//
-// Calls a number of lower level functions for doing the actual encoding
-void
-uint8_encode(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf)
+// Each encode key uses a prefix code for the delta between successive
+// bucket numbers. A code is described by its bits, stored in the order
+// they appear in the bit stream (bit 0 first, the same convention used
+// by write_bitstream), and the delta it represents. Codes with the XXX
+// or XXXX suffix are followed by extra_bits bits of payload, the delta
+// is then delta + payload (delta - payload when delta is negative)
+typedef struct {
+	uint16_t bits;
+	uint8_t length;
+	uint8_t extra_bits;
+	int8_t delta;
+} uint8_code;
+
+#define MAX_CODES_PER_KEY 24
+
+static int
+add_code(uint8_code *codes, int code_count, uint16_t bits, uint8_t length, int8_t delta, uint8_t extra_bits)
+{
+	codes[code_count].bits = bits;
+	codes[code_count].length = length;
+	codes[code_count].extra_bits = extra_bits;
+	codes[code_count].delta = delta;
+
+	return code_count + 1;
+}
+
+// Fills up codes with the prefix codes used by encode_key, see the
+// explanation of encode key values at the top of this file
+// Returns the number of codes, 0 if the encode key is invalid
+static int
+uint8_codes(uint8_t encode_key, uint8_code *codes)
 {
+int n;
+int sign;
+
+	n = 0;
+
+	if (encode_key == 18) {
+		// 18: Encoding 000, 001, 010, 011, 100, 101, 110, 1110XXX, 1111XXX, 1110111XXXX, 1111111XXXX
+		n = add_code(codes, n, 0b000, 3, 0, 0);
+		n = add_code(codes, n, 0b100, 3, 1, 0);
+		n = add_code(codes, n, 0b010, 3, -1, 0);
+		n = add_code(codes, n, 0b110, 3, 2, 0);
+		n = add_code(codes, n, 0b001, 3, -2, 0);
+		n = add_code(codes, n, 0b101, 3, 3, 0);
+		n = add_code(codes, n, 0b011, 3, -3, 0);
+
+		// XXX = 111 is reserved for the longer codes 1110111XXXX and 1111111XXXX
+		for (int i = 0; i < 7; i++) {
+			n = add_code(codes, n, 0b0111 | (i << 4), 7, 4 + i, 0);
+			n = add_code(codes, n, 0b1111 | (i << 4), 7, -(4 + i), 0);
+		}
+
+		n = add_code(codes, n, 0b1110111, 7, 11, 4);
+		n = add_code(codes, n, 0b1111111, 7, -11, 4);
+		return n;
+	}
+
+	if (encode_key < 1 || encode_key > 17)
+		return 0;
+
+	// Append 0
+	n = add_code(codes, n, 0b0, 1, 0, 0);
+
+	if (encode_key == 1) {
+		// Append 10 and 11
+		n = add_code(codes, n, 0b01, 2, 1, 0);
+		n = add_code(codes, n, 0b11, 2, -1, 0);
+		return n;
+	}
+
+	// Even keys are used when count of +1 > count of -1 and encode +1 as 10,
+	// odd keys encode -1 as 10
+	sign = (encode_key % 2 == 0) ? 1 : (-1);
+
+	// Append 10 and 110
+	n = add_code(codes, n, 0b01, 2, sign, 0);
+	n = add_code(codes, n, 0b011, 3, -sign, 0);
+
 	switch(encode_key){
-		case  1: 
-		case  2: 
-		case  3: uint8_encode_1_2_3(encode_key, len, buf, encoded_buf);
-				return;
-		case  4: 
-		case  5: uint8_encode_4_5(encode_key, len, buf, encoded_buf);
-				return;
+		case  2:
+		case  3: // Append 1110 and 1111
+				n = add_code(codes, n, 0b0111, 4, 2, 0);
+				n = add_code(codes, n, 0b1111, 4, -2, 0);
+				break;
+		case  4:
+		case  5: // Append 11100, 11101, 11110 and 11111
+				n = add_code(codes, n, 0b00111, 5, 2, 0);
+				n = add_code(codes, n, 0b10111, 5, -2, 0);
+				n = add_code(codes, n, 0b01111, 5, 3, 0);
+				n = add_code(codes, n, 0b11111, 5, -3, 0);
+				break;
 		case  6:
-		case  7:
-		case  8: 
-		case  9: uint8_encode_6_7_8_9(encode_key, len, buf, encoded_buf);
-				return;
+		case  7: // Append 11100, 11101, 111100, 111101, 111110 and 111111
+				n = add_code(codes, n, 0b00111, 5, 2, 0);
+				n = add_code(codes, n, 0b10111, 5, -2, 0);
+				n = add_code(codes, n, 0b001111, 6, 3, 0);
+				n = add_code(codes, n, 0b101111, 6, -3, 0);
+				n = add_code(codes, n, 0b011111, 6, 4, 0);
+				n = add_code(codes, n, 0b111111, 6, -4, 0);
+				break;
+		case  8:
+		case  9: // Append 11100, 11101, 111100, 111101, 1111100, 1111101, 1111110 and 1111111
+				n = add_code(codes, n, 0b00111, 5, 2, 0);
+				n = add_code(codes, n, 0b10111, 5, -2, 0);
+				n = add_code(codes, n, 0b001111, 6, 3, 0);
+				n = add_code(codes, n, 0b101111, 6, -3, 0);
+				n = add_code(codes, n, 0b0011111, 7, 4, 0);
+				n = add_code(codes, n, 0b1011111, 7, -4, 0);
+				n = add_code(codes, n, 0b0111111, 7, 5, 0);
+				n = add_code(codes, n, 0b1111111, 7, -5, 0);
+				break;
 		case 10:
 		case 11:
-		case 12: 
-		case 13: uint8_encode_10_11_12_13(encode_key, len, buf, encoded_buf);
-				return;
+		case 12:
+		case 13: // Append 11100, 11101, 11110XX and 11111XX (XXX for 12 and 13)
+				n = add_code(codes, n, 0b00111, 5, 2, 0);
+				n = add_code(codes, n, 0b10111, 5, -2, 0);
+				n = add_code(codes, n, 0b01111, 5, 3, (encode_key < 12) ? 2 : 3);
+				n = add_code(codes, n, 0b11111, 5, -3, (encode_key < 12) ? 2 : 3);
+				break;
 		case 14:
 		case 15:
-		case 16: 
-		case 17: uint8_encode_14_15_16_17(encode_key, len, buf, encoded_buf);
-				return;
-		case 18: uint8_encode_18(encode_key, len, buf, encoded_buf);
-				return;
-		default: 
-				printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
-				// Set the length to zero to indicate that error happened
-				encoded_buf[0] = 0;
-				encoded_buf[1] = 0;
-				return;
-		}
+		case 16:
+		case 17: // Append 11100, 11101, 111100, 111101, 1111100, 1111101,
+				 // 1111110XXX and 1111111XXX (XXXX for 16 and 17)
+				n = add_code(codes, n, 0b00111, 5, 2, 0);
+				n = add_code(codes, n, 0b10111, 5, -2, 0);
+				n = add_code(codes, n, 0b001111, 6, 3, 0);
+				n = add_code(codes, n, 0b101111, 6, -3, 0);
+				n = add_code(codes, n, 0b0011111, 7, 4, 0);
+				n = add_code(codes, n, 0b1011111, 7, -4, 0);
+				n = add_code(codes, n, 0b0111111, 7, 5, (encode_key < 16) ? 3 : 4);
+				n = add_code(codes, n, 0b1111111, 7, -5, (encode_key < 16) ? 3 : 4);
+				break;
+	}
+
+	return n;
 }
 
-// RESOLVE: Lot of duplication in the uint8_encode_XXXX functions,
-// needs to be cleaned up later
+// The encoder looks up the code for a delta in a table built for the
+// encode key. The payload of the XXX or XXXX codes is part of the table
+// entry, so every delta is appended with a single bit_writer_put
+typedef struct {
+	uint16_t bits;
+	uint8_t length;
+	uint8_t unused;
+} encode_entry;
+
+static encode_entry encode_table[MAX_ENCODE_KEY + 1][2 * DELTA_HIGH + 1];
+static pthread_once_t encode_tables_once = PTHREAD_ONCE_INIT;
 
-// Encode input buffer when the encode key is 1 | 2 | 3
-void
-uint8_encode_1_2_3(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf)
+static void
+build_encode_table(uint8_t encode_key)
 {
-uint32_t encoded_buf_idx;
-uint16_t encoded_buf_len;
-uint8_t *final_encoded_buf;
-uint64_t value;
-int16_t delta;
-uint16_t *p_val16;
-
-	// Set the length of encoded buffer uint16_t to zero
-	// Will be filled up later with correct values
-	encoded_buf[0] = 0;
-	encoded_buf[1] = 0;
-
-	// Set the following byte with the first bucket value
-	encoded_buf[2] = buf[0];
-
-	encoded_buf_idx = 24; // Points to the next bit position 
-
-	// 2: delta values 0, +1, -1, +2, -2 [count of +1 > count of -1]
-	//    Encoding 0, 10, 110, 1110, 1111
-	// 3: delta values 0, +1, -1, +2, -2 [count of -1 > count of +1]
-	//    Encoding 0, 110, 10, 1110, 1111
-
-	for (int i = 1; i < len; i++) {
-		delta = buf[i] - buf[i - 1];
-		switch(delta){
-			case 0: // Append 0
-					clear_bit(encoded_buf, encoded_buf_idx);
-					encoded_buf_idx++;
-					break;
-			case 1: 
-					if (encode_key == 1 || encode_key == 2) {
-						// Append 10
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						clear_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					} else { 
-						// encode_key == 3
-						// Append 110
-						value = 0b011;
-						write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-						encoded_buf_idx += 3;
-					}
-					break;
-			case (-1): 
-					if (encode_key == 1) {
-						// Append 10
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					} else if (encode_key == 2) {
-						// Append 110
-						value = 0b011;
-						write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-						encoded_buf_idx += 3;
-					} else {
-						// encode_key == 3
-						// Append 01
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						clear_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					}
-					break;
-			case 2: // Append bits 1110
-					value = 0b0111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 4, value);
-					encoded_buf_idx += 4;
-					break;
-			case (-2): // Append bits 1111
-					value = 0b1111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 4, value);
-					encoded_buf_idx += 4;
-					break;
-			default: 
-					printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
-					return;
+uint8_code codes[MAX_CODES_PER_KEY];
+encode_entry *table;
+int code_count;
+int payload;
+int delta;
+
+	// Deltas without a code keep length zero
+	table = encode_table[encode_key];
+	memset(table, 0, (2 * DELTA_HIGH + 1) * sizeof(encode_entry));
+
+	code_count = uint8_codes(encode_key, codes);
+
+	for (int c = 0; c < code_count; c++) {
+		for (payload = 0; payload < (1 << codes[c].extra_bits); payload++) {
+			delta = (codes[c].delta < 0) ? codes[c].delta - payload : codes[c].delta + payload;
+			table[delta + DELTA_HIGH].bits = codes[c].bits | (payload << codes[c].length);
+			table[delta + DELTA_HIGH].length = codes[c].length + codes[c].extra_bits;
 		}
 	}
+}
 
-	if (DEBUG)
-		printf("Encoded bit count = %d\n", encoded_buf_idx);
+// The tables of all the encode keys are built once, on first use by any
+// thread
+static void
+build_encode_tables(void)
+{
+	for (uint8_t encode_key = 1; encode_key <= MAX_ENCODE_KEY; encode_key++)
+		build_encode_table(encode_key);
+}
 
-	// Check whether the last byte of encoded_buf is partially filled
-	// and clear the unfilled portion 
-	while ((encoded_buf_idx % 8) != 0) {
-		clear_bit(encoded_buf, encoded_buf_idx);
-		encoded_buf_idx++;
+// Writes the lengths of the runs of ZERO_BUCKET elements and of other
+// elements, starting with a run of other elements. Returns the position
+// after the lengths
+static uint8_t *
+put_zero_runs(uint8_t *ptr, uint32_t len, uint8_t *buf)
+{
+uint32_t run_start;
+int zero;
+
+	zero = 0;
+	run_start = 0;
+	for (uint32_t i = 0; i < len; i++) {
+		if ((buf[i] == ZERO_BUCKET) != zero) {
+			ptr = put_varint(ptr, i - run_start);
+			run_start = i;
+			zero = !zero;
+		}
 	}
+	ptr = put_varint(ptr, len - run_start);
 
-	encoded_buf_len = encoded_buf_idx / 8;
+	return ptr;
+}
 
-	if (DEBUG)
-		printf("Encoded buffer length = %d\n", encoded_buf_len);
+// Number of bytes of the lengths written by put_zero_runs
+static uint32_t
+zero_runs_size(uint32_t len, uint8_t *buf)
+{
+uint32_t run_start;
+uint32_t size;
+int zero;
+
+	zero = 0;
+	run_start = 0;
+	size = 0;
+	for (uint32_t i = 0; i < len; i++) {
+		if ((buf[i] == ZERO_BUCKET) != zero) {
+			size += varint_size(i - run_start);
+			run_start = i;
+			zero = !zero;
+		}
+	}
+	size += varint_size(len - run_start);
 
-	// Patch the first word with the length of the buffer
-	p_val16 = (uint16_t *) encoded_buf;
-	*p_val16 = encoded_buf_len;
+	return size;
 }
 
-// Encode input buffer when the encode key is 4 | 5 
-void
-uint8_encode_4_5(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf)
+//
+//  Input:
+// 	len, buf: length and location of the array that has to be encoded.
+// 	encode_key: Decides the encoding strategy to be used
+// 	checkpoint_interval: distance between checkpoints, 0 for none
+// 	Output:
+// 	encoded buffer: The encoded bits are written at the location pointed
+// 	by encoded_buf, starting with the first element. It is the 
+// 	responsibility of the caller to provide space for the buffer and free it.
+//
+//  Returns:
+//  The number of bytes written, 0 in case of error
+//
+// All encode keys share the same table driven encoder
+uint32_t
+uint8_encode(uint8_t encode_key, uint32_t len, uint8_t *buf, uint8_t *encoded_buf, uint32_t checkpoint_interval)
 {
-uint32_t encoded_buf_idx;
-uint16_t encoded_buf_len;
-uint8_t *final_encoded_buf;
-uint64_t value;
-int16_t delta;
-uint16_t *p_val16;
-
-	// Set the length of encoded buffer uint16_t to zero
-	// Will be filled up later with correct values
-	encoded_buf[0] = 0;
-	encoded_buf[1] = 0;
-
-	// Set the following byte with the first bucket value
-	encoded_buf[2] = buf[0];
-
-	encoded_buf_idx = 24; // Points to the next bit position 
-
-	// 4: delta values 0, +1, -1, +2, -2, +3, -3 [count of +1 >= count of -1]
-	//    Encoding 0, 10, 110, 11100, 11101, 11110, 11111
-	// 5: delta values 0, +1, -1, +2, -2, +3, -3 [count of -1 > count of +1]
-	//    Encoding 0, 110, 10, 11100, 11101, 11110, 11111
-
-	for (int i = 1; i < len; i++) {
-		delta = buf[i] - buf[i - 1];
-		switch(delta){
-			case 0: clear_bit(encoded_buf, encoded_buf_idx);
-					encoded_buf_idx++;
-					break;
-			case 1: 
-					if (encode_key == 4) {
-						// Append 10
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						clear_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					} else { 
-						// encode_key == 5
-						// Append 110
-						value = 0b011;
-						write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-						encoded_buf_idx += 3;
-					}
-					break;
-			case (-1): 
-					if (encode_key == 4) {
-						// Append 110
-						value = 0b011;
-						write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-						encoded_buf_idx += 3;
-					} else {
-						// encode_key == 5
-						// Append 10
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						clear_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					}
-					break;
-			case 2: // Append bits 11100
-					value = 0b00111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 5, value);
-					encoded_buf_idx += 5;
-					break;
-			case (-2): // Append bits 11101
-					value = 0b10111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 5, value);
-					encoded_buf_idx += 5;
-					break;
-			case 3: // Append bits 11110
-					value = 0b01111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 5, value);
-					encoded_buf_idx += 5;
-					break;
-			case (-3): // Append bits 11111
-					value = 0b11111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 5, value);
-					encoded_buf_idx += 5;
-					break;
-			default: 
-					printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
-					return;
+encode_entry *table;
+encode_entry entry;
+bit_writer bw;
+uint8_t *ptr;
+uint8_t *checkpoint;
+uint32_t checkpoint_size;
+uint32_t encoded_buf_len;
+uint32_t nonzero_count;
+uint32_t bit_offset;
+uint32_t run_offset;
+uint32_t run_start;
+uint32_t first;
+uint32_t n;
+uint8_t prev;
+int zeros;
+int zero;
+int delta;
+
+	zeros = encode_key & ENCODE_KEY_ZEROS;
+	encode_key &= ~ENCODE_KEY_ZEROS;
+
+	if (encode_key == 0 || encode_key > MAX_ENCODE_KEY) {
+		printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
+		return 0;
+	}
+
+	pthread_once(&encode_tables_once, build_encode_tables);
+
+	table = encode_table[encode_key];
+
+	ptr = encoded_buf;
+	nonzero_count = len;
+	checkpoint_size = CHECKPOINT_SIZE;
+	if (zeros) {
+		nonzero_count = 0;
+		for (uint32_t i = 0; i < len; i++)
+			nonzero_count += (buf[i] != ZERO_BUCKET);
+
+		if (checkpoint_interval != 0) {
+			ptr = put_varint(ptr, zero_runs_size(len, buf));
+			ptr = put_varint(ptr, nonzero_count);
+			checkpoint_size = ZERO_CHECKPOINT_SIZE;
 		}
 	}
 
-	if (DEBUG)
-		printf("Encoded bit count = %d\n", encoded_buf_idx);
+	// Room for the checkpoints, which are filled in as the codes are
+	// written
+	checkpoint = ptr;
+	ptr += uint8_checkpoint_count(nonzero_count, checkpoint_interval) * checkpoint_size;
+
+	if (zeros)
+		ptr = put_zero_runs(ptr, len, buf);
+
+	// Set the following byte with the first bucket value, there is
+	// none if all the elements are ZERO_BUCKET
+	if (nonzero_count > 0) {
+		first = 0;
+		while (zeros && buf[first] == ZERO_BUCKET)
+			first++;
+
+		prev = buf[first];
+		*ptr++ = prev;
+
+		bit_writer_init(&bw, ptr);
+
+		// n is the number of elements which are not ZERO_BUCKET
+		// encoded so far. The run of element i starts with element
+		// run_start, its length is run_offset bytes after the first
+		// run, as written by put_zero_runs
+		n = 1;
+		zero = 0;
+		run_start = 0;
+		run_offset = 0;
+		for (uint32_t i = 0; i < len; i++) {
+			if (zeros && (buf[i] == ZERO_BUCKET) != zero) {
+				run_offset += varint_size(i - run_start);
+				run_start = i;
+				zero = !zero;
+			}
+
+			if (i <= first || (zeros && buf[i] == ZERO_BUCKET))
+				continue;
 
-	// Check whether the last byte of encoded_buf is partially filled
-	// and clear the unfilled portion 
-	while ((encoded_buf_idx % 8) != 0) {
-		clear_bit(encoded_buf, encoded_buf_idx);
-		encoded_buf_idx++;
+			if (checkpoint_interval != 0 && n % checkpoint_interval == 0) {
+				bit_offset = bit_writer_position(&bw);
+				memcpy(checkpoint, &bit_offset, sizeof(uint32_t));
+				checkpoint[sizeof(uint32_t)] = prev;
+				if (zeros) {
+					memcpy(checkpoint + CHECKPOINT_SIZE, &i, sizeof(uint32_t));
+					memcpy(checkpoint + CHECKPOINT_SIZE + sizeof(uint32_t), &run_offset, sizeof(uint32_t));
+					memcpy(checkpoint + CHECKPOINT_SIZE + 2 * sizeof(uint32_t), &run_start, sizeof(uint32_t));
+				}
+				checkpoint += checkpoint_size;
+			}
+			n++;
+
+			delta = buf[i] - prev;
+			if (delta < -DELTA_HIGH || delta > DELTA_HIGH || table[delta + DELTA_HIGH].length == 0) {
+				// The encode key does not have a code for this delta
+				printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
+				return 0;
+			}
+
+			entry = table[delta + DELTA_HIGH];
+			bit_writer_put(&bw, entry.bits, entry.length);
+			prev = buf[i];
+		}
+
+		// The unfilled portion of the last byte is cleared
+		ptr += bit_writer_finish(&bw);
 	}
 
-	encoded_buf_len = encoded_buf_idx / 8;
+	encoded_buf_len = ptr - encoded_buf;
+
 	if (DEBUG)
 		printf("Encoded buffer length = %d\n", encoded_buf_len);
 
-	// Patch the first word with the length of the buffer
-	p_val16 = (uint16_t *) encoded_buf;
-	*p_val16 = encoded_buf_len;
+	return encoded_buf_len;
 }
 
-// Encode input buffer when the encode key is 6 | 7 | 8 | 9 
-void
-uint8_encode_6_7_8_9(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf)
+// The decoder looks up DECODE_TABLE_BITS bits of the bit stream at a time
+// in a table built for the encode key. Every code of every encode key has
+// a prefix of at most 7 bits, so a lookup always resolves the code. If the
+// code and its payload fit within DECODE_TABLE_BITS, the payload is resolved
+// by the table too, otherwise the entry is an escape and the payload is
+// read from the bits following the prefix
+#define DECODE_TABLE_BITS 8
+#define DECODE_TABLE_SIZE (1 << DECODE_TABLE_BITS)
+
+// sign is -1 when the payload is subtracted from delta, 0 otherwise
+typedef struct {
+	int8_t delta;
+	uint8_t length;
+	uint8_t extra_bits;
+	int8_t sign;
+} decode_entry;
+
+static decode_entry decode_table[MAX_ENCODE_KEY + 1][DECODE_TABLE_SIZE];
+static pthread_once_t decode_tables_once = PTHREAD_ONCE_INIT;
+
+// Number of deltas that can be decoded after a single refill of the
+// bit reader, depends on the longest code of the encode key
+static uint8_t decode_per_refill[MAX_ENCODE_KEY + 1];
+
+// Every table index whose low length bits match the code maps to the code
+static void
+fill_decode_entries(decode_entry *table, uint16_t bits, uint8_t length, int8_t delta, uint8_t extra_bits)
 {
-uint32_t encoded_buf_idx;
-uint16_t encoded_buf_len;
-uint8_t *final_encoded_buf;
-uint64_t value;
-int16_t delta;
-uint16_t *p_val16;
-
-	// Set the length of encoded buffer uint16_t to zero
-	// Will be filled up later with correct values
-	encoded_buf[0] = 0;
-	encoded_buf[1] = 0;
-
-	// Set the following byte with the first bucket value
-	encoded_buf[2] = buf[0];
-
-	encoded_buf_idx = 24; // Points to the next bit position 
-
-	// 6: delta values 0, +1, -1, +2, -2, +3, -3, +4, -4 [count of +1 > count of -1]
-	//    Encoding 0, 10, 110, 11100, 11101, 111100, 111101, 111110, 111111
-	// 7: delta values 0, +1, -1, +2, -2, +3, -3, +4, -4 [count of -1 > count of +1]
-	//    Encoding 0, 110, 10, 11100, 11101, 111100, 111101, 111110, 111111
-	// 8: delta values 0, +1, -1, +2, -2, +3, -3, +4, -4, +5, -5 [count of +1 > count of -1]
-	//    Encoding 0, 10, 110, 11100, 11101, 111100, 111101, 1111100, 1111101, 1111110, 1111111
-	// 9: delta values 0, +1, -1, +2, -2, +3, -3, +4, -4, +5, -5 [count of -1 > count of +1]
-	//    Encoding 0, 110, 10, 11100, 11101, 111100, 111101, 1111100, 1111101, 1111110, 1111111
-
-	for (int i = 1; i < len; i++) {
-		delta = buf[i] - buf[i - 1];
-		switch(delta){
-			case 0: clear_bit(encoded_buf, encoded_buf_idx);
-					encoded_buf_idx++;
-					break;
-			case 1: 
-					if (encode_key == 6 || encode_key ==8) {
-						// Append 10
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						clear_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					} else { 
-						// encode_key == 7 || encode_key == 9
-						// Append 110
-						value = 0b011;
-						write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-						encoded_buf_idx += 3;
-					}
-					break;
-			case (-1): 
-					if (encode_key == 6 || encode_key ==8) {
-						// Append 110
-						value = 0b011;
-						write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-						encoded_buf_idx += 3;
-					} else {
-						// encode_key == 7 || encode_key == 9
-						// Append 10
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						clear_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					}
-					break;
-			case 2: // Append bits 11100
-					value = 0b00111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 5, value);
-					encoded_buf_idx += 5;
-					break;
-			case (-2): // Append bits 11101
-					value = 0b10111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 5, value);
-					encoded_buf_idx += 5;
-					break;
-			case 3: // Append bits 111100
-					value = 0b001111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 6, value);
-					encoded_buf_idx += 6;
-					break;
-			case (-3): // Append bits 111101
-					value = 0b101111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 6, value);
-					encoded_buf_idx += 6;
-					break;
-			case 4: 
-					if (encode_key == 6 || encode_key == 7) {
-						// Append bits 111110
-						value = 0b011111;
-						write_bitstream(encoded_buf, encoded_buf_idx, 6, value);
-						encoded_buf_idx += 6;
-					} else {
-						// encode_key == 8 || encode_key == 9
-						// Append bits 1111100
-						value = 0b0011111;
-						write_bitstream(encoded_buf, encoded_buf_idx, 7, value);
-						encoded_buf_idx += 7;
-					}
-					break;
-			case (-4):
-					if (encode_key == 6 || encode_key == 7) {
-						// Append bits 111111
-						value = 0b111111;
-						write_bitstream(encoded_buf, encoded_buf_idx, 6, value);
-						encoded_buf_idx += 6;
-					} else {
-						// encode_key == 8 || encode_key == 9
-						// Append bits 1111101
-						value = 0b1011111;
-						write_bitstream(encoded_buf, encoded_buf_idx, 7, value);
-						encoded_buf_idx += 7;
-					}
-					break;
-			case 5: 
-					// Append bits 1111110
-					value = 0b0111111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 7, value);
-					encoded_buf_idx += 7;
-					break;
-			case -5: 
-					// Append bits 1111111
-					value = 0b1111111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 7, value);
-					encoded_buf_idx += 7;
-					break;
-			default: 
-					printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
-					return;
-		}
+	for (int i = bits; i < DECODE_TABLE_SIZE; i += (1 << length)) {
+		table[i].delta = delta;
+		table[i].length = length;
+		table[i].extra_bits = extra_bits;
+		table[i].sign = (delta < 0) ? (-1) : 0;
 	}
+}
 
-	if (DEBUG)
-		printf("Encoded bit count = %d\n", encoded_buf_idx);
+static void
+build_decode_table(uint8_t encode_key)
+{
+uint8_code codes[MAX_CODES_PER_KEY];
+decode_entry *table;
+int code_count;
+int max_length;
+int payload;
+int delta;
+
+	table = decode_table[encode_key];
+	memset(table, 0, DECODE_TABLE_SIZE * sizeof(decode_entry));
+
+	code_count = uint8_codes(encode_key, codes);
+	max_length = 1;
+
+	for (int c = 0; c < code_count; c++) {
+		if (codes[c].length + codes[c].extra_bits > max_length)
+			max_length = codes[c].length + codes[c].extra_bits;
+
+		if (codes[c].length + codes[c].extra_bits > DECODE_TABLE_BITS) {
+			fill_decode_entries(table, codes[c].bits, codes[c].length, codes[c].delta, codes[c].extra_bits);
+			continue;
+		}
 
-	// Check whether the last byte of encoded_buf is partially filled
-	// and clear the unfilled portion 
-	while ((encoded_buf_idx % 8) != 0) {
-		clear_bit(encoded_buf, encoded_buf_idx);
-		encoded_buf_idx++;
+		// Resolve the payload within the table
+		for (payload = 0; payload < (1 << codes[c].extra_bits); payload++) {
+			delta = (codes[c].delta < 0) ? codes[c].delta - payload : codes[c].delta + payload;
+			fill_decode_entries(table, codes[c].bits | (payload << codes[c].length), 
+					codes[c].length + codes[c].extra_bits, delta, 0);
+		}
 	}
 
-	encoded_buf_len = encoded_buf_idx / 8;
-	if (DEBUG)
-		printf("Encoded buffer length = %d\n", encoded_buf_len);
+	decode_per_refill[encode_key] = BIT_READER_MIN_BITS / max_length;
+}
 
-	// Patch the first word with the length of the buffer
-	p_val16 = (uint16_t *) encoded_buf;
-	*p_val16 = encoded_buf_len;
+// Same as build_encode_tables for the decode tables
+static void
+build_decode_tables(void)
+{
+	for (uint8_t encode_key = 1; encode_key <= MAX_ENCODE_KEY; encode_key++)
+		build_decode_table(encode_key);
 }
 
-// Encode input buffer when the encode key is 10 | 11 | 12 | 13 
-void
-uint8_encode_10_11_12_13(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf)
+// Decodes one delta, at least as many bits as the longest code of the
+// encode key must be available in the bit reader. The payload of an
+// escape is extracted without a branch, it is zero for other entries
+static inline int
+decode_delta(decode_entry *table, bit_reader *br)
 {
-uint32_t encoded_buf_idx;
-uint16_t encoded_buf_len;
-uint8_t *final_encoded_buf;
-uint64_t value;
-int16_t delta;
-uint16_t *p_val16;
-
-	// Set the length of encoded buffer uint16_t to zero
-	// Will be filled up later with correct values
-	encoded_buf[0] = 0;
-	encoded_buf[1] = 0;
-
-	// Set the following byte with the first bucket value
-	encoded_buf[2] = buf[0];
-
-	encoded_buf_idx = 24; // Points to the next bit position 
-
-	// 10: delta values 0, +1, -1, +2, -2, +3 .. +6, -3 .. -6 [count of +1 > count of -1]
-	//     Encoding 0, 10, 110, 11100, 11101, 11110XX, 11111XX
-	// 11: delta values 0, +1, -1, +2, -2, +3 .. +6, -3 .. -6 [count of -1 > count of +1]
-	//     Encoding 0, 110, 10, 11100, 11101, 11110XX, 11111XX
-	// 12: delta values 0, +1, -1, +2, -2, +3 .. +10, -3 .. -10 [count of +1 > count of -1]
-	//     Encoding 0, 10, 110, 11100, 11101, 11110XXX, 11111XXX
-	// 13: delta values 0, +1, -1, +2, -2, +3 .. +10, -3 .. -10 [count of -1 > count of +1]
-	//     Encoding 0, 110, 10, 11100, 11101, 11110XXXX, 11111XXXX
-
-	for (int i = 1; i < len; i++) {
-		delta = buf[i] - buf[i - 1];
-		switch(delta){
-			case 0: clear_bit(encoded_buf, encoded_buf_idx);
-					encoded_buf_idx++;
-					break;
-			case 1: 
-					if (encode_key == 10 || encode_key == 12) {
-						// Append 10
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						clear_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					} else { 
-						// encode_key == 11 or encode_key == 13
-						// Append 110
-						value = 0b011;
-						write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-						encoded_buf_idx += 3;
-					} 
-					break;
-			case (-1): 
-					if (encode_key == 10 || encode_key == 12) {
-						// Append 110
-						value = 0b011;
-						write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-						encoded_buf_idx += 3;
-					} else {
-						// encode_key == 11 or encode_key == 13
-						// Append 10
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						clear_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					}
-					break;
-			case 2: // Append 11100
-					value = 0b00111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 5, value);
-					encoded_buf_idx += 5;
-					break;
-			case (-2): // Append 11101
-					value = 0b10111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 5, value);
-					encoded_buf_idx += 5;
-					break;
-			default: 
-					if (encode_key == 10 || encode_key == 11) {
-						value = (delta > 0) ? 0b01111 : 0b11111;
-						value += (abs(delta) - 3) << 5;
-						write_bitstream(encoded_buf, encoded_buf_idx, 7, value);
-						encoded_buf_idx += 7;
-					} else {
-						// encode_key == 12 or encode_key == 13
-						value = (delta > 0) ? 0b01111 : 0b11111;
-						value += (abs(delta) - 3) << 5;
-						write_bitstream(encoded_buf, encoded_buf_idx, 8, value);
-						encoded_buf_idx += 8;
-					}
-					break;
-		}
-	}
+decode_entry entry;
+uint32_t payload;
 
-	if (DEBUG)
-		printf("Encoded bit count = %d\n", encoded_buf_idx);
+	entry = table[bit_reader_peek(br, DECODE_TABLE_BITS)];
+	payload = (br->buf >> entry.length) & ((1 << entry.extra_bits) - 1);
+	bit_reader_consume(br, entry.length + entry.extra_bits);
 
-	// Check whether the last byte of encoded_buf is partially filled
-	// and clear the unfilled portion 
-	while ((encoded_buf_idx % 8) != 0) {
-		clear_bit(encoded_buf, encoded_buf_idx);
-		encoded_buf_idx++;
-	}
+	return entry.delta + (((int) payload ^ entry.sign) - entry.sign);
+}
 
-	encoded_buf_len = encoded_buf_idx / 8;
-	if (DEBUG)
-		printf("Encoded buffer length = %d\n", encoded_buf_len);
+// Number of checkpoints of count elements which are not ZERO_BUCKET
+uint32_t
+uint8_checkpoint_count(uint32_t count, uint32_t checkpoint_interval)
+{
+	if (count == 0 || checkpoint_interval == 0)
+		return 0;
 
-	// Patch the first word with the length of the buffer
-	p_val16 = (uint16_t *) encoded_buf;
-	*p_val16 = encoded_buf_len;
+	return (count - 1) / checkpoint_interval;
 }
 
-// Encode input buffer when the encode key is 14 | 15 | 16 | 17 
-void
-uint8_encode_14_15_16_17(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf)
+// Decodes the first element and count - 1 deltas of the byte_count bytes
+// at encoded_buffer to decoded_buffer. Returns 0 on success, -1 if the
+// bytes run out
+static int
+decode_deltas(uint8_t encode_key, uint32_t count, uint8_t *encoded_buffer, uint32_t byte_count, uint8_t *decoded_buffer)
 {
-uint32_t encoded_buf_idx;
-uint16_t encoded_buf_len;
-uint8_t *final_encoded_buf;
-uint64_t value;
-int16_t delta;
-uint16_t *p_val16;
-
-	// Set the length of encoded buffer uint16_t to zero
-	// Will be filled up later with correct values
-	encoded_buf[0] = 0;
-	encoded_buf[1] = 0;
-
-	// Set the following byte with the first bucket value
-	encoded_buf[2] = buf[0];
-
-	encoded_buf_idx = 24; // Points to the next bit position 
-
-	// E: delta values 0, +1, -1, +2, -2, +3, -3, +4, -4, +5 .. +12, -5 .. -12 [count of +1 > count of -1]
-	//    Encoding 0, 10, 110, 11100, 11101, 111100, 111101, 1111100, 1111101, 1111110XXX, 1111111XXX
-	// F: delta values 0, +1, -1, +2, -2, +3, -3, +4, -4, +5 .. +12, -5 .. -12 [count of -1 > count of +1]
-	//    Encoding 0, 110, 10, 11100, 11101, 111100, 111101, 1111100, 1111101, 1111110XXX, 1111111XXX
-	// G: delta values 0, +1, -1, +2, -2, +3, -3, +4, -4, +5 .. +20, -5 .. -20 [count of +1 > count of -1]
-	//    Encoding 0, 10, 110, 11100, 11101, 111100, 111101, 1111100, 1111101, 1111110XXXX, 1111111XXXX
-	// H: delta values 0, +1, -1, +2, -2, +3, -3, +4, -4, +5 .. +20, -5 .. -20 [count of -1 > count of +1]
-	//    Encoding 0, 110, 10, 11100, 11101, 111100, 111101, 1111100, 1111101, 1111110XXXX, 1111111XXXX
-
-	for (int i = 1; i < len; i++) {
-		delta = buf[i] - buf[i - 1];
-		switch(delta){
-			case 0: clear_bit(encoded_buf, encoded_buf_idx);
-					encoded_buf_idx++;
-					break;
-			case 1: 
-					if (encode_key == 14 || encode_key == 16) {
-						// Append 10
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						clear_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					} else { 
-						// encode_key == 15 || encode_key == 17
-						// Append 110
-						value = 0b011;
-						write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-						encoded_buf_idx += 3;
-					}
-					break;
-			case (-1): 
-					if (encode_key == 14 || encode_key == 16) {
-						// Append 110
-						value = 0b011;
-						write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-						encoded_buf_idx += 3;
-					} else {
-						// encode_key == 15 || encode_key == 17
-						// Append 10
-						set_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-						clear_bit(encoded_buf, encoded_buf_idx);
-						encoded_buf_idx++;
-					}
-					break;
-			case 2: // Append 11100
-					value = 0b00111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 5, value);
-					encoded_buf_idx += 5;
-					break;
-			case (-2): // Append 11101
-					value = 0b10111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 5, value);
-					encoded_buf_idx += 5;
-					break;
-			case 3: // Append 111100
-					value = 0b001111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 6, value);
-					encoded_buf_idx += 6;
-					break;
-			case (-3): // Append 111101
-					value = 0b101111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 6, value);
-					encoded_buf_idx += 6;
-					break;
-			case 4: // Append 1111100
-					value = 0b0011111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 7, value);
-					encoded_buf_idx += 7;
-					break;
-			case (-4): // Append 1111101
-					value = 0b1011111;
-					write_bitstream(encoded_buf, encoded_buf_idx, 7, value);
-					encoded_buf_idx += 7;
-					break;
-			default: 
-					value = (delta > 0) ? 0b0111111 : 0b1111111;
-					if (encode_key == 14 || encode_key == 15) {
-						value += (abs(delta) - 5) << 7;
-						write_bitstream(encoded_buf, encoded_buf_idx, 10, value);
-						encoded_buf_idx += 10;
-					} else {
-						// encode_key == 16 || encode_key == 17
-						value += (abs(delta) - 5) << 7;
-						write_bitstream(encoded_buf, encoded_buf_idx, 11, value);
-						encoded_buf_idx += 11;
-					}
-
-					break;
+decode_entry *table;
+bit_reader br;
+uint8_t val;
+int per_refill;
+uint32_t i;
+
+	// The first element is not encoded
+	if (byte_count < 1)
+		return (-1);
+
+	pthread_once(&decode_tables_once, build_decode_tables);
+
+	table = decode_table[encode_key];
+	per_refill = decode_per_refill[encode_key];
+
+	val = *encoded_buffer;
+	decoded_buffer[0] = val;
+
+	bit_reader_init(&br, encoded_buffer + 1, byte_count - 1);
+
+	// Fast path, while at least 8 encoded bytes are left each refill is a
+	// single load and per_refill deltas are decoded without any bounds check
+	for (i = 1; count - i >= per_refill && bit_reader_can_refill_fast(&br); i += per_refill) {
+		bit_reader_refill_fast(&br);
+		for (int j = 0; j < per_refill; j++) {
+			val = val + decode_delta(table, &br);
+			decoded_buffer[i + j] = val;
 		}
 	}
 
-	if (DEBUG)
-		printf("Encoded bit count = %d\n", encoded_buf_idx);
-
-	// Check whether the last byte of encoded_buf is partially filled
-	// and clear the unfilled portion 
-	while ((encoded_buf_idx % 8) != 0) {
-		clear_bit(encoded_buf, encoded_buf_idx);
-		encoded_buf_idx++;
+	for (; i < count; i++) {
+		bit_reader_refill(&br);
+		val = val + decode_delta(table, &br);
+		decoded_buffer[i] = val;
 	}
 
-	encoded_buf_len = encoded_buf_idx / 8;
-	if (DEBUG)
-		printf("Encoded buffer length = %d\n", encoded_buf_len);
+	// Ran past the end of the encoded buffer, it must be corrupt
+	if (bit_reader_position(&br) > (uint64_t) (byte_count - 1) * 8) {
+		if (DEBUG)
+			printf("uint8_decode: decoded %d bits from %d bytes\n", 
+					(int) bit_reader_position(&br), byte_count - 1);
+		return (-1);
+	}
 
-	// Patch the first word with the length of the buffer
-	p_val16 = (uint16_t *) encoded_buf;
-	*p_val16 = encoded_buf_len;
+	return 0;
 }
 
-// Encode input buffer when the encode key is 18
-void
-uint8_encode_18(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf)
+// Reads the start of the encoded data of batch_size elements at ptr, up to
+// the runs or the first element. Sets checkpoints to the first checkpoint
+// and count to the number of checkpoints. The number of elements which are
+// not ZERO_BUCKET and the size of their runs are set if the array has
+// ZERO_BUCKET elements and checkpoints, otherwise they are not known before
+// the runs are read and nonzero_count is set to batch_size. Returns the
+// position after the checkpoints, NULL if they go past end
+static uint8_t *
+read_checkpoints(uint8_t *ptr, uint8_t *end, int zeros, uint32_t batch_size, uint32_t checkpoint_interval, 
+		uint8_t **checkpoints, uint32_t *count, uint64_t *runs_size, uint64_t *nonzero_count)
 {
-uint32_t encoded_buf_idx;
-uint16_t encoded_buf_len;
-uint8_t *final_encoded_buf;
-uint64_t value;
-int16_t delta;
-uint16_t *p_val16;
-
-	// Set the length of encoded buffer uint16_t to zero
-	// Will be filled up later with correct values
-	encoded_buf[0] = 0;
-	encoded_buf[1] = 0;
-
-	// Set the following byte with the first bucket value
-	encoded_buf[2] = buf[0];
-
-	encoded_buf_idx = 24; // Points to the next bit position 
-
-	// 18: delta values 0, +1, -1, +2, -2, +3, -3, +4 .. +10, -4 .. -10, +11 .. +27, -11 .. -27
-	//     Encoding 000, 001, 010, 011, 100, 101, 110, 1110XXX, 1111XXX, 1110111XXXX, 1111111XXXX
-
-	value = buf[0];
-
-	for (int i = 1; i < len; i++) {
-		delta = buf[i] - buf[i - 1];
-		switch(delta){
-			case 0: // Append 000
-					value = 0b000;
-					write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-					encoded_buf_idx += 3;
-					break;
-			case 1: // Append 001
-					value = 0b100;
-					write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-					encoded_buf_idx += 3;
-					break;
-			case (-1): // Append 010
-					value = 0b010;
-					write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-					encoded_buf_idx += 3;
-					break;
-			case 2: // Append 011
-					value = 0b110;
-					write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-					encoded_buf_idx += 3;
-					break;
-			case (-2): // Append 100
-					value = 0b001;
-					write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-					encoded_buf_idx += 3;
-					break;
-			case 3: // Append 101
-					value = 0b101;
-					write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-					encoded_buf_idx += 3;
-					break;
-			case (-3): // Append 110
-					value = 0b011;
-					write_bitstream(encoded_buf, encoded_buf_idx, 3, value);
-					encoded_buf_idx += 3;
-					break;
-			case 4: case 5: case 6: case 7: case 8: case 9:
-			case 10: // Append 1110XXX
-					value = 0b0111;
-					value += (delta - 4) << 4;
-					write_bitstream(encoded_buf, encoded_buf_idx, 7, value);
-					encoded_buf_idx += 7;
-					break;
-			case (-4): case (-5): case (-6): case (-7): case (-8): case (-9):
-			case (-10): // Append 1111XXX
-					value = 0b1111;
-					value += ((-delta) - 4) << 4;
-					write_bitstream(encoded_buf, encoded_buf_idx, 7, value);
-					encoded_buf_idx += 7;
-					break;
-			case 11: case 12: case 13: case 14: case 15: case 16: case 17: case 18:
-			case 19: case 20: case 21: case 22: case 23: case 24: case 25: case 26:
-					// Append 1110111XXXX
-					value = 0b1110111;
-					value += (delta - 11) << 7;
-					write_bitstream(encoded_buf, encoded_buf_idx, 11, value);
-					encoded_buf_idx += 11;
-					break;
-			case (-11): case (-12): case (-13): case (-14): case (-15): case (-16): case (-17): case (-18):
-			case (-19): case (-20): case (-21): case (-22): case (-23): case (-24): case (-25): case (-26):
-					// Append 1111111XXXX
-					value = 0b1111111;
-					value += ((-delta) - 11) << 7;
-					write_bitstream(encoded_buf, encoded_buf_idx, 11, value);
-					encoded_buf_idx += 11;
-					break;
-			default: 
-					printf("Internal error: %s at line %d\n", __FILE__, __LINE__);
-					return;
-		}
-	}
+uint64_t size;
 
-	if (DEBUG)
-		printf("Encoded bit count = %d\n", encoded_buf_idx);
+	*nonzero_count = batch_size;
+	*runs_size = 0;
+	*count = 0;
+	*checkpoints = ptr;
+
+	if (checkpoint_interval == 0)
+		return ptr;
+
+	size = CHECKPOINT_SIZE;
+	if (zeros) {
+		ptr = get_varint(ptr, end, runs_size);
+		if (ptr != NULL)
+			ptr = get_varint(ptr, end, nonzero_count);
+		if (ptr == NULL || *nonzero_count > batch_size || *runs_size > end - ptr)
+			return NULL;
 
-	// Check whether the last byte of encoded_buf is partially filled
-	// and clear the unfilled portion 
-	while ((encoded_buf_idx % 8) != 0) {
-		clear_bit(encoded_buf, encoded_buf_idx);
-		encoded_buf_idx++;
+		size = ZERO_CHECKPOINT_SIZE;
 	}
 
-	encoded_buf_len = encoded_buf_idx / 8;
-	if (DEBUG)
-		printf("Encoded buffer length = %d\n", encoded_buf_len);
+	*checkpoints = ptr;
+	*count = uint8_checkpoint_count(*nonzero_count, checkpoint_interval);
+	size *= *count;
+	if (end - ptr < size)
+		return NULL;
 
-	// Patch the first word with the length of the buffer
-	p_val16 = (uint16_t *) encoded_buf;
-	*p_val16 = encoded_buf_len;
+	return ptr + size;
 }
 
 //
 //  Input:
-// 	encoded buffer: First two bytes contain the length of encoded bits
-// 	followed by encoded bits. 
+// 	encoded buffer: encoded_size bytes of encoded bits, as written by
+// 	uint8_encode
 // 	batch_size: number of elements in the encoded buffer
 // 	encode_key: contains the same key that was used to encode
+// 	checkpoint_interval: the same distance between checkpoints
 //
 // 	Output:
-// 	decoded buffer: 
-// 	First two bytes contain the length N followed by N floating point
-// 	numbers.
+// 	decoded buffer: batch_size bucket numbers
 //
 //  Returns:
 //  0: Decoding successful
 //  -1: Error
 //
-// Calls a number of lower level functions for doing the actual encoding
+// All encode keys share the same table driven decoder. The elements which
+// are not ZERO_BUCKET are decoded to the end of decoded_buffer, and then
+// moved to their place as the runs of ZERO_BUCKET are filled in. The
+// checkpoints are skipped
 int
-uint8_decode(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer)
+uint8_decode(uint8_t encode_key, uint32_t batch_size, uint8_t *encoded_buffer, uint32_t encoded_size, 
+		uint32_t checkpoint_interval, uint8_t *decoded_buffer)
 {
+uint8_t *ptr;
+uint8_t *end;
+uint8_t *runs;
+uint8_t *nonzero;
+uint8_t *checkpoints;
+uint32_t checkpoint_count;
+uint32_t nonzero_count;
+uint32_t done;
+uint64_t runs_size;
+uint64_t expected_count;
+uint64_t length;
+int zeros;
+int run;
+
 	if (DEBUG)
 		printf("uint8_decode: encode_key = %d\n", encode_key);
 
-	switch(encode_key){
-		case  1: 
-		case  2: 
-		case  3: return(uint8_decode_1_2_3(encode_key, batch_size, encoded_buffer, decoded_buffer));
-
-		case  4: 
-		case  5: return(uint8_decode_4_5(encode_key, batch_size, encoded_buffer, decoded_buffer));
-
-		case  6: 
-		case  7: 
-		case  8: 
-		case  9: return(uint8_decode_6_7_8_9(encode_key, batch_size, encoded_buffer, decoded_buffer));
-				
-		case 10: 
-		case 11: 
-		case 12: 
-		case 13: return(uint8_decode_10_11_12_13(encode_key, batch_size, encoded_buffer, decoded_buffer));
-				
-		case 14: 
-		case 15: 
-		case 16: 
-		case 17: return(uint8_decode_14_15_16_17(encode_key, batch_size, encoded_buffer, decoded_buffer));
-
-		case 18: return(uint8_decode_18(encode_key, batch_size, encoded_buffer, decoded_buffer));
-		
-		default: return (-1);
-	}
-}
+	zeros = encode_key & ENCODE_KEY_ZEROS;
+	encode_key &= ~ENCODE_KEY_ZEROS;
 
-// RESOLVE: Lot of duplication in the uint8_encode_XXXX functions,
-// needs to be cleaned up later
+	if (encode_key == 0 || encode_key > MAX_ENCODE_KEY)
+		return (-1);
 
-// Decode encoded buffer when the encode key is 1 | 2 | 3
-int
-uint8_decode_1_2_3(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer)
-{
-uint32_t encoded_buffer_idx;
-uint64_t val64;
-uint8_t val8;
-uint16_t *p_val16;
-uint16_t encoded_buffer_size;
-int delta;
-int val;
-
-	// Save the encoded length for diagnostics
-	p_val16 = (uint16_t *)encoded_buffer;
-	encoded_buffer_size = *p_val16++;
-	encoded_buffer = (uint8_t *)p_val16;
-
-	encoded_buffer_idx = 0;
-
-	decoded_buffer[0] = *encoded_buffer;
-	encoded_buffer_idx += 8;
-	for (int i = 1; i < batch_size; i++) {
-		if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-			// The first bit is 0, no need to go further
-			decoded_buffer[i] = decoded_buffer[i - 1];
-			encoded_buffer_idx++;
-			continue;
-		} else {
-			// The first bit is 1, check next bit
-			encoded_buffer_idx++;
-			if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-				// The first two bits are 10 
-				if (encode_key == 1 || encode_key == 2)
-					decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-				else {
-					// encode_key == 3
-					decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-				}
+	end = encoded_buffer + encoded_size;
 
-				encoded_buffer_idx++;
-				continue;
-			} else {
-				// The first two bits are 11
-				if (encode_key == 1) {
-					decoded_buffer[i] = decoded_buffer[i - 1] - 1;
+	ptr = read_checkpoints(encoded_buffer, end, zeros, batch_size, checkpoint_interval, &checkpoints, 
+			&checkpoint_count, &runs_size, &expected_count);
+	if (ptr == NULL)
+		return (-1);
 
-					encoded_buffer_idx++;
-					continue;
-				}
+	if (!zeros)
+		return decode_deltas(encode_key, batch_size, ptr, end - ptr, decoded_buffer);
 
-				encoded_buffer_idx++;
-				if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-					// The first three bits are 110
-					if (encode_key == 2) {
-						decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-					} else {
-						// encode_key == 3
-						decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-					}
-					encoded_buffer_idx++;
-					continue;
-				} else {
-					// The first three bits are 111, check next bit
-					encoded_buffer_idx++;
-					if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-						// The first four bits are 1110, delta = 2
-						decoded_buffer[i] = decoded_buffer[i - 1] + 2;
-					} else {
-						// The first four bits are 1111, delta = (-2)
-						decoded_buffer[i] = decoded_buffer[i - 1] - 2;
-					}
-					encoded_buffer_idx++;
-					continue;
-				}
-			}
-		}
+	runs = ptr;
+	nonzero_count = 0;
+	for (run = 0, done = 0; done < batch_size; run++, done += length) {
+		ptr = get_varint(ptr, end, &length);
+		if (ptr == NULL || length > batch_size - done)
+			return (-1);
+
+		if (run % 2 == 0)
+			nonzero_count += length;
+	}
+
+	// The counts read with the checkpoints must match the runs
+	if (checkpoint_interval != 0 && (nonzero_count != expected_count || ptr - runs != runs_size))
+		return (-1);
+
+	nonzero = decoded_buffer + batch_size - nonzero_count;
+	if (nonzero_count > 0 && decode_deltas(encode_key, nonzero_count, ptr, end - ptr, nonzero) != 0)
+		return (-1);
+
+	// The elements are never moved up, the ones not moved yet are
+	// always behind the place they are moved to
+	ptr = runs;
+	for (run = 0, done = 0; done < batch_size; run++, done += length) {
+		ptr = get_varint(ptr, end, &length);
+		if (run % 2 == 0) {
+			memmove(decoded_buffer + done, nonzero, length);
+			nonzero += length;
+		} else
+			memset(decoded_buffer + done, ZERO_BUCKET, length);
 	}
 
 	return 0;
 }
 
-// Decode encoded buffer when the encode key is 1 | 2 | 3
-int
-uint8_decode_4_5(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer)
+// Reads the runs written by put_zero_runs from the run at ptr, which starts
+// with element run_start and has no ZERO_BUCKET element unless zero is set,
+// up to the run of element index. Sets count to the number of elements
+// which are not ZERO_BUCKET from element elem of the first run up to and
+// including element index. Returns 1 if element index is ZERO_BUCKET, 0
+// if it is not, -1 in case of error
+static int
+read_zero_runs(uint8_t *ptr, uint8_t *end, uint32_t batch_size, uint32_t run_start, int zero, uint32_t elem, 
+		uint32_t index, uint32_t *count)
 {
-uint32_t encoded_buffer_idx;
-uint64_t val64;
-uint8_t val8;
-uint16_t *p_val16;
-uint16_t encoded_buffer_size;
-int delta;
-int val;
-int bit3;
-int bit4;
-
-	// Save the encoded length for diagnostics
-	p_val16 = (uint16_t *)encoded_buffer;
-	encoded_buffer_size = *p_val16++;
-	encoded_buffer = (uint8_t *)p_val16;
-
-	encoded_buffer_idx = 0;
-
-	decoded_buffer[0] = *encoded_buffer;
-	encoded_buffer_idx += 8;
-	for (int i = 1; i < batch_size; i++) {
-		if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-			// The first bit is 0, no need to go further
-			decoded_buffer[i] = decoded_buffer[i - 1];
-			encoded_buffer_idx++;
-			continue;
-		} else {
-			// The first bit is 1, check next bit
-			encoded_buffer_idx++;
-			if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-				// The first two bits are 10 
-				if (encode_key == 4)
-					decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-				else {
-					// encode_key == 5
-					decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-				}
+uint64_t length;
 
-				encoded_buffer_idx++;
-				continue;
-			} else {
-				// The first two bits are 11, check next bit
-				encoded_buffer_idx++;
-				if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-					// The first three bits are 110
-					if (encode_key == 4) {
-						decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-					} else {
-						// encode_key == 5
-						decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-					}
-					encoded_buffer_idx++;
-					continue;
-				} else {
-					// The first three bits are 111, check next bit
-					encoded_buffer_idx++;
-					bit3 = get_bit(encoded_buffer, encoded_buffer_idx);
-					encoded_buffer_idx++;
-					bit4 = get_bit(encoded_buffer, encoded_buffer_idx);
-					encoded_buffer_idx++;
-					if (bit3 == 0) {
-						// The first four bits are 1110
-						if (bit4 == 0) {
-							// The first five bits are 11100
-							decoded_buffer[i] = decoded_buffer[i - 1] + 2;
-						} else {
-							// The first five bits are 11101
-							decoded_buffer[i] = decoded_buffer[i - 1] - 2;
-						}
-					} else {
-						// The first four bits are 1111
-						if (bit4 == 0) {
-							// The first five bits are 11110
-							decoded_buffer[i] = decoded_buffer[i - 1] + 3;
-						} else {
-							// The first five bits are 11111
-							decoded_buffer[i] = decoded_buffer[i - 1] - 3;
-						}
-					}
-					continue;
-				}
-			}
-		}
-	}
-	return 0;
-}
+	*count = 0;
+	for (;;) {
+		ptr = get_varint(ptr, end, &length);
+		if (ptr == NULL || length > batch_size - run_start)
+			return (-1);
 
-// Decode encoded buffer when the encode key is 6 | 7 | 8 | 9
-int
-uint8_decode_6_7_8_9(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer)
-{
-uint32_t encoded_buffer_idx;
-uint64_t val64;
-uint8_t val8;
-uint16_t *p_val16;
-uint16_t encoded_buffer_size;
-int delta;
-int val;
-int bit3;
-int bit4;
-int bit5;
-int bit6;
-int bit7;
-
-	// Save the encoded length in bytes for diagnostics
-	p_val16 = (uint16_t *)encoded_buffer;
-	encoded_buffer_size = *p_val16++;
-	encoded_buffer = (uint8_t *)p_val16;
-
-	encoded_buffer_idx = 0;
-
-	decoded_buffer[0] = *encoded_buffer;
-	encoded_buffer_idx += 8;
-	for (int i = 1; i < batch_size; i++) {
-		if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-			// The first bit is 0, no need to go further
-			decoded_buffer[i] = decoded_buffer[i - 1];
-			encoded_buffer_idx++;
-			continue;
-		} else {
-			// The first bit is 1, check next bit
-			encoded_buffer_idx++;
-			if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-				// The first two bits are 10 
-				if (encode_key == 6 || encode_key == 8)
-					decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-				else {
-					// encode_key == 7 || encode_key == 9
-					decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-				}
+		if (index < run_start + length) {
+			if (zero)
+				return 1;
 
-				encoded_buffer_idx++;
-				continue;
-			} else {
-				// The first two bits are 11, check next bit
-				encoded_buffer_idx++;
-				if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-					// The first three bits are 110
-					if (encode_key == 6 || encode_key == 8) {
-						decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-					} else {
-						// encode_key == 7 || encode_key == 9
-						decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-					}
-					encoded_buffer_idx++;
-					continue;
-				} else {
-					// The first three bits are 111, check next two bits
-					encoded_buffer_idx++;
-					bit4 = get_bit(encoded_buffer, encoded_buffer_idx);
-					encoded_buffer_idx++;
-					bit5 = get_bit(encoded_buffer, encoded_buffer_idx);
-					encoded_buffer_idx++;
-					if (bit4 == 0) {
-						// The first four bits are 1110
-						if (bit5 == 0) {
-							// The first five bits are 11100
-							decoded_buffer[i] = decoded_buffer[i - 1] + 2;
-						} else {
-							// The first five bits are 11101
-							decoded_buffer[i] = decoded_buffer[i - 1] - 2;
-						}
-					} else {
-						// The first four bits are 1111
-						bit6 = get_bit(encoded_buffer, encoded_buffer_idx);
-						encoded_buffer_idx++;
-						if (bit5 == 0) {
-							// The first five bits are 11110
-							if (bit6 == 0) {
-								// The first six bits are 111100
-								decoded_buffer[i] = decoded_buffer[i - 1] + 3;
-							} else {
-								// The first six bits are 111101
-								decoded_buffer[i] = decoded_buffer[i - 1] - 3;
-							}
-						} else {
-							// The first five bits are 11111
-							if (encode_key == 6 || encode_key == 7) {
-								// The first five bits are 11110
-								if (bit6 == 0) {
-									// The first six bits are 111110
-									decoded_buffer[i] = decoded_buffer[i - 1] + 4;
-								} else {
-									// The first six bits are 111111
-									decoded_buffer[i] = decoded_buffer[i - 1] - 4;
-								}
-							} else {
-								// (encode_key == 8 || encode_key == 9)
-								bit7 = get_bit(encoded_buffer, encoded_buffer_idx);
-								encoded_buffer_idx++;
-								if (bit6 == 0) {
-									// The first six bits are 111110
-									if (bit7 == 0) {
-										// The first seven bits are 1111100
-										decoded_buffer[i] = decoded_buffer[i - 1] + 4;
-									} else {
-										// The first seven bits are 1111101
-										decoded_buffer[i] = decoded_buffer[i - 1] - 4;
-									}
-								} else {
-									// The first six bits are 111111
-									if (bit7 == 0) {
-										// The first seven bits are 1111110
-										decoded_buffer[i] = decoded_buffer[i - 1] + 5;
-									} else {
-										// The first seven bits are 1111111
-										decoded_buffer[i] = decoded_buffer[i - 1] - 5;
-									}
-								}
-							}
-						}
-					}
-				}
-			}
+			*count += index - elem + 1;
+			return 0;
 		}
+
+		if (!zero)
+			*count += run_start + length - elem;
+
+		run_start += length;
+		elem = run_start;
+		zero = !zero;
 	}
-	return 0;
 }
 
-// Decode encoded buffer when the encode key is 10 | 11 | 12 | 13
+// Decodes element index of the batch_size elements encoded by uint8_encode
+// at encoded_buffer and sets bucket to it. Only the runs of ZERO_BUCKET
+// elements and the deltas that follow the checkpoint before the element
+// are decoded. Returns 0 on success, -1 in case of error
 int
-uint8_decode_10_11_12_13(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer)
+uint8_decode_element(uint8_t encode_key, uint32_t batch_size, uint8_t *encoded_buffer, uint32_t encoded_size, 
+		uint32_t checkpoint_interval, uint32_t index, uint8_t *bucket)
 {
-uint32_t encoded_buffer_idx;
-uint64_t val64;
-uint8_t val8;
-uint16_t *p_val16;
-uint16_t encoded_buffer_size;
-int delta;
-int val;
+decode_entry *table;
+bit_reader br;
+uint8_t *ptr;
+uint8_t *end;
+uint8_t *runs;
+uint8_t *checkpoints;
+uint8_t *checkpoint;
+uint32_t checkpoint_count;
+uint32_t checkpoint_size;
+uint32_t nonzero_index;
+uint32_t bit_offset;
+uint32_t delta_count;
+uint32_t elem;
+uint32_t run_offset;
+uint32_t run_start;
+uint32_t low;
+uint32_t high;
+uint32_t mid;
+uint32_t done;
+uint64_t runs_size;
+uint64_t nonzero_count;
+uint64_t length;
+uint8_t val;
+int zeros;
+int status;
+
+	zeros = encode_key & ENCODE_KEY_ZEROS;
+	encode_key &= ~ENCODE_KEY_ZEROS;
+
+	if (encode_key == 0 || encode_key > MAX_ENCODE_KEY || index >= batch_size)
+		return (-1);
+
+	end = encoded_buffer + encoded_size;
+
+	ptr = read_checkpoints(encoded_buffer, end, zeros, batch_size, checkpoint_interval, &checkpoints, 
+			&checkpoint_count, &runs_size, &nonzero_count);
+	if (ptr == NULL)
+		return (-1);
+
+	// Find the checkpoint before the element, the one of the element
+	// itself counts. checkpoint is NULL if decoding starts with the
+	// first element
+	checkpoint = NULL;
+	checkpoint_size = zeros ? ZERO_CHECKPOINT_SIZE : CHECKPOINT_SIZE;
+	if (!zeros) {
+		nonzero_index = index;
+		if (checkpoint_interval != 0 && index >= checkpoint_interval)
+			checkpoint = checkpoints + (index / checkpoint_interval - 1) * checkpoint_size;
+	} else if (checkpoint_count > 0) {
+		// The positions of the elements of the checkpoints are
+		// increasing
+		low = 0;
+		high = checkpoint_count;
+		while (low < high) {
+			mid = low + (high - low) / 2;
+			memcpy(&elem, checkpoints + mid * checkpoint_size + CHECKPOINT_SIZE, sizeof(uint32_t));
+			if (elem <= index)
+				low = mid + 1;
+			else
+				high = mid;
+		}
 
-	// Save the encoded length for diagnostics
-	p_val16 = (uint16_t *)encoded_buffer;
-	encoded_buffer_size = *p_val16++;
-	encoded_buffer = (uint8_t *)p_val16;
+		if (low > 0)
+			checkpoint = checkpoints + (low - 1) * checkpoint_size;
+	}
 
-	encoded_buffer_idx = 0;
+	if (zeros) {
+		runs = ptr;
+		if (checkpoint_interval != 0) {
+			if (runs_size > end - runs)
+				return (-1);
+			ptr = runs + runs_size;
+		}
 
-	// The first element is not encoded
-	decoded_buffer[0] = *encoded_buffer;
-	encoded_buffer_idx += 8;
-
-	for (int i = 1; i < batch_size; i++) {
-		if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-			// The first bit is 0, no need to go further
-			decoded_buffer[i] = decoded_buffer[i - 1];
-			encoded_buffer_idx++;
-			continue;
+		if (checkpoint == NULL) {
+			status = read_zero_runs(runs, end, batch_size, 0, 0, 0, index, &nonzero_index);
 		} else {
-			// The first bit is 1, check next bit
-			encoded_buffer_idx++;
-			if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-				// The first two bits are 10 
-				if (encode_key == 10 || encode_key == 12)
-					decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-				else {
-					// encode_key == 11 || encode_key == 13
-					decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-				}
+			memcpy(&elem, checkpoint + CHECKPOINT_SIZE, sizeof(uint32_t));
+			memcpy(&run_offset, checkpoint + CHECKPOINT_SIZE + sizeof(uint32_t), sizeof(uint32_t));
+			memcpy(&run_start, checkpoint + CHECKPOINT_SIZE + 2 * sizeof(uint32_t), sizeof(uint32_t));
+			if (run_offset >= runs_size || run_start > elem || elem > index)
+				return (-1);
 
-				encoded_buffer_idx++;
-				continue;
-			} else {
-				// The first two bits are 11, check next bit
-				encoded_buffer_idx++;
-				if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-					// The first three bits are 110
-				if (encode_key == 10 || encode_key == 12) {
-					decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-				} else {
-					// encode_key == 11 || encode_key == 13
-					decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-				}
-					encoded_buffer_idx++;
-					continue;
-				} else {
-					// The first three bits are 111, check next bit
-					encoded_buffer_idx++;
-					if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-						// The first four bits are 1110, check next bit
-						encoded_buffer_idx++;
-						if (get_bit(encoded_buffer, encoded_buffer_idx) == 0)
-							// Found 11100
-							decoded_buffer[i] = decoded_buffer[i - 1] + 2;
-						else {
-							// Found 11101
-							decoded_buffer[i] = decoded_buffer[i - 1] - 2;
-						}
-						encoded_buffer_idx++;
-						continue;
-					} else {
-						// The first four bits are 1111, check next bit
-						encoded_buffer_idx++;
-						if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-							// The first five bits are 11110, depending on encode key
-							// fetch next two or next three bits
-							if (encode_key == 10 || encode_key == 11) {
-								// Fetch next two bits
-								encoded_buffer_idx++;
-								read_bitstream(encoded_buffer, encoded_buffer_idx, 2, &val64);
-								encoded_buffer_idx += 2;
-							} else {
-								// encode_key == 12 || encode_key == 13
-								// Fetch next three bits
-								encoded_buffer_idx++;
-								read_bitstream(encoded_buffer, encoded_buffer_idx, 3, &val64);
-								encoded_buffer_idx += 3;
-							}
-
-							val = val64;
-							val += 3;
-							val = decoded_buffer[i - 1] + val;
-							decoded_buffer[i] = val;
-						} else {
-							// The first five bits are 11111, depending on encode key
-							// fetch next two or next three bits
-							if (encode_key == 10 || encode_key == 11) {
-								// Fetch next two bits
-								encoded_buffer_idx++;
-								read_bitstream(encoded_buffer, encoded_buffer_idx, 2, &val64);
-								encoded_buffer_idx += 2;
-							} else {
-								// encode_key == 12 || encode_key == 13
-								// Fetch next three bits
-								encoded_buffer_idx++;
-								read_bitstream(encoded_buffer, encoded_buffer_idx, 3, &val64);
-								encoded_buffer_idx += 3;
-							}
-							
-							val = val64;
-							val += 3;
-							val = decoded_buffer[i - 1] - val;
-							decoded_buffer[i] = val;
-						}
-
-						continue;
-					}
-				}
+			status = read_zero_runs(runs + run_offset, end, batch_size, run_start, 0, elem, index, &nonzero_index);
+		}
+
+		if (status != 0) {
+			*bucket = ZERO_BUCKET;
+			return status;
+		}
+
+		// Without checkpoints all runs are read to find where they end
+		if (checkpoint_interval == 0) {
+			for (done = 0; done < batch_size; done += length) {
+				ptr = get_varint(ptr, end, &length);
+				if (ptr == NULL || length > batch_size - done)
+					return (-1);
 			}
 		}
+
+		// nonzero_index counts the element itself
+		nonzero_index--;
 	}
-	return 0;
-}
 
-// Decode encoded buffer when the encode key is 14 | 15 | 16 | 17
-int
-uint8_decode_14_15_16_17(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer)
-{
-uint32_t encoded_buffer_idx;
-uint64_t val64;
-uint8_t val8;
-uint16_t *p_val16;
-uint16_t encoded_buffer_size;
-int delta;
-int val;
-int bit7;
+	if (ptr >= end)
+		return (-1);
+
+	// Start with the first element or the checkpoint before the element
+	if (checkpoint == NULL) {
+		val = *ptr;
+		bit_offset = 0;
+		delta_count = nonzero_index;
+	} else {
+		memcpy(&bit_offset, checkpoint, sizeof(uint32_t));
+		val = checkpoint[sizeof(uint32_t)];
+		delta_count = zeros ? nonzero_index + 1 : index % checkpoint_interval + 1;
+	}
 
-	// Save the encoded length for diagnostics
-	p_val16 = (uint16_t *)encoded_buffer;
-	encoded_buffer_size = *p_val16++;
-	encoded_buffer = (uint8_t *)p_val16;
+	// The codes start after the first element
+	ptr++;
+	if (bit_offset / 8 > end - ptr)
+		return (-1);
 
-	encoded_buffer_idx = 0;
+	pthread_once(&decode_tables_once, build_decode_tables);
 
-	// The first element is not encoded
-	decoded_buffer[0] = *encoded_buffer;
-	encoded_buffer_idx += 8;
-
-	for (int i = 1; i < batch_size; i++) {
-		if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-			// The first bit is 0, no need to go further
-			decoded_buffer[i] = decoded_buffer[i - 1];
-			encoded_buffer_idx++;
-			continue;
-		} else {
-			// The first bit is 1, check next bit
-			encoded_buffer_idx++;
-			if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-				// The first two bits are 10 
-				if (encode_key == 14 || encode_key == 16)
-					decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-				else {
-					// encode_key == 15 || encode_key == 17
-					decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-				}
+	table = decode_table[encode_key];
 
-				encoded_buffer_idx++;
-				continue;
-			} else {
-				// The first two bits are 11, check next bit
-				encoded_buffer_idx++;
-				if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-					// The first three bits are 110
-					if (encode_key == 14 || encode_key == 16) {
-						decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-					} else {
-						// encode_key == 15 || encode_key == 17
-						decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-					}
-					encoded_buffer_idx++;
-					continue;
-				} else {
-					// The first three bits are 111, check next bit
-					encoded_buffer_idx++;
-					if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-						// The first four bits are 1110, check next bit
-						encoded_buffer_idx++;
-						if (get_bit(encoded_buffer, encoded_buffer_idx) == 0)
-							// Found 11100
-							decoded_buffer[i] = decoded_buffer[i - 1] + 2;
-						else {
-							// Found 11101
-							decoded_buffer[i] = decoded_buffer[i - 1] - 2;
-						}
-						encoded_buffer_idx++;
-						continue;
-					} else {
-						// The first four bits are 1111, check next bit
-						encoded_buffer_idx++;
-						if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-							// The first five bits are 11110, check next bit
-							encoded_buffer_idx++;
-							if (get_bit(encoded_buffer, encoded_buffer_idx) == 0)
-								// Found 111100
-								decoded_buffer[i] = decoded_buffer[i - 1] + 3;
-							else {
-								// Found 111101
-								decoded_buffer[i] = decoded_buffer[i - 1] - 3;
-							}
-							encoded_buffer_idx++;
-							continue;
-						} else {
-							// The first five bits are 11111, check next bit
-							encoded_buffer_idx++;
-							if (get_bit(encoded_buffer, encoded_buffer_idx) == 0) {
-								// Found 111110
-								encoded_buffer_idx++;
-								if (get_bit(encoded_buffer, encoded_buffer_idx) == 0)
-									// Found 1111100
-									decoded_buffer[i] = decoded_buffer[i - 1] + 4;
-								else {
-									// Found 1111101
-									decoded_buffer[i] = decoded_buffer[i - 1] - 4;
-								}
-								encoded_buffer_idx++;
-								continue;
-							} else {
-								//  The first six bits are 111111, check next bit
-								encoded_buffer_idx++;
-								bit7 = get_bit(encoded_buffer, encoded_buffer_idx);
-								// Depending on encode key, fetch next three or next four bits
-								if (encode_key == 14 || encode_key == 15) {
-									// Fetch next three bits
-									encoded_buffer_idx++;
-									read_bitstream(encoded_buffer, encoded_buffer_idx, 3, &val64);
-									encoded_buffer_idx += 3;
-								} else {
-									// encode_key == 16 || encode_key == 17
-									// Fetch next four bits
-									encoded_buffer_idx++;
-									read_bitstream(encoded_buffer, encoded_buffer_idx, 4, &val64);
-									encoded_buffer_idx += 4;
-								}
-
-								if (bit7 == 0) {
-									// The first seven bits are 1111110
-									// Range is 5 .. 5 + 7  for encode_key == 14
-									// Range is 5 .. 5 + 15 for encode_key == 14
-									val = val64 + 5;
-									decoded_buffer[i] = decoded_buffer[i - 1] + val;
-								} else {
-									// The first seven bits are 1111111
-									// Range is -5 .. -5 - 7  for encode_key == 14
-									// Range is -5 .. -5 - 15 for encode_key == 14
-									val = val64 + 5;
-									decoded_buffer[i] = decoded_buffer[i - 1] - val;
-								}									
-							}
-						}
-					}
-				}
-			}
-		}
-	}
-	return 0;
-}
+	bit_reader_init(&br, ptr + bit_offset / 8, end - ptr - bit_offset / 8);
+	bit_reader_refill(&br);
+	bit_reader_consume(&br, bit_offset % 8);
 
-// Decode encoded buffer when the encode key is 14 | 15 | 16 | 17
-int
-uint8_decode_18(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer)
-{
-uint32_t encoded_buffer_idx;
-uint64_t val64;
-uint8_t val8;
-uint16_t *p_val16;
-uint16_t encoded_buffer_size;
-int delta;
-int val;
-int bit4;
+	for (uint32_t i = 0; i < delta_count; i++) {
+		bit_reader_refill(&br);
+		val = val + decode_delta(table, &br);
+	}
 
-	// Save the encoded length for diagnostics
-	p_val16 = (uint16_t *)encoded_buffer;
-	encoded_buffer_size = *p_val16++;
-	encoded_buffer = (uint8_t *)p_val16;
+	// Ran past the end of the encoded buffer, it must be corrupt
+	if (bit_reader_position(&br) > (uint64_t) (end - ptr - bit_offset / 8) * 8)
+		return (-1);
 
-	encoded_buffer_idx = 0;
+	*bucket = val;
 
-	// The first element is not encoded
-	decoded_buffer[0] = *encoded_buffer;
-	encoded_buffer_idx += 8;
-
-	// 18: delta values 0, +1, -1, +2, -2, +3, -3, +4 .. +10, -4 .. -10, +11 .. +26, -11 .. -26
-	//    Encoding 000, 001, 010, 011, 100, 101, 110, 1110XXX, 1111XXX, 1110111XXXX, 1111111XXXX
-	//
-	for (int i = 1; i < batch_size; i++) {
-		read_bitstream(encoded_buffer, encoded_buffer_idx, 3, &val64);
-		encoded_buffer_idx += 3;
-		if (val64 < 7) {
-			switch(val64){
-				case 0b000: decoded_buffer[i] = decoded_buffer[i - 1];
-						break;
-				case 0b100: decoded_buffer[i] = decoded_buffer[i - 1] + 1;
-						break;
-				case 0b010: decoded_buffer[i] = decoded_buffer[i - 1] - 1;
-						break;
-				case 0b110: decoded_buffer[i] = decoded_buffer[i - 1] + 2;
-						break;
-				case 0b001: decoded_buffer[i] = decoded_buffer[i - 1] - 2;
-						break;
-				case 0b101: decoded_buffer[i] = decoded_buffer[i - 1] + 3;
-						break;
-				case 0b011: decoded_buffer[i] = decoded_buffer[i - 1] - 3;
-						break;
-			}
-			continue;
-		} else { // val64 equals 7
-			bit4 = get_bit(encoded_buffer, encoded_buffer_idx);
-			encoded_buffer_idx++;
-			if (bit4 == 0) {
-				// The first four bits are 1110 , read 3 more bits
-				read_bitstream(encoded_buffer, encoded_buffer_idx, 3, &val64);
-				encoded_buffer_idx += 3;
-				if (val64 < 7) {
-					decoded_buffer[i] = decoded_buffer[i - 1] + (4 + val64);
-					continue;
-				} else { // val64 equals 7
-					// The first four bits are 1110111 , read 4 more bits
-					read_bitstream(encoded_buffer, encoded_buffer_idx, 4, &val64);
-					encoded_buffer_idx += 4;
-					decoded_buffer[i] = decoded_buffer[i - 1] + (11 + val64);
-					continue;
-				}
-			} else {
-				// The first four bits are 1111 , read 3 more bits
-				read_bitstream(encoded_buffer, encoded_buffer_idx, 3, &val64);
-				encoded_buffer_idx += 3;
-				if (val64 < 7) {
-					decoded_buffer[i] = decoded_buffer[i - 1] - (4 + val64);
-					continue;
-				} else { // val64 equals 7
-					// The first four bits are 1110111 , read 4 more bits
-					read_bitstream(encoded_buffer, encoded_buffer_idx, 4, &val64);
-					encoded_buffer_idx += 4;
-					decoded_buffer[i] = decoded_buffer[i - 1] - (11 + val64);
-					continue;
-				}
-			}
-		}
-	}
 	return 0;
 }
-
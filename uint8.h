@@ -1,17 +1,21 @@
 
-void uint8_encode(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf);
-void uint8_encode_1_2_3(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf);
-void uint8_encode_4_5(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf);
-void uint8_encode_6_7_8_9(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf);
-void uint8_encode_10_11_12_13(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf);
-void uint8_encode_10_11_12_13(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf);
-void uint8_encode_14_15_16_17(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf);
-void uint8_encode_18(uint8_t encode_key, uint16_t len, uint8_t *buf, uint8_t *encoded_buf);
+// Encode keys 1 .. MAX_ENCODE_KEY use delta encoding, 0 means no encoding
+#define MAX_ENCODE_KEY 18
 
-int uint8_decode(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer);
-int uint8_decode_1_2_3(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer);
-int uint8_decode_4_5(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer);
-int uint8_decode_6_7_8_9(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer);
-int uint8_decode_10_11_12_13(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer);
-int uint8_decode_14_15_16_17(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer);
-int uint8_decode_18(uint8_t encode_key, uint16_t batch_size, uint8_t *encoded_buffer, uint8_t *decoded_buffer);
+// Set in the encode key of a batch that has zero buckets
+#define ENCODE_KEY_ZEROS 0x80
+
+// Size of a checkpoint, the bit offset of a code and a bucket number
+#define CHECKPOINT_SIZE (sizeof(uint32_t) + sizeof(uint8_t))
+
+// Size of a checkpoint of an array that has zero buckets, which also holds
+// the position of its element and of its run
+#define ZERO_CHECKPOINT_SIZE (CHECKPOINT_SIZE + 3 * sizeof(uint32_t))
+
+uint32_t uint8_encode(uint8_t encode_key, uint32_t len, uint8_t *buf, uint8_t *encoded_buf, uint32_t checkpoint_interval);
+
+int uint8_decode(uint8_t encode_key, uint32_t batch_size, uint8_t *encoded_buffer, uint32_t encoded_size, 
+		uint32_t checkpoint_interval, uint8_t *decoded_buffer);
+int uint8_decode_element(uint8_t encode_key, uint32_t batch_size, uint8_t *encoded_buffer, uint32_t encoded_size, 
+		uint32_t checkpoint_interval, uint32_t index, uint8_t *bucket);
+uint32_t uint8_checkpoint_count(uint32_t count, uint32_t checkpoint_interval);